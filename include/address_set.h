@@ -0,0 +1,140 @@
+/**
+ * @file address_set.h
+ * @author Aryan Chopra
+ * @brief Contains the declarations of a set of IPv4 addresses and prefixes,
+ * the local addresses a network device answers for.
+ */
+
+#ifndef ADDRESS_SET_H
+#define ADDRESS_SET_H
+
+#include <stdint.h>
+
+#define ADDRESS_SET_LEN 16 ///Initial number of slots of the table of a prefix length, a power of two.
+#define ADDRESS_SET_LOAD 75 ///Percentage of used slots above which the table of a prefix length is doubled.
+
+/**
+ * @struct AddressSlot
+ * @brief A slot of the table of a prefix length.
+ *
+ * @var AddressSlot::network
+ * The prefix, in host notation, its host bits cleared.
+ *
+ * @var AddressSlot::used
+ * Whether the slot holds a prefix.
+ */
+
+typedef struct {
+  uint32_t network;
+  uint32_t used;
+} AddressSlot;
+
+/**
+ * @struct AddressSet
+ * @brief A struct holding a set of IPv4 prefixes, one hash table per prefix
+ * length.
+ *
+ * A single address is a prefix of 32 bits.
+ * Looking an address up probes one table per prefix length present in the
+ * set, however many prefixes the set holds.
+ *
+ * @var AddressSet::slots
+ * The open-addressing table of every prefix length, NULL while the length
+ * has no prefix.
+ *
+ * @var AddressSet::masks
+ * The number of slots of every table minus one.
+ *
+ * @var AddressSet::counts
+ * The number of prefixes of every length.
+ *
+ * @var AddressSet::lengths
+ * The prefix lengths present in the set, one bit per length.
+ */
+
+typedef struct {
+  AddressSlot *slots[33];
+  uint32_t masks[33];
+  uint32_t counts[33];
+  uint64_t lengths;
+} AddressSet;
+
+/**
+ * @brief Allocates an empty set of addresses.
+ *
+ *
+ * Prints the error and exits the process if the set cannot be allocated.
+ *
+ * @return AddressSet * The set.
+ */
+
+AddressSet *newAddressSet();
+
+/**
+ * @brief Adds a prefix to the set.
+ *
+ *
+ * The set is not synchronized, it is filled before the workers are started
+ * and only read afterwards.
+ * Prints the error and exits the process if the table cannot be grown.
+ *
+ * @param[in, out] AddressSet * The set.
+ * @param[in] uint32_t An address of the prefix, in Network notation(Big
+ * Endian), its host bits ignored.
+ * @param[in] int The length of the prefix, 32 for a single address.
+ * @return int 0 if the prefix was added, -1 if the length is invalid.
+ */
+
+int addAddress(AddressSet *, uint32_t, int);
+
+/**
+ * @brief Checks whether an address belongs to a prefix of the set.
+ *
+ * @param[in] AddressSet * The set.
+ * @param[in] uint32_t The address, in Network notation(Big Endian).
+ * @return int 1 if the address belongs to the set, 0 otherwise.
+ */
+
+int containsAddress(AddressSet *, uint32_t);
+
+/**
+ * @brief Parses an address or a prefix in decimal notation, such as
+ * 10.1.0.0/16.
+ *
+ * @param[in] char * The address, followed by the length of the prefix if it
+ * is not a single address.
+ * @param[out] uint32_t * The address, in Network notation(Big Endian).
+ * @param[out] int * The length of the prefix, 32 for a single address.
+ * @return int 0 if the prefix was parsed, -1 otherwise.
+ */
+
+int parsePrefix(char *, uint32_t *, int *);
+
+/**
+ * @brief Parses an address or a prefix in decimal notation, such as
+ * 10.1.0.0/16, and adds it to the set.
+ *
+ * @param[in, out] AddressSet * The set.
+ * @param[in] char * The address, followed by the length of the prefix if it
+ * is not a single address.
+ * @return int 0 if the prefix was added, -1 if it could not be parsed.
+ */
+
+int parseAddress(AddressSet *, char *);
+
+/**
+ * @brief Adds every address or prefix listed in a file to the set, one per
+ * line.
+ *
+ *
+ * Skips the empty lines and the lines starting with #.
+ * Prints the error and exits the process if the file cannot be read or a
+ * line cannot be parsed.
+ *
+ * @param[in, out] AddressSet * The set.
+ * @param[in] char * The path of the file.
+ */
+
+void loadAddresses(AddressSet *, char *);
+
+#endif
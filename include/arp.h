@@ -5,9 +5,9 @@
  *
  * This header file declares various structures to be used by ARP functionality, viz
  * representing an ARP header, an ARP data header, which is the payload of an ARP header
- * containing information about sender and host, and an ARP Cache Entry struct which is 
- * a single entry for the ARP cache containing IP address and MAC address of various
- * devices that interacted with the process.
+ * containing information about sender and host.
+ * The ARP cache holding the IP address and MAC address of various devices that
+ * interacted with the process is declared in arp_cache.h.
  */
 
 #ifndef ARP_H
@@ -15,9 +15,10 @@
 
 #include <stdint.h>
 
-#include "ethernet.h"
+#include "arp_cache.h"
 #include "ethernet.h"
 #include "netdev.h"
+#include "packet.h"
 
 #define ARP_ETHERNET 0x0001 ///Predefined code for specifying that ARP request was carried over Ethernet.
 #define ARP_IPV4 0x0800 ///Predefined code for specifying that the protocol used to carry the request is IPv4.
@@ -25,9 +26,14 @@
 #define ARP_REQUEST 0x0001 ///Predefined code for specifying that ARP header contains an ARP Request.
 #define ARP_REPLY 0x0002 ///Predefined code for specifying that ARP header contains a reply to an ARP Request.
 
-#define ARP_CACHE_LEN 32
-#define ARP_FREE 0
-#define ARP_RESOLVED 2
+#define ARP_FRAME_LEN 42 ///Length of an ARP frame, its ethernet header, ARP header and IPv4 data.
+
+#define ARP_REACHABLE_TIME 30000 ///Milliseconds an entry stays reachable after its neighbour was last heard from.
+#define ARP_DELAY_TIME 5000 ///Milliseconds a stale entry waits to be used, before it is probed if it was, and expires otherwise.
+#define ARP_PROBE_INTERVAL 1000 ///Milliseconds between two refresh probes of a stale entry.
+#define ARP_PROBE_COUNT 3 ///Number of refresh probes left unanswered before a stale entry expires.
+#define ARP_PROBE_BATCH 16 ///Initial capacity of the list of ARP requests the timers record, to be sent once the cache is unlocked.
+#define ARP_SNAPSHOT_INTERVAL 10000 ///Milliseconds between two snapshots of the ARP cache.
 
 /**
  * @struct ArpHeader
@@ -96,86 +102,115 @@ typedef struct{
 }__attribute__((packed)) arp_ipv4;
 
 /**
- * @struct ArpCacheEntry
- * @brief Structure to contain one entry in the ARP Cache table.
- *
- * An array of Arp Cache Entries make the ARP Cache Table.
- *
- * @var ArpCacheEntry::hardwareType
- * It specifies the tpye of hardware connecting the two devices.
- *
- * @var ArpCacheEntry::sourceIp
- * It specifies the IP address of the device which interacts with the 
- * system.
- * In our case, it will contain the IP address of the device sending the ARP request.
- *
- * @var ArpCacheEntry::sourceMac
- * It specifies the MAC address of the device which interacts with the 
- * system.
- * In our case, it will contain the MAC address of the device sending the 
- * ARP request.
- *
- * @var ArpCacheEntry::state
- * It specifies whether the current entry in ARP Cache is empty(0) or
- * resolved(1).
- * If the entry is empty, it means that there is no information that the
- * current entry has.
- * If the entry is resolved, it means that there the current entry has
- * information about a device.
- * Arp Cache array is cleared(set to zero) when the ARP is initialized, which
- * sets all the states
- * to zero.
+ * @brief This function initializes the ArpCache, allocating ARP_CACHE_LEN free slots, and the wheel aging its entries.
+ *
+ *
+ * Builds the template of the replies sent from the local addresses of the network device.
+ * Restores the neighbours saved in the snapshot file provided which are still reachable, and saves the cache to it
+ * every ARP_SNAPSHOT_INTERVAL milliseconds.
+ *
+ * @param[in] Netdev * The network device the replies are sent from.
+ * @param[in] char * The path of the snapshot file, NULL to start with an empty cache and not save it.
  */
 
-typedef struct{
-	uint16_t hardwareType;
-	uint32_t sourceIp;
-	unsigned char sourceMac[6];
-	unsigned int state;
-} ArpCacheEntry;
+void initArp(Netdev *, char *);
 
 /**
- * @brief This function initializes the ArpCache buffer by setting it to zero(0).
+ * @brief Runs the timers of the ARP cache which expired.
+ *
+ *
+ * Turns the entries whose neighbour was not heard from for ARP_REACHABLE_TIME milliseconds stale, probes the stale
+ * entries, and removes the entries whose probes were left unanswered.
+ * Called by every worker on every iteration of its loop, only one of them advances the wheel during a tick.
+ *
+ * @param[in] Netdev * The network device of the calling worker, the probes are sent from.
+ */
+
+void runArpTimers(Netdev *);
+
+/**
+ * @brief Returns the tick the next timer of the ARP cache is due at, at the latest.
+ *
+ *
+ * Lets a worker sleep until the timers are due rather than waking up every tick, without taking the lock of the cache.
+ *
+ * @return uint64_t The tick, UINT64_MAX when no timer is armed.
+ */
+
+uint64_t arpTimerDeadline();
+
+/**
+ * @brief Transmits a packet to a neighbour, resolving its MAC address first if needed.
+ *
+ *
+ * Sends the packet right away to the MAC address held in the ARP cache if the neighbour is reachable or stale.
+ * Otherwise copies the packet into a buffer taken from the packet pool and queues it on the neighbour's entry, which
+ * holds ARP_PENDING_LEN packets at most, the oldest being dropped first.
+ * The packet is dropped, and counted with the counters of the pipeline, if ARP_PENDING_MAX packets are queued on all
+ * the neighbours already.
+ * A neighbour missing from the cache is inserted waiting, and a broadcast ARP request is sent for it, which is
+ * retransmitted every ARP_PROBE_INTERVAL milliseconds until it is answered, or ARP_PROBE_COUNT requests are left
+ * unanswered and the queued packets are dropped.
+ *
+ * @param[in] Netdev * The network device the packet is sent from.
+ * @param[in, out] EthernetHeader * The frame carrying the packet, whose ethernet header is filled in.
+ * @param[in] uint16_t The type of payload of the frame.
+ * @param[in] int The length of the payload of the frame.
+ * @param[in] uint32_t The IP address of the neighbour.
+ */
+
+void resolveAndTransmit(Netdev *, EthernetHeader *, uint16_t, int, uint32_t);
+
+/**
+ * @brief Looks up the MAC address of a neighbour, starting its resolution if it is not known.
+ *
+ *
+ * A neighbour missing from the cache is inserted waiting, and a broadcast ARP request is sent for it, as for
+ * resolveAndTransmit(), but nothing is queued on its entry.
  *
- * @pre An array containing ArpCacheEntry of size ARP_CACHE_LEN exists.
+ * @param[in] Netdev * The network device the ARP request is sent from.
+ * @param[in] uint32_t The IP address of the neighbour.
+ * @param[out] unsigned char * The MAC address of the neighbour, if it is known.
+ * @return int 0 if the MAC address is known, -1 if the neighbour is being resolved.
  */
 
-void initArp();
+int resolveArp(Netdev *, uint32_t, unsigned char *);
 
 /**
  * @brief Handles the incoming ARP request.
  *
  *
- * Extracts the ARP header from the Ethernet header's payload and ARP devices' informtion.
- * Converts the required information from network notation(Big Endian) to host's notation(mostly Little Endian).
+ * Extracts the ARP devices' information from the ARP header at the offset recorded in the descriptor.
+ * Reads the hardware type and opcode from the descriptor, in host's notation, instead of converting them in the frame.
  * Logs the incoming ARP packet to a log file.
- * Checks if the hardware type is supported and whether the Internet Protocol is version 4.
+ * Checks if the hardware type is supported, the protocol being checked to be IPv4 when the frame is parsed.
+ * Drops the packet, before taking the lock of the cache, if the sender exceeds its rate of ARP packets.
  * Updates the MAC address of the IP address in the ARP cache and updates a flag if the operation is successful.
  * Flag conveys whether the IP address exists in the ARP cache or not.
- * Checks whether the requested IP's MAC exists in the ARP cache.
- * Replies with the requested MAC address.
+ * Inserts the sender in the ARP cache otherwise, which grows as needed.
+ * Marks the sender's entry as reachable, whether the packet is a request or the reply to a probe.
+ * Transmits the packets queued on the sender's entry while its MAC address was being resolved.
+ * Checks whether the requested IP address is one of the local addresses of the device, in constant time.
+ * Replies with the requested MAC address if it is.
  *
  * @param[in] Netdev * A pointer to a struct emulating a network device having IP and MAC address.
- * @param[in] EthernetHeader * A pointer to a struct containing the information of an ethernet header.
+ * @param[in] Packet * The descriptor of the frame carrying the ARP header.
  */
 
-void incomingRequest(Netdev *, EthernetHeader *);
+void incomingRequest(Netdev *, Packet *);
 
 /**
  * @brief Replies the MAC address back to the sender
  *
  *
- * Updates the ARP devices' header marking the destination(our device) as the source,
- * Fills in the requested MAC address.
- * Converts the fields back to Network notation(Big Endian).
- * Updates the opcode of ARP header from request, to response.
- * Updates the length, logs the outgoing ARP packet, and calls the function required to transmit the packet over the network.
+ * Copies the template of the replies sent from our addresses over the frame, its headers already in Network
+ * notation(Big Endian), and patches in the MAC and IP addresses of the sender and the local address requested.
+ * Transmits the frame as it is, without rewriting or logging it again.
  *
  * @param[in] Netdev A struct emulating a network device having IP and MAC address.
- * @param[in, out] EthernetHeader A struct containing the information of an ethernet header.
- * @param[in, out] ArpHeader A struct containing the information about the device sending the ARP request.
+ * @param[in, out] Packet The descriptor of the frame carrying the ARP request, the reply is built in place in the frame.
  */
 
-void replyArp(Netdev *, EthernetHeader *, ArpHeader *);
+void replyArp(Netdev *, Packet *);
 
 #endif
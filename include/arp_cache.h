@@ -0,0 +1,217 @@
+/**
+ * @file arp_cache.h
+ * @author Aryan Chopra
+ * @brief Contains the declarations of the ARP cache, a hash table of the
+ * neighbours keyed by their IP address and hardware type, read without any
+ * lock.
+ */
+
+#ifndef ARP_CACHE_H
+#define ARP_CACHE_H
+
+#include <stdint.h>
+
+#include "packet_buffer.h"
+#include "timer.h"
+
+#define ARP_CACHE_LEN 1024 ///Initial number of slots of the ARP cache, a power of two.
+#define ARP_CACHE_LOAD 75 ///Percentage of used slots, deleted ones included, above which the cache is resized.
+
+#define ARP_PENDING_LEN 8 ///Number of packets queued at most on a neighbour whose MAC address is being resolved.
+#define ARP_PENDING_MAX 256 ///Number of packets queued at most on all the neighbours being resolved, counted in the packet pool.
+
+#define ARP_WAITING 1 ///The MAC address of the neighbour is being resolved, the packets sent to it are queued.
+#define ARP_REACHABLE 2 ///The MAC address of the neighbour was confirmed recently.
+#define ARP_STALE 3 ///The MAC address of the neighbour was not confirmed recently, it is probed once a transmit uses it.
+
+/**
+ * @union ArpNeighbour
+ * @brief The MAC address of a neighbour and the state of its entry, read
+ * and written as one word, so a reader never sees half of an update.
+ *
+ * @var ArpNeighbour::mac
+ * The MAC address of the neighbour.
+ *
+ * @var ArpNeighbour::state
+ * It specifies whether the neighbour is being resolved, reachable or stale.
+ *
+ * @var ArpNeighbour::word
+ * The MAC address and the state together.
+ */
+
+typedef union {
+	struct {
+		unsigned char mac[6];
+		uint16_t state;
+	};
+	uint64_t word;
+} ArpNeighbour;
+
+/**
+ * @struct ArpCacheEntry
+ * @brief Structure to contain one entry in the ARP Cache table.
+ *
+ * An entry is allocated once, when the neighbour is inserted, and never
+ * moves when the table is resized, so its timer stays linked in the wheel.
+ * Only the neighbour word is read without the lock of the writers, the key
+ * never changes once the entry is inserted.
+ *
+ * @var ArpCacheEntry::sourceIp
+ * It specifies the IP address of the device which interacts with the
+ * system.
+ * In our case, it will contain the IP address of the device sending the ARP request.
+ *
+ * @var ArpCacheEntry::hardwareType
+ * It specifies the tpye of hardware connecting the two devices.
+ *
+ * @var ArpCacheEntry::neighbour
+ * It specifies the MAC address of the device which interacts with the
+ * system, and whether it is being resolved, reachable or stale.
+ * In our case, it will contain the MAC address of the device sending the
+ * ARP request.
+ *
+ * @var ArpCacheEntry::probes
+ * Number of requests sent since the entry started waiting, or of refresh
+ * probes sent since the entry became stale.
+ *
+ * @var ArpCacheEntry::pending
+ * The packets waiting for the MAC address of the neighbour, oldest first,
+ * linked through their next buffer.
+ *
+ * @var ArpCacheEntry::pendingCount
+ * Number of packets waiting, ARP_PENDING_LEN at most.
+ *
+ * @var ArpCacheEntry::device
+ * Index of the network device the neighbour was last heard on, or is being
+ * resolved on, the requests and probes being sent from it.
+ *
+ * @var ArpCacheEntry::used
+ * Set without the lock of the writers by a transmit which used the entry
+ * while it was stale, so the entry is probed rather than left to expire.
+ *
+ * @var ArpCacheEntry::timer
+ * Timer aging the entry, armed while the entry is in the cache.
+ */
+
+typedef struct{
+	uint32_t sourceIp;
+	uint16_t hardwareType;
+	ArpNeighbour neighbour;
+	uint32_t probes;
+	PacketBuffer *pending;
+	uint32_t pendingCount;
+	int device;
+	int used;
+	Timer timer;
+} ArpCacheEntry;
+
+/**
+ * @brief Allocates the ARP cache with the number of slots provided.
+ *
+ *
+ * Prints the error and exits the process if the cache cannot be allocated.
+ *
+ * @param[in] uint32_t The number of slots, rounded up to a power of two.
+ */
+
+void initArpCache(uint32_t);
+
+/**
+ * @brief Looks up the entry of a neighbour, without any lock.
+ *
+ *
+ * Called by a registered epoch reader, or by a writer, the entry stays
+ * valid until the reader's next quiescent state.
+ *
+ * @param[in] uint16_t The hardware type of the neighbour.
+ * @param[in] uint32_t The IP address of the neighbour.
+ * @return ArpCacheEntry * The entry, or NULL if the neighbour is not in the
+ * cache.
+ */
+
+ArpCacheEntry *lookupArpEntry(uint16_t, uint32_t);
+
+/**
+ * @brief Reads the MAC address and the state of a neighbour at once.
+ *
+ * @param[in] ArpCacheEntry * The entry of the neighbour.
+ * @return ArpNeighbour The MAC address and the state of the neighbour.
+ */
+
+ArpNeighbour readArpNeighbour(ArpCacheEntry *);
+
+/**
+ * @brief Publishes the MAC address and the state of a neighbour at once.
+ *
+ * @param[in, out] ArpCacheEntry * The entry of the neighbour.
+ * @param[in] unsigned char * The MAC address of the neighbour.
+ * @param[in] uint16_t The state of the entry.
+ */
+
+void writeArpNeighbour(ArpCacheEntry *, unsigned char *, uint16_t);
+
+/**
+ * @brief Updates the MAC address of a neighbour already in the cache.
+ *
+ * @param[in] uint16_t The hardware type of the neighbour.
+ * @param[in] uint32_t The IP address of the neighbour.
+ * @param[in] unsigned char * The MAC address of the neighbour.
+ * @return ArpCacheEntry * The entry of the neighbour, or NULL if it was not
+ * in the cache.
+ */
+
+ArpCacheEntry *updateArpEntry(uint16_t, uint32_t, unsigned char *);
+
+/**
+ * @brief Inserts a neighbour in the cache, or updates its MAC address if it
+ * is already there.
+ *
+ *
+ * A new neighbour is inserted in the state provided, with its timer
+ * disarmed.
+ * Resizes the cache first if the insertion would load it above
+ * ARP_CACHE_LOAD.
+ *
+ * @param[in] uint16_t The hardware type of the neighbour.
+ * @param[in] uint32_t The IP address of the neighbour.
+ * @param[in] unsigned char * The MAC address of the neighbour.
+ * @param[in] uint16_t The state of the entry of a new neighbour.
+ * @return ArpCacheEntry * The entry of the neighbour.
+ */
+
+ArpCacheEntry *insertArpEntry(uint16_t, uint32_t, unsigned char *, uint16_t);
+
+/**
+ * @brief Removes the entry of a neighbour from the cache.
+ *
+ *
+ * The entry is handed to the caller, who disarms its timer and retires it,
+ * as readers may still hold it.
+ *
+ * @param[in] uint16_t The hardware type of the neighbour.
+ * @param[in] uint32_t The IP address of the neighbour.
+ * @return ArpCacheEntry * The entry removed, or NULL if the neighbour was
+ * not in the cache.
+ */
+
+ArpCacheEntry *deleteArpEntry(uint16_t, uint32_t);
+
+/**
+ * @brief Calls a function on every entry of the cache.
+ *
+ * @param[in] void (*)(ArpCacheEntry *, void *) The function, called with
+ * every entry and the context.
+ * @param[in] void * The context passed to the function.
+ */
+
+void walkArpCache(void (*)(ArpCacheEntry *, void *), void *);
+
+/**
+ * @brief Returns the number of neighbours in the cache.
+ *
+ * @return uint32_t The number of entries.
+ */
+
+uint32_t arpCacheCount();
+
+#endif
@@ -0,0 +1,116 @@
+/**
+ * @file arp_snapshot.h
+ * @author Aryan Chopra
+ * @brief Contains the declarations of the file format the neighbours of the
+ * ARP cache are saved in, and reloaded from after a restart.
+ */
+
+#ifndef ARP_SNAPSHOT_H
+#define ARP_SNAPSHOT_H
+
+#include <stdint.h>
+
+#define ARP_SNAPSHOT_MAGIC 0x53505241 ///Marks an ARP snapshot file, "ARPS" in the bytes of the file.
+#define ARP_SNAPSHOT_VERSION 1 ///Version of the layout of the snapshot file.
+
+/**
+ * @struct ArpSnapshotHeader
+ * @brief The header starting a snapshot file, followed by its records.
+ *
+ * The numbers are in host notation, a snapshot is reloaded on the machine
+ * which saved it.
+ *
+ * @var ArpSnapshotHeader::magic
+ * ARP_SNAPSHOT_MAGIC.
+ *
+ * @var ArpSnapshotHeader::version
+ * ARP_SNAPSHOT_VERSION.
+ *
+ * @var ArpSnapshotHeader::count
+ * Number of records following the header.
+ *
+ * @var ArpSnapshotHeader::recordSize
+ * Size of a record, checked against the size the process was built with.
+ *
+ * @var ArpSnapshotHeader::saved
+ * The wall-clock time the snapshot was saved at, in milliseconds since the
+ * epoch.
+ */
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t count;
+  uint32_t recordSize;
+  uint64_t saved;
+} __attribute__((packed)) ArpSnapshotHeader;
+
+/**
+ * @struct ArpSnapshotRecord
+ * @brief A neighbour saved in a snapshot file.
+ *
+ * @var ArpSnapshotRecord::expires
+ * The wall-clock time the entry turns stale at, in milliseconds since the
+ * epoch, the entry being dropped if it is reloaded later.
+ *
+ * @var ArpSnapshotRecord::ip
+ * The IP address of the neighbour, in Network notation(Big Endian).
+ *
+ * @var ArpSnapshotRecord::hardwareType
+ * The hardware type of the neighbour.
+ *
+ * @var ArpSnapshotRecord::mac
+ * The MAC address of the neighbour.
+ */
+
+typedef struct {
+  uint64_t expires;
+  uint32_t ip;
+  uint16_t hardwareType;
+  unsigned char mac[6];
+} __attribute__((packed)) ArpSnapshotRecord;
+
+/**
+ * @brief Returns the wall-clock time, in milliseconds since the epoch.
+ *
+ * @return uint64_t The current time.
+ */
+
+uint64_t snapshotNow();
+
+/**
+ * @brief Saves records to a snapshot file.
+ *
+ *
+ * Writes the snapshot to a temporary file renamed over the file provided,
+ * so a snapshot is never read half written.
+ * Prints the error if the snapshot cannot be written, the previous snapshot
+ * being left in place.
+ *
+ * @param[in] char * The path of the snapshot file.
+ * @param[in] ArpSnapshotRecord * The records.
+ * @param[in] uint32_t The number of records.
+ * @return int 0 if the snapshot was saved, -1 otherwise.
+ */
+
+int saveArpSnapshot(char *, ArpSnapshotRecord *, uint32_t);
+
+/**
+ * @brief Maps a snapshot file, and hands every record which has not expired
+ * to the function provided.
+ *
+ *
+ * Does nothing if the file does not exist.
+ * Prints the error and ignores the file if it is not a valid snapshot.
+ *
+ * @param[in] char * The path of the snapshot file.
+ * @param[in] void (*)(ArpSnapshotRecord *, uint64_t, void *) The function
+ * restoring a record, called with the record, the current wall-clock time,
+ * and the context.
+ * @param[in] void * The context passed to the function.
+ * @return int The number of records restored.
+ */
+
+int loadArpSnapshot(char *, void (*)(ArpSnapshotRecord *, uint64_t, void *), void *);
+
+#endif
@@ -0,0 +1,71 @@
+/**
+ * @file checksum.h
+ * @author Aryan Chopra
+ * @brief Contains the declarations of the Internet checksum, computed by the
+ * widest routine the processor supports.
+ */
+
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <stdint.h>
+
+/**
+ * @brief Selects the routine computing the checksums, from the instructions
+ * the processor supports.
+ *
+ *
+ * Checks every routine the processor can run against the reference routine
+ * before using it, and skips the ones which disagree.
+ * Called once, before the workers are started; until then the checksums are
+ * computed by the scalar routine.
+ */
+
+void initChecksum();
+
+/**
+ * @brief Returns the name of the routine computing the checksums.
+ *
+ * @return char * The name of the routine.
+ */
+
+const char *checksumRoutine();
+
+/**
+ * @brief Computes the Internet checksum of the bytes provided.
+ *
+ * @param[in] void * The bytes on which the checksum is to be computed, such as
+ * an IP header or an ICMP message.
+ * @param[in] int The number of bytes.
+ * @return uint16_t Checksum computed, in the byte order of the bytes.
+ */
+
+uint16_t checksum(void *, int);
+
+/**
+ * @brief Updates a checksum for a 16-bit word of the bytes it covers being
+ * rewritten, without summing the bytes again, as per RFC 1624.
+ *
+ * @param[in] uint16_t The checksum, as stored in the bytes.
+ * @param[in] uint16_t The word before it was rewritten, as stored in the
+ * bytes.
+ * @param[in] uint16_t The word after it was rewritten, as stored in the bytes.
+ * @return uint16_t The updated checksum, as stored in the bytes.
+ */
+
+uint16_t updateChecksum(uint16_t, uint16_t, uint16_t);
+
+/**
+ * @brief Updates a checksum for a 32-bit field of the bytes it covers being
+ * rewritten, such as an IP address, as per RFC 1624.
+ *
+ * @param[in] uint16_t The checksum, as stored in the bytes.
+ * @param[in] uint32_t The field before it was rewritten, as stored in the
+ * bytes.
+ * @param[in] uint32_t The field after it was rewritten, as stored in the bytes.
+ * @return uint16_t The updated checksum, as stored in the bytes.
+ */
+
+uint16_t updateChecksum32(uint16_t, uint32_t, uint32_t);
+
+#endif
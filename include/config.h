@@ -0,0 +1,163 @@
+/**
+ * @file config.h
+ * @author Aryan Chopra
+ * @brief Contains the declaration of the struct holding the runtime
+ * configuration of the stack.
+ *
+ * The configuration is filled from the command line arguments when the
+ * process starts, every field not provided keeps its default value.
+ */
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#define DEFAULT_QUEUES 1 ///Number of TAP queues, and worker threads, used when none is specified.
+#define MAX_QUEUES 64 ///Maximum number of TAP queues a device can be opened with.
+#define DEFAULT_BATCH 1 ///Number of frames received per wakeup when none is specified.
+#define MAX_BATCH 256 ///Maximum number of frames received per wakeup.
+#define MAX_URING_READS 4096 ///Maximum number of reads kept posted per queue through io_uring.
+#define DEFAULT_ARP_RATE 100 ///ARP packets handled per second and per sender when no rate is specified.
+#define DEFAULT_ICMP_RATE 1000 ///ICMP requests answered per second and per source when no rate is specified.
+#define MAX_RATE 1000000 ///Maximum number of requests per second a rate limit can be set to.
+#define DEFAULT_FRAGMENTS 256 ///Fragments held for reassembly by all the workers when no limit is specified.
+#define MAX_FRAGMENTS 65536 ///Maximum number of fragments held for reassembly the limit can be set to.
+#define MIN_MTU 68 ///Smallest MTU an IPv4 device can be given.
+#define MAX_MTU 9000 ///Largest MTU a device can be given.
+#define MAX_DEVICES 8 ///Maximum number of TAP devices the stack forwards between.
+#define MAX_BUSY_POLL 1000000 ///Longest time, in microseconds, a worker can busy poll for after traffic.
+
+/**
+ * @struct Config
+ * @brief A struct holding the runtime configuration of the stack.
+ *
+ * @var Config::queues
+ * Number of queues the TAP device is opened with.
+ * Every queue is served by its own worker thread, pinned to its own core.
+ * A single queue keeps the stack in one thread, without IFF_MULTI_QUEUE.
+ *
+ * @var Config::batch
+ * Maximum number of frames drained from a queue per wakeup.
+ * The replies to a batch are transmitted together once the whole batch is
+ * handled.
+ * A batch of one reads and writes every frame on its own.
+ *
+ * @var Config::uringReads
+ * Number of fixed-buffer reads kept posted on every queue through io_uring.
+ * Zero keeps the blocking read() and write() path.
+ * When io_uring is used, the batch size is not, as every wakeup handles all
+ * the reads completed.
+ *
+ * @var Config::packetInterface
+ * Name of an existing interface, eg. one end of a veth pair, whose frames
+ * are received through a TPACKET_V3 ring instead of a TAP device.
+ * NULL to use the TAP device.
+ * Several queues share the interface through a fanout group.
+ *
+ * @var Config::xdpInterface
+ * Name of an existing interface whose frames are received and transmitted
+ * through AF_XDP sockets, one per queue of the interface.
+ * NULL to use the TAP device.
+ *
+ * @var Config::arpRate
+ * Number of ARP packets handled per second from every sender, the others
+ * being dropped.
+ * Zero handles every ARP packet.
+ *
+ * @var Config::icmpRate
+ * Number of ICMP requests answered per second from every source, the others
+ * being dropped.
+ * Zero answers every ICMP request.
+ *
+ * @var Config::localPrefixes
+ * The addresses and prefixes answered for on top of the address of the
+ * device, in decimal notation such as 10.1.0.0/16.
+ *
+ * @var Config::localPrefixCount
+ * Number of addresses and prefixes provided.
+ *
+ * @var Config::localFile
+ * Path of a file listing more addresses and prefixes, one per line.
+ * NULL if none is provided.
+ *
+ * @var Config::arpSnapshot
+ * Path of the file the ARP cache is restored from at startup, and saved to
+ * periodically.
+ * NULL to start with an empty cache.
+ *
+ * @var Config::fragments
+ * Number of fragments held by all the workers while their datagrams are
+ * reassembled, every fragment keeping a buffer of the packet pool.
+ * Zero drops every fragment.
+ *
+ * @var Config::mtu
+ * Largest IP packet transmitted in one frame, the larger ones being sent in
+ * fragments.
+ *
+ * @var Config::routeFile
+ * Path of a file listing the routes added to the forwarding table, one per
+ * line.
+ * NULL to resolve every destination on the link of the device.
+ *
+ * @var Config::devices
+ * Number of TAP devices opened, tap0 being the first one.
+ * More than one device makes the stack a router, forwarding the packets
+ * which are not sent to its own addresses between the devices.
+ *
+ * @var Config::rssWorkers
+ * Number of worker threads the frames of the single TAP queue are spread
+ * over by the hash of their flow, by a dispatcher reading the queue.
+ * Zero handles the frames in the threads reading the queues.
+ *
+ * @var Config::txBatch
+ * Maximum number of frames the transmit thread writes per ring and per
+ * pass, when the workers the frames are spread over hand their replies to
+ * a transmit thread of their own.
+ * Zero makes every worker write its replies itself.
+ *
+ * @var Config::busyPoll
+ * Time, in microseconds, the threads reading the TAP queues keep polling
+ * them without sleeping after traffic, trading a core for the latency of
+ * the next frame.
+ * Zero sleeps in epoll as soon as the queues are empty, until a queue is
+ * readable or the next timer is due.
+ */
+
+typedef struct {
+  int queues;
+  int batch;
+  int uringReads;
+  char *packetInterface;
+  char *xdpInterface;
+  int arpRate;
+  int icmpRate;
+  char **localPrefixes;
+  int localPrefixCount;
+  char *localFile;
+  char *arpSnapshot;
+  int fragments;
+  int mtu;
+  char *routeFile;
+  int devices;
+  int rssWorkers;
+  int txBatch;
+  int busyPoll;
+} Config;
+
+/**
+ * @brief Fills the configuration from the command line arguments.
+ *
+ *
+ * Sets every field to its default value.
+ * Parses the options provided on the command line and overrides the
+ * corresponding fields.
+ * Prints the usage and exits the process on an unknown option or an
+ * invalid value.
+ *
+ * @param[out] Config * The configuration to be filled.
+ * @param[in] int The number of command line arguments.
+ * @param[in] char ** The command line arguments.
+ */
+
+void parseConfig(Config *, int, char **);
+
+#endif
@@ -0,0 +1,63 @@
+/**
+ * @file epoch.h
+ * @author Aryan Chopra
+ * @brief Contains the declarations of the epoch-based reclamation letting
+ * the workers read shared tables without any lock.
+ */
+
+#ifndef EPOCH_H
+#define EPOCH_H
+
+#include <stdint.h>
+
+#define EPOCH_READERS 64 ///Number of threads which can read the shared tables, one per worker.
+
+/**
+ * @brief Registers the calling thread as a reader of the shared tables.
+ *
+ *
+ * Until it is registered, the memory a thread reads can be reclaimed under
+ * it.
+ * Prints the error and exits the process if EPOCH_READERS threads are
+ * registered already.
+ */
+
+void registerEpochReader();
+
+/**
+ * @brief Announces that the calling thread holds no pointer into the shared
+ * tables.
+ *
+ *
+ * Called by every reader between two iterations of its loop, so the memory
+ * retired before can be reclaimed.
+ */
+
+void quiescentEpoch();
+
+/**
+ * @brief Retires memory unlinked from a shared table, which the readers may
+ * still be reading.
+ *
+ *
+ * The memory is released once every reader has announced a quiescent state
+ * since it was retired.
+ * Prints the error and exits the process if the memory cannot be tracked.
+ *
+ * @param[in] void * The memory retired.
+ * @param[in] void (*)(void *) The function releasing the memory.
+ */
+
+void retireEpoch(void *, void (*)(void *));
+
+/**
+ * @brief Releases the memory retired which no reader can still be reading.
+ *
+ *
+ * Returns right away if no memory is retired, or if another thread is
+ * releasing it already.
+ */
+
+void reclaimEpoch();
+
+#endif
@@ -46,6 +46,8 @@ typedef struct{
  * marked and named with appropriate name and size.
  *
  *
+ * The frame is left as received, the payload type stays in network order.
+ *
  * @param[in] buffer An incoming Ethernet Packet from the network.
  * @return header A struct which has various fields of the Ethernet Header
  * marked 
@@ -0,0 +1,99 @@
+/**
+ * @file event_loop.h
+ * @author Aryan Chopra
+ * @brief Contains the declarations of the event loop a worker waits for its
+ * queues and its timers in, busy polling for a while after traffic before
+ * sleeping.
+ */
+
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <stdint.h>
+#include <sys/epoll.h>
+
+#define EVENT_LOOP_DESCRIPTORS 64 ///Maximum number of file descriptors an event loop watches.
+#define EVENT_LOOP_MAX_SLEEP_MS 1000 ///Longest time a worker sleeps, even without any timer due, so the memory it could still read gets reclaimed.
+
+/**
+ * @struct EventLoop
+ * @brief A struct holding the epoll instance a worker waits in, and the
+ * state of its busy polling.
+ *
+ * Right after traffic, the loop keeps polling the descriptors without
+ * sleeping, so the next frame is handled within microseconds rather than
+ * after the wakeup of a sleeping thread.
+ * Once no traffic was seen for the spin budget, the loop sleeps in
+ * epoll_wait() until a descriptor is ready or the next timer is due, so an
+ * idle worker costs no CPU.
+ *
+ * @var EventLoop::epollDescriptor
+ * The epoll instance the descriptors are watched through.
+ *
+ * @var EventLoop::spinBudget
+ * Time, in nanoseconds, the loop busy polls for after the last traffic,
+ * zero to always sleep.
+ *
+ * @var EventLoop::lastTraffic
+ * Time, in nanoseconds of the monotonic clock, a descriptor was last ready.
+ *
+ * @var EventLoop::events
+ * The events returned by the last wait.
+ */
+
+typedef struct {
+  int epollDescriptor;
+  uint64_t spinBudget;
+  uint64_t lastTraffic;
+  struct epoll_event events[EVENT_LOOP_DESCRIPTORS];
+} EventLoop;
+
+/**
+ * @brief Creates the epoll instance of an event loop.
+ *
+ *
+ * Prints the error and exits the process if the instance cannot be
+ * created.
+ *
+ * @param[out] EventLoop * The event loop.
+ * @param[in] int Time, in microseconds, the loop busy polls for after
+ * traffic, zero to always sleep.
+ */
+
+void initEventLoop(EventLoop *, int);
+
+/**
+ * @brief Watches a file descriptor for readability.
+ *
+ *
+ * Prints the error and exits the process if the descriptor cannot be
+ * watched.
+ *
+ * @param[in, out] EventLoop * The event loop.
+ * @param[in] int The file descriptor.
+ * @param[in] int The index the descriptor is reported ready as, below
+ * EVENT_LOOP_DESCRIPTORS.
+ */
+
+void watchEventLoop(EventLoop *, int, int);
+
+/**
+ * @brief Waits until a watched descriptor is readable, or the deadline is
+ * reached.
+ *
+ *
+ * Busy polls while the last traffic is more recent than the spin budget,
+ * and sleeps in epoll_wait() otherwise, for EVENT_LOOP_MAX_SLEEP_MS at
+ * most.
+ * Prints the error and exits the process if waiting fails.
+ *
+ * @param[in, out] EventLoop * The event loop.
+ * @param[in] uint64_t The tick the next timer is due at, UINT64_MAX for
+ * none.
+ * @return uint64_t The bits of the indices of the descriptors ready, zero
+ * when the deadline was reached or the spin budget ran out.
+ */
+
+uint64_t waitEventLoop(EventLoop *, uint64_t);
+
+#endif
@@ -0,0 +1,170 @@
+/**
+ * @file fib.h
+ * @author Aryan Chopra
+ * @brief Contains the declarations of the IPv4 forwarding table, mapping
+ * every destination to the next hop of its longest matching prefix.
+ */
+
+#ifndef FIB_H
+#define FIB_H
+
+#include <stdint.h>
+
+#define FIB_TBL24_LEN (1 << 24) ///Number of entries of the first level, indexed by the first 24 bits of the destination.
+#define FIB_TBL8_LEN 256 ///Number of entries of a group of the second level, indexed by the last 8 bits of the destination.
+#define FIB_MAX_INDEX ((1 << 24) - 1) ///Largest index of a next hop, or of a group of the second level.
+
+/**
+ * @struct FibNextHop
+ * @brief A struct holding a next hop, shared by every route through it.
+ *
+ * @var FibNextHop::gateway
+ * The IP address of the gateway, in Network notation(Big Endian), 0 when
+ * the destinations are on the link of the device.
+ *
+ * @var FibNextHop::device
+ * The index of the network device the destinations are reached through.
+ */
+
+typedef struct {
+  uint32_t gateway;
+  int device;
+} FibNextHop;
+
+/**
+ * @struct Fib
+ * @brief A struct holding the forwarding table, as a DIR-24-8 table.
+ *
+ * A destination is looked up in the first level with its first 24 bits;
+ * the entry either holds the next hop of the longest prefix of at most 24
+ * bits matching it, or points to a group of the second level, looked up
+ * with its last 8 bits, for the destinations also covered by longer
+ * prefixes.
+ * A lookup reads two entries at most, whatever the number of routes.
+ * Every entry holds the length of the prefix it was filled from, so routes
+ * can be added in any order.
+ *
+ * @var Fib::tbl24
+ * The first level, FIB_TBL24_LEN entries.
+ *
+ * @var Fib::tbl8
+ * The groups of the second level, FIB_TBL8_LEN entries each.
+ *
+ * @var Fib::groups
+ * Number of groups of the second level used.
+ *
+ * @var Fib::groupCapacity
+ * Number of groups of the second level allocated.
+ *
+ * @var Fib::nextHops
+ * The next hops, the entries holding their index.
+ *
+ * @var Fib::nextHopCount
+ * Number of next hops.
+ *
+ * @var Fib::nextHopCapacity
+ * Number of next hops allocated.
+ *
+ * @var Fib::nextHopSlots
+ * Open-addressing hash of the next hops, every slot holding the index of a
+ * next hop plus one, 0 if the slot is free.
+ *
+ * @var Fib::nextHopMask
+ * Number of slots of the hash of the next hops minus one.
+ *
+ * @var Fib::routes
+ * Number of routes added.
+ */
+
+typedef struct {
+  uint32_t *tbl24;
+  uint32_t *tbl8;
+  uint32_t groups;
+  uint32_t groupCapacity;
+  FibNextHop *nextHops;
+  uint32_t nextHopCount;
+  uint32_t nextHopCapacity;
+  uint32_t *nextHopSlots;
+  uint32_t nextHopMask;
+  uint32_t routes;
+} Fib;
+
+/**
+ * @brief Allocates an empty forwarding table.
+ *
+ *
+ * The first level is allocated at once, its pages being only backed by
+ * memory once routes are written to them.
+ * Prints the error and exits the process if the table cannot be allocated.
+ *
+ * @return Fib * The table.
+ */
+
+Fib *newFib();
+
+/**
+ * @brief Adds a route to the table, or replaces the route of the same
+ * prefix.
+ *
+ *
+ * The table is not synchronized, it is filled before the workers are
+ * started and only read afterwards.
+ * Prints the error and exits the process if the table cannot be grown.
+ *
+ * @param[in, out] Fib * The table.
+ * @param[in] uint32_t An address of the prefix, in Network notation(Big
+ * Endian), its host bits ignored.
+ * @param[in] int The length of the prefix.
+ * @param[in] uint32_t The gateway, in Network notation(Big Endian), 0 for
+ * the destinations on the link of the device.
+ * @param[in] int The index of the network device.
+ * @return int 0 if the route was added, -1 if the length is invalid.
+ */
+
+int addRoute(Fib *, uint32_t, int, uint32_t, int);
+
+/**
+ * @brief Looks up the next hop of the longest prefix matching a
+ * destination.
+ *
+ * @param[in] Fib * The table.
+ * @param[in] uint32_t The destination, in Network notation(Big Endian).
+ * @return FibNextHop * The next hop, or NULL if no route matches.
+ */
+
+FibNextHop *lookupRoute(Fib *, uint32_t);
+
+/**
+ * @brief Parses a route and adds it to the table.
+ *
+ *
+ * A route is a prefix in decimal notation, optionally followed by its
+ * gateway, and by the index of its network device, separated by spaces,
+ * such as "10.2.0.0/16 10.0.0.1 0".
+ * A missing gateway, or 0.0.0.0, makes the destinations of the prefix on
+ * the link of the device.
+ *
+ * @param[in, out] Fib * The table.
+ * @param[in] char * The route.
+ * @param[in] int The number of network devices.
+ * @return int 0 if the route was added, -1 if it could not be parsed.
+ */
+
+int parseRoute(Fib *, char *, int);
+
+/**
+ * @brief Adds every route listed in a file to the table, one per line.
+ *
+ *
+ * Skips the empty lines and the lines starting with #.
+ * Prints the error and exits the process if the file cannot be read or a
+ * line cannot be parsed.
+ *
+ * @param[in, out] Fib * The table.
+ * @param[in] char * The path of the file.
+ * @param[in] int The number of network devices.
+ */
+
+void loadRoutes(Fib *, char *, int);
+
+#endif
@@ -0,0 +1,72 @@
+/**
+ * @file graph.h
+ * @author Aryan Chopra
+ * @brief Contains the declarations of the graph of nodes a vector of frames
+ * is handled through, one layer at a time.
+ */
+
+#ifndef GRAPH_H
+#define GRAPH_H
+
+#include "netdev.h"
+#include "packet.h"
+#include "packet_buffer.h"
+
+#define GRAPH_VECTOR_LEN 256 ///Maximum number of packets a node handles per call.
+#define GRAPH_PREFETCH 4 ///Distance, in packets, the headers of the next packets are prefetched at.
+
+#define NODE_ETHERNET_INPUT 0 ///Parses the frames and dispatches them on their ethertype.
+#define NODE_ARP_INPUT 1 ///Handles the ARP packets.
+#define NODE_IP4_INPUT 2 ///Checks the IP packets and dispatches them to the stack or to the forwarding.
+#define NODE_ICMP_ECHO 3 ///Answers the ICMP requests sent to the stack.
+#define NODE_IP4_FORWARD 4 ///Forwards the IP packets which are not sent to the stack.
+#define NODE_INTERFACE_OUTPUT 5 ///Writes the frames queued on every device.
+#define GRAPH_NODES 6 ///Number of nodes of the graph.
+
+/**
+ * @struct Graph
+ * @brief A struct holding the vectors of packets waiting at every node of
+ * the graph of a worker.
+ *
+ * Every node handles its whole vector in one call, in the order of the
+ * nodes, so the code of a layer stays in the instruction cache for the
+ * whole vector, and the dispatch is paid once per vector rather than per
+ * packet.
+ *
+ * @var Graph::packets
+ * The descriptors of the frames of the vector being handled.
+ *
+ * @var Graph::vectors
+ * The packets waiting at every node.
+ *
+ * @var Graph::counts
+ * Number of packets waiting at every node.
+ */
+
+typedef struct {
+  Packet packets[GRAPH_VECTOR_LEN];
+  Packet *vectors[GRAPH_NODES][GRAPH_VECTOR_LEN];
+  int counts[GRAPH_NODES];
+} Graph;
+
+/**
+ * @brief Handles a vector of frames received on a device through the
+ * graph.
+ *
+ *
+ * The frames enter the graph at ethernet-input, and every node hands its
+ * packets to the vector of the next node, before that node runs.
+ * The replies and the packets forwarded are queued on the transmit batch
+ * of their device, which interface-output writes last.
+ *
+ * @param[in, out] Graph * The graph of the calling worker.
+ * @param[in] Netdev * The worker's copy of the device the frames were
+ * received on.
+ * @param[in, out] PacketBuffer ** The buffers holding the frames, the
+ * replies being built in place in them.
+ * @param[in] int The number of frames, GRAPH_VECTOR_LEN at most.
+ */
+
+void runGraph(Graph *, Netdev *, PacketBuffer **, int);
+
+#endif
@@ -0,0 +1,35 @@
+/**
+ * @file hash.h
+ * @author Aryan Chopra
+ * @brief Contains the finalizer mixing the keys of the hash tables of the
+ * stack.
+ */
+
+#ifndef HASH_H
+#define HASH_H
+
+#include <stdint.h>
+
+/**
+ * @brief Mixes a 32 bit key, in the manner of the murmur3 finalizer.
+ *
+ *
+ * Every bit of the key affects every bit of the hash, so keys differing
+ * only in a few bits, like consecutive addresses of a subnet, spread over
+ * the whole table, whose index may then be taken from the low bits.
+ *
+ * @param[in] uint32_t The key.
+ * @return uint32_t The hash of the key.
+ */
+
+static inline uint32_t mixHash(uint32_t hash) {
+  hash ^= hash >> 16;
+  hash *= 0x7feb352d;
+  hash ^= hash >> 15;
+  hash *= 0x846ca68b;
+  hash ^= hash >> 16;
+
+  return hash;
+}
+
+#endif
@@ -12,6 +12,7 @@
 
 #include "ip.h"
 #include "netdev.h"
+#include "packet.h"
 
 #define ICMP_REPLY 0x00 ///Predefined value which represents the header carries an ICMP reply.
 #define ICMP_ECHO 0x08 ///Predefined value which represents the header carries an ICMP request.
@@ -47,33 +48,34 @@ typedef struct {
  * @brief Handles the incoming ICMP Reqeust.
  *
  *
- * Extracts the ICMP information from the incoming IP Header.
+ * Extracts the ICMP information from the payload of the incoming IP Header,
+ * at the offset and length recorded in the descriptor.
  * Checks if the request type is Echo, and calls the appropriate function to
  * modify the incoming header accordingly.
+ * Drops the packet if it is shorter than the ICMP header.
  *
- * @param[in, out] IpHeader A struct containing aptly named and sized
- * fields of an IP Header.
+ * @param[in, out] Packet The descriptor of the frame carrying the ICMP
+ * header.
  * If the request type is Echo, calls the appropriate function to modify the
  * incmoing header.
+ * @return int 0 if a reply was built in place, -1 if the packet is dropped.
  */
 
-void handleIcmp(IpHeader *); 
+int handleIcmp(Packet *);
 
 /**
- * @brief Changes the info type from Echo to Reply, and recomputes the checksum.
+ * @brief Changes the info type from Echo to Reply, and updates the checksum.
  *
  *
- * @param[in, out] icmpInfo A struct formated with appropriate names and
- * sizes for an ICMP Header.
  * Changes the type from Echo to Reply to reply back to the ICMP(commonly a
  * ping) request.
- * Recomputes the checksum.
+ * Updates the checksum for the rewritten type only, whatever the length of
+ * the payload.
  * @param[in] Icmp A struct which is designed to allow us to read and write to
  * the ICMP header.
- * @param[in] int Conatains length of ICMP Header.
  */
 
-void structureIcmpReply(Icmp *, int);
+void structureIcmpReply(Icmp *);
 
 #endif
 
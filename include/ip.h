@@ -9,11 +9,22 @@
 
 #include <stdint.h>
 
+#include "checksum.h"
 #include "ethernet.h"
 #include "netdev.h"
+#include "packet.h"
 
 #define IPV4 0x04 ///Predefined value which represents that the header has the version for of Internet Protocol
 #define ICMP 0x01 ///Predefined value whihc represents that the payload carries an ICMP Echo or Reply
+#define IP_DONT_FRAGMENT 0x4000 ///Flag of the fragment field forbidding the packet to be fragmented.
+#define IP_MORE_FRAGMENTS 0x2000 ///Flag of the fragment field marking every fragment of a datagram but the last one.
+#define IP_OFFSET_MASK 0x1fff ///Bits of the fragment field holding the offset of the fragment, in units of 8 bytes.
+#define IP_OPTION_END 0x00 ///Type of the option ending the list of options of the header.
+#define IP_OPTION_NOP 0x01 ///Type of the single byte option padding the options of the header.
+#define IP_OPTION_COPIED 0x80 ///Flag of the type of an option which is copied into every fragment.
+#define IP_DROP 0 ///The incoming packet is dropped.
+#define IP_LOCAL 1 ///The incoming packet is sent to the stack.
+#define IP_FORWARD 2 ///The incoming packet is to be forwarded.
 
 /**
  * @struct IpHeader
@@ -90,54 +101,171 @@ typedef struct {
  * @brief Handles the incoming IP request.
  *
  *
- * Extracts the payload, an IP Packet from the incoming Ethernet Packet.
- * Computes the checksum to verify the integrity of the packet.
- * Checks various parameters of the IP Header to verify the integrity.
- * Checks the type of request the packet is carrying.
- * In case of an ICMP request, calls the appropriate functions to deal with
- * the ICMP request.
- * Replies back to the source with a modified IP/Ethernet Packet.
+ * Checks the packet through ipInput(), then forwards it through
+ * ipForward() or delivers it to the stack through ipLocal().
  *
  * @param[in] Netdev A struct emulating a network device. The IP request is
  * directed to the device.
- * @param[in, out] EthernetHeader A struct containing formated fields for
- * an Ethrnet Header.
+ * @param[in, out] Packet The descriptor of the frame carrying the IP
+ * packet.
  * The payload and the sender and receiver address of the packet is
  * modified while relaying back.
- * @pre The ethernet header contains an IP Packet;
+ * @pre The frame was parsed and carries an IP Packet;
  */
 
-void ipIncoming(Netdev *, EthernetHeader *);
+void ipIncoming(Netdev *, Packet *);
+
+/**
+ * @brief Checks an incoming IP packet and decides where it goes.
+ *
+ *
+ * Checks various parameters of the IP Header to verify the integrity, the
+ * version and lengths being checked when the frame is parsed.
+ * A packet which is not sent to one of the local addresses of the device,
+ * checked in constant time, is to be forwarded if the stack forwards
+ * between several devices, and dropped otherwise.
+ * Computes the checksum of a packet sent to the stack to verify its
+ * integrity.
+ *
+ * @param[in] Netdev * A struct emulating a network device. The IP request
+ * is directed to the device.
+ * @param[in] Packet * The descriptor of the frame carrying the IP packet.
+ * @return int IP_LOCAL if the packet is sent to the stack, IP_FORWARD if it
+ * is to be forwarded, IP_DROP if it is dropped.
+ * @pre The frame was parsed and carries an IP Packet;
+ */
+
+int ipInput(Netdev *, Packet *);
+
+/**
+ * @brief Delivers an IP packet sent to the stack to its protocol.
+ *
+ *
+ * Hands the fragments to the reassembly, and handles their datagram once it
+ * is complete, flushing its reply right away as the datagram is only valid
+ * until the next fragment.
+ * Answers the ICMP requests through ipEcho().
+ *
+ * @param[in] Netdev * A struct emulating a network device. The IP request
+ * is directed to the device.
+ * @param[in, out] Packet * The descriptor of the frame carrying the IP
+ * packet, checked by ipInput().
+ */
+
+void ipLocal(Netdev *, Packet *);
+
+/**
+ * @brief Answers an ICMP request sent to the stack.
+ *
+ *
+ * Drops the request if the source exceeds its rate of ICMP requests.
+ * Otherwise builds the reply in place and transmits it through ipReply().
+ *
+ * @param[in] Netdev * A struct emulating a network device. The IP request
+ * is directed to the device.
+ * @param[in, out] Packet * The descriptor of the frame carrying the ICMP
+ * request, the reply is built in place in it.
+ * @return Netdev * The device the reply is sent from, NULL if the request
+ * is dropped.
+ */
+
+Netdev *ipEcho(Netdev *, Packet *);
 
 /**
  * @brief Relays the ethernet packet back to the sender.
  *
  *
  * Swaps the source and destination IP Addresses, as the Packet is to be
- * send back to the sender.
- * Recomputes the checksum to verify the integrity of the IP Packet.
+ * send back to the sender from the local address it was sent to.
+ * Clears the flags of the header, so the reply can be fragmented, like the
+ * replies of the kernel.
+ * Updates the checksum for the cleared flags only, rather than summing the
+ * header again, as swapping the addresses leaves the sum unchanged.
  * Logs the outgoing Packet to a log file.
+ * Looks up the route to the sender, and drops the Packet if there is none.
+ * Transmits the Packet through ipOutput() from the device of the route, to
+ * the gateway of the route, or to the sender itself when it is on the link,
+ * fragmenting it if it is larger than the MTU of the device.
  *
  * @param[in] Netdev A struct emulating a device on the network, through
- * which the request is received
- * and is to be sent back from.
- * @param[in, out] EthernetHeader A struct containing formated fields to
- * contain an ethernet header/packet.
+ * which the request is received.
+ * @param[in, out] Packet The descriptor of the frame carrying the IP
+ * packet.
  * The payload(Ip Packet) is modified with the appropriate information and
  * is transmitted back to the sender.
+ * @return Netdev * The device the Packet is sent from, NULL if there is no
+ * route to the sender.
+ */
+
+Netdev *ipReply(Netdev *, Packet *);
+
+/**
+ * @brief Forwards an IP packet which is not sent to the stack towards its
+ * destination.
+ *
+ *
+ * Only forwards the packets sent to the MAC address of the device they
+ * arrived on, whose header checksum verifies and whose TTL does not expire.
+ * Looks up the next hop and the egress device of the destination in the
+ * forwarding table.
+ * Decrements the TTL, updating the checksum for it rather than summing the
+ * header again.
+ * Transmits the packet in place through ipOutput(), from the worker's copy
+ * of the egress device, so it is queued on the transmit batch of that
+ * device, its MAC addresses rewritten from the ARP cache.
+ *
+ * @param[in] Netdev * The network device the packet arrived on.
+ * @param[in, out] Packet * The descriptor of the frame carrying the IP
+ * packet, rewritten in place.
+ */
+
+void ipForward(Netdev *, Packet *);
+
+/**
+ * @brief Transmits an IP packet to the next hop, fragmenting it if it is
+ * larger than the MTU of the device.
+ *
+ *
+ * A packet which fits in the MTU is handed to the ARP layer as it is,
+ * queued until the next hop is resolved if needed.
+ * A larger packet is dropped if it must not be fragmented, or if the next
+ * hop is not resolved yet, its resolution being started; otherwise every
+ * fragment is transmitted as a copy of the headers followed by its slice
+ * of the payload, gathered when the fragment is written.
+ *
+ * @param[in] Netdev * The network device the packet is sent from.
+ * @param[in, out] EthernetHeader * The frame carrying the packet, whose
+ * ethernet header is filled in.
+ * @param[in] int The length of the IP packet.
+ * @param[in] uint32_t The IP address of the next hop, in Network
+ * notation(Big Endian).
+ * @pre The payload of the packet stays valid until the device is flushed.
+ */
+
+void ipOutput(Netdev *, EthernetHeader *, int, uint32_t);
+
+/**
+ * @brief Reads the flags and the fragment offset of an IP header.
+ *
+ *
+ * The flags and fragmentOffset fields of IpHeader do not match the bits of
+ * the header on a Little Endian host, so the 16 bits are read as a whole.
+ *
+ * @param[in] IpHeader * The IP header.
+ * @return uint16_t The flags and the offset, in host notation, as
+ * IP_DONT_FRAGMENT, IP_MORE_FRAGMENTS and IP_OFFSET_MASK.
  */
 
-void ipReply(Netdev *, EthernetHeader *);
+uint16_t ipFragment(IpHeader *);
 
 /**
- * @brief Computes the checksum for the IP Header provided.
+ * @brief Writes the flags and the fragment offset of an IP header.
  *
- * @param[in] void * The IP header on which the checksum is to be computed.
- * @param[in] int The length of the IP Header provided.
- * @return Checksum computed.
+ * @param[in, out] IpHeader * The IP header.
+ * @param[in] uint16_t The flags and the offset, in host notation.
  */
 
-uint16_t checksum(void *, int);
+void setIpFragment(IpHeader *, uint16_t);
 
 #endif
 
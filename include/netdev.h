@@ -8,7 +8,60 @@
 #ifndef NETDEV_H
 #define NETDEV_H
 
+#include <sys/uio.h>
+
+#include "address_set.h"
 #include "ethernet.h"
+#include "fib.h"
+#include "spsc_ring.h"
+#include "uring.h"
+#include "xsk.h"
+
+#define NETDEV_MTU 1500 ///Largest IP packet transmitted in one frame, unless the device is given another MTU.
+#define TX_HEADER_LEN 80 ///Room for the ethernet and IP headers of a frame whose payload is transmitted from elsewhere.
+
+/**
+ * @struct TxFrame
+ * @brief A struct which holds a frame queued for transmission.
+ *
+ * @var TxFrame::parts
+ * The parts the frame is gathered from when it is written.
+ *
+ * @var TxFrame::count
+ * Number of parts of the frame, one for a frame built in a single buffer,
+ * two for headers followed by a payload stored apart.
+ *
+ * @var TxFrame::header
+ * The copy of the headers of a frame whose payload is stored apart.
+ */
+
+typedef struct {
+  struct iovec parts[2];
+  int count;
+  char header[TX_HEADER_LEN];
+} TxFrame;
+
+/**
+ * @struct TxBatch
+ * @brief A struct which holds the frames queued for transmission until the
+ * end of a batch.
+ *
+ * @var TxBatch::frames
+ * The queued frames, each pointing into the receive buffer the reply was
+ * built in, or into the packet a fragment was cut from.
+ *
+ * @var TxBatch::count
+ * Number of frames queued.
+ *
+ * @var TxBatch::capacity
+ * Maximum number of frames that can be queued.
+ */
+
+typedef struct {
+  TxFrame *frames;
+  int count;
+  int capacity;
+} TxBatch;
 
 /**
  * @struct Netdev
@@ -22,13 +75,65 @@
  *
  * @var Netdev::macOctates
  * MAC Address of the network device.
+ *
+ * @var Netdev::mtu
+ * Largest IP packet transmitted in one frame, the larger ones being
+ * fragmented.
+ *
+ * @var Netdev::locals
+ * Every address and prefix the network device answers for, its own address
+ * included, shared by the copies of the device.
+ *
+ * @var Netdev::routes
+ * The forwarding table the next hop of every packet transmitted is looked
+ * up in, shared by the copies of every device.
+ *
+ * @var Netdev::index
+ * Index of the network device, the next hops of the forwarding table
+ * referring to the devices by their index.
+ *
+ * @var Netdev::devices
+ * The worker's own copies of every network device, indexed by their index,
+ * the packets forwarded being queued on the copy of their egress device.
+ * NULL until the device is copied for a worker.
+ *
+ * @var Netdev::deviceCount
+ * Number of network devices, more than one making the stack forward the
+ * packets not sent to its own addresses.
+ *
+ * @var Netdev::txBatch
+ * Frames waiting to be transmitted at the end of the current batch.
+ * NULL when every frame is written as soon as it is transmitted.
+ *
+ * @var Netdev::uring
+ * The io_uring instance the frames are written through.
+ * NULL when the frames are written with write().
+ *
+ * @var Netdev::xsk
+ * The AF_XDP socket the frames are posted to.
+ * NULL when the device is not an AF_XDP socket.
+ *
+ * @var Netdev::txRing
+ * The ring the frames of a batch are handed to the transmit thread through
+ * when the device is flushed.
+ * NULL when the worker writes its frames itself.
  */
 
-typedef struct{
+typedef struct Netdev {
   int deviceDescriptor;
 	uint32_t address;
 	unsigned char macOctets[6];
-}Netdev;
+  int mtu;
+  AddressSet *locals;
+  Fib *routes;
+  int index;
+  struct Netdev *devices;
+  int deviceCount;
+  TxBatch *txBatch;
+  Uring *uring;
+  Xsk *xsk;
+  SpscRing *txRing;
+} Netdev;
 
 /**
  * @brief Initializes the virtual network device.
@@ -41,6 +146,9 @@ typedef struct{
  * Network Byte Order(Big Endian).
  * Assigns the provided MAC address to the network device converting it to
  * uint8_t.
+ * Adds the IP address to the set of local addresses of the device.
+ * The device starts as device 0, without a forwarding table.
+ * Sets the MTU of the device to NETDEV_MTU.
  *
  * @param[in, out] Netdev A struct respresenting a virtual/emulated network
  * device.
@@ -67,7 +175,13 @@ void initNetdev(Netdev *, int,  char *, char *);
  * Adds the size of the ethernet header to the total length of the
  * packet/frame.
  * Logs the outgoing ethernet header.
- * Writes the ethernet header to the TUN/TAP device of the device provided.
+ * Writes the ethernet header to the TUN/TAP device of the device provided,
+ * or queues it until the end of the batch if the device batches its
+ * transmissions.
+ * Submits the write through io_uring instead, without blocking, if the
+ * device has an io_uring instance.
+ * Posts the frame to the transmit ring instead if the device is an AF_XDP
+ * socket.
  *
  * @param[in] Netdev A struct emulating a network device.
  * The MAC address of netdev is used as source address, as the frame is
@@ -87,5 +201,87 @@ void initNetdev(Netdev *, int,  char *, char *);
 
 void transmitNetdev(Netdev *, EthernetHeader *, uint16_t , int , unsigned char *);
 
+/**
+ * @brief Transmits a complete frame through the network device, as it is.
+ *
+ *
+ * Neither rewrites nor logs the ethernet header, for the frames built from
+ * a template.
+ * Writes, queues, submits or posts the frame the same way as
+ * transmitNetdev().
+ *
+ * @param[in] Netdev * A struct emulating a network device.
+ * @param[in] char * The frame, starting with its ethernet header.
+ * @param[in] int The length of the frame.
+ */
+
+void sendNetdev(Netdev *, char *, int);
+
+/**
+ * @brief Transmits a frame made of headers and of a payload stored apart,
+ * such as a fragment of a larger packet.
+ *
+ *
+ * Only the headers are copied, the payload is gathered from where it is
+ * when the frame is written.
+ * Writes the frame right away if the device does not batch its
+ * transmissions, or queues it until the end of the batch.
+ * Queues the write of a copy on io_uring instead, without blocking, if
+ * the device has an io_uring instance.
+ * Gathers the frame into a single buffer first if the device is an AF_XDP
+ * socket.
+ *
+ * @param[in] Netdev * A struct emulating a network device.
+ * @param[in] char * The headers, starting with the ethernet header.
+ * @param[in] int The length of the headers, TX_HEADER_LEN at most.
+ * @param[in] char * The payload.
+ * @param[in] int The length of the payload.
+ * @pre The payload stays valid until the device is flushed.
+ */
+
+void sendNetdevParts(Netdev *, char *, int, char *, int);
+
+/**
+ * @brief Allocates a transmit batch for the network device.
+ *
+ *
+ * Once the batch is allocated, the frames transmitted are queued until the
+ * device is flushed.
+ *
+ * @param[in, out] Netdev A struct emulating a network device.
+ * @param[in] int Maximum number of frames queued before the device is
+ * flushed.
+ */
+
+void initTxBatch(Netdev *, int);
+
+/**
+ * @brief Writes every frame queued on the network device.
+ *
+ *
+ * Writes the queued frames in the order they were transmitted, and empties
+ * the batch.
+ * Hands them to the transmit thread instead if the device has a transmit
+ * ring.
+ * Does nothing if the device does not batch its transmissions.
+ *
+ * @param[in] Netdev A struct emulating a network device.
+ * @pre The buffers the queued frames point into are still valid.
+ */
+
+void flushNetdev(Netdev *);
+
+/**
+ * @brief Returns the calling worker's copy of a network device, by its
+ * index.
+ *
+ * @param[in] Netdev * A copy of a network device of the worker.
+ * @param[in] int The index of the network device.
+ * @return Netdev * The worker's copy of the device, or the copy provided if
+ * the device is not copied for a worker or the index is unknown.
+ */
+
+Netdev *peerNetdev(Netdev *, int);
+
 #endif
 
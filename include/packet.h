@@ -0,0 +1,108 @@
+/**
+ * @file packet.h
+ * @author Aryan Chopra
+ * @brief Contains the definition of the descriptor a frame is parsed into
+ * once, and carried through the layers.
+ */
+
+#ifndef PACKET_H
+#define PACKET_H
+
+#include <stdint.h>
+
+#include "ethernet.h"
+#include "packet_buffer.h"
+
+#define PACKET_ARP 0x01 ///The frame carries a complete ARP header over IPv4.
+#define PACKET_IPV4 0x02 ///The frame carries an IPv4 header whose lengths fit in the frame.
+#define PACKET_FRAGMENT 0x04 ///The IP packet is a fragment of a larger datagram.
+#define PACKET_MORE_FRAGMENTS 0x08 ///The IP packet is a fragment followed by more fragments of its datagram.
+
+/**
+ * @struct Packet
+ * @brief A struct describing a received frame, filled once when the frame
+ * is parsed.
+ *
+ * Every length and field is kept in host order, so the layers read the
+ * descriptor instead of swapping the bytes of the frame, which are left as
+ * received.
+ *
+ * @var Packet::ethernet
+ * The ethernet header at the start of the frame.
+ *
+ * @var Packet::buffer
+ * The packet buffer the frame was received in, NULL if it was received in
+ * a ring or assembled by the stack.
+ *
+ * @var Packet::length
+ * Length of the frame received.
+ *
+ * @var Packet::ethertype
+ * Type of the payload of the ethernet header.
+ *
+ * @var Packet::flags
+ * PACKET_ARP or PACKET_IPV4, the headers found while parsing the frame,
+ * and PACKET_FRAGMENT and PACKET_MORE_FRAGMENTS for the fragments of a
+ * datagram.
+ *
+ * @var Packet::networkOffset
+ * Offset of the ARP or IP header from the start of the frame.
+ *
+ * @var Packet::networkLength
+ * Length of the ARP header and its data, or total length of the IP packet.
+ *
+ * @var Packet::transportOffset
+ * Offset of the payload of the IP packet from the start of the frame.
+ *
+ * @var Packet::transportLength
+ * Length of the payload of the IP packet.
+ *
+ * @var Packet::protocol
+ * Protocol of the payload of the IP packet.
+ *
+ * @var Packet::fragmentOffset
+ * Offset of the payload of the IP packet in its datagram, in bytes.
+ *
+ * @var Packet::hardwareType
+ * Hardware type of the ARP header.
+ *
+ * @var Packet::opcode
+ * Operation of the ARP header.
+ */
+
+typedef struct {
+  EthernetHeader *ethernet;
+  PacketBuffer *buffer;
+  int length;
+  uint16_t ethertype;
+  uint16_t flags;
+
+  uint16_t networkOffset;
+  uint16_t networkLength;
+  uint16_t transportOffset;
+  uint16_t transportLength;
+  uint8_t protocol;
+  uint16_t fragmentOffset;
+
+  uint16_t hardwareType;
+  uint16_t opcode;
+} Packet;
+
+/**
+ * @brief Parses a received frame into its descriptor.
+ *
+ *
+ * Records the ethertype, and the offsets and lengths of the ARP or IP
+ * header, converted to host order, without modifying the frame.
+ * Checks that the headers found fit in the frame received.
+ *
+ * @param[out] Packet * The descriptor of the frame.
+ * @param[in] char * The frame received.
+ * @param[in] int The length of the frame received.
+ * @return int 0 if the frame can be handled, -1 if it is truncated or
+ * malformed.
+ */
+
+int parsePacket(Packet *, char *, int);
+
+#endif
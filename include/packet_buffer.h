@@ -0,0 +1,137 @@
+/**
+ * @file packet_buffer.h
+ * @author Aryan Chopra
+ * @brief Contains the declarations of the preallocated pool of packet
+ * buffers the frames are received into.
+ */
+
+#ifndef PACKET_BUFFER_H
+#define PACKET_BUFFER_H
+
+#define PACKET_HEADROOM 128 ///Room kept in front of a received frame, so headers can be prepended without moving it.
+#define PACKET_DATA_SIZE 2048 ///Room for the frame itself and its tailroom, larger than any frame of a 1500 bytes MTU.
+#define PACKET_CACHE_SIZE 64 ///Number of free buffers a core keeps for itself.
+#define PACKET_CACHE_BULK 32 ///Number of buffers moved at once between a core's cache and the shared pool.
+
+/**
+ * @struct PacketBuffer
+ * @brief A struct holding one buffer of the pool, and the frame it holds.
+ *
+ * The buffer is laid out as its headroom, the frame, and its tailroom, and
+ * always starts on a cache line.
+ *
+ * @var PacketBuffer::data
+ * Start of the frame within the buffer.
+ *
+ * @var PacketBuffer::length
+ * Length of the frame.
+ *
+ * @var PacketBuffer::references
+ * Number of references held on the buffer, it goes back to the pool once
+ * the last one is released.
+ *
+ * @var PacketBuffer::next
+ * Next buffer of the list the buffer is queued on, free for the current
+ * holder to use.
+ *
+ * @var PacketBuffer::room
+ * The headroom, the frame and the tailroom.
+ */
+
+typedef struct PacketBuffer {
+  char *data;
+  int length;
+  int references;
+  struct PacketBuffer *next;
+  char room[PACKET_HEADROOM + PACKET_DATA_SIZE];
+} __attribute__((aligned(64))) PacketBuffer;
+
+/**
+ * @brief Preallocates the pool of packet buffers shared by all the cores.
+ *
+ *
+ * Allocates every buffer at once, so no buffer is ever allocated on the
+ * receive path.
+ * Prints the error and exits the process if the pool cannot be allocated.
+ *
+ * @param[in] int The number of buffers of the pool.
+ */
+
+void initPacketPool(int);
+
+/**
+ * @brief Takes a free buffer from the pool.
+ *
+ *
+ * Takes the buffer from the calling core's cache, without any lock, and
+ * refills the cache from the shared pool in bulk once it is empty.
+ * The buffer is returned with a single reference, an empty frame, and the
+ * whole headroom in front of it.
+ *
+ * @return PacketBuffer * The buffer, or NULL if the pool is exhausted.
+ */
+
+PacketBuffer *allocPacket(void);
+
+/**
+ * @brief Takes one more reference on a buffer.
+ *
+ * @param[in, out] PacketBuffer * The buffer.
+ */
+
+void holdPacket(PacketBuffer *);
+
+/**
+ * @brief Releases one reference on a buffer.
+ *
+ *
+ * Puts the buffer back in the calling core's cache once the last reference
+ * is released, and spills half the cache to the shared pool in bulk once it
+ * is full.
+ *
+ * @param[in, out] PacketBuffer * The buffer.
+ */
+
+void freePacket(PacketBuffer *);
+
+/**
+ * @brief Grows the frame at its front, into the headroom.
+ *
+ * @param[in, out] PacketBuffer * The buffer.
+ * @param[in] int The number of bytes to prepend.
+ * @return char * The new start of the frame, or NULL if the headroom is too
+ * small.
+ */
+
+char *prependPacket(PacketBuffer *, int);
+
+/**
+ * @brief Grows the frame at its end, into the tailroom.
+ *
+ * @param[in, out] PacketBuffer * The buffer.
+ * @param[in] int The number of bytes to append.
+ * @return char * The start of the bytes appended, or NULL if the tailroom is
+ * too small.
+ */
+
+char *appendPacket(PacketBuffer *, int);
+
+/**
+ * @brief Returns the room left in front of the frame.
+ *
+ * @param[in] PacketBuffer * The buffer.
+ * @return int The headroom, in bytes.
+ */
+
+int packetHeadroom(PacketBuffer *);
+
+/**
+ * @brief Returns the room left after the frame.
+ *
+ * @param[in] PacketBuffer * The buffer.
+ * @return int The tailroom, in bytes.
+ */
+
+int packetTailroom(PacketBuffer *);
+
+#endif
@@ -0,0 +1,99 @@
+/**
+ * @file packet_mmap.h
+ * @author Aryan Chopra
+ * @brief Contains the declarations required to receive frames from an
+ * existing interface through a PACKET_MMAP TPACKET_V3 ring.
+ */
+
+#ifndef PACKET_MMAP_H
+#define PACKET_MMAP_H
+
+#define PACKET_BLOCK_SIZE (1 << 20) ///Size of a block of the receive ring, the unit handed between the kernel and the stack.
+#define PACKET_BLOCK_COUNT 64 ///Number of blocks in the receive ring.
+#define PACKET_FRAME_SIZE 2048 ///Frame size the ring is described with, frames are packed within a block regardless.
+#define PACKET_BLOCK_TIMEOUT 1 ///Milliseconds after which the kernel retires a block which is not full.
+
+/**
+ * @struct PacketRing
+ * @brief A struct holding the receive ring mapped from a packet socket.
+ *
+ * @var PacketRing::socketDescriptor
+ * File descriptor of the packet socket.
+ *
+ * @var PacketRing::ring
+ * Start of the ring shared with the kernel.
+ *
+ * @var PacketRing::block
+ * Index of the next block to be handed back by the kernel.
+ */
+
+typedef struct {
+  int socketDescriptor;
+  char *ring;
+  int block;
+} PacketRing;
+
+/**
+ * @brief Opens a packet socket with a TPACKET_V3 receive ring on an existing
+ * interface.
+ *
+ *
+ * Sets the socket to TPACKET_V3 and requests the receive ring.
+ * Binds the socket to the interface provided, receiving every ethertype.
+ * Puts the interface in promiscuous mode, as the stack answers with its own
+ * MAC address, not the interface's.
+ * Ignores the frames transmitted by the stack itself.
+ * Joins the fanout group provided if it is not negative, so several sockets
+ * share the frames of the interface, a flow always reaching the same socket.
+ * Prints the error and exits the process on failure.
+ *
+ * @param[in] char * The name of the interface, eg. one end of a veth pair.
+ * @param[in] int The fanout group to join, or -1 for none.
+ * @return int The file descriptor of the packet socket.
+ */
+
+int openPacketSocket(char *, int);
+
+/**
+ * @brief Maps the receive ring of a packet socket.
+ *
+ *
+ * Prints the error and exits the process if the ring cannot be mapped.
+ *
+ * @param[in] int The file descriptor of a socket opened by openPacketSocket.
+ * @return PacketRing * The mapped ring.
+ */
+
+PacketRing *mapPacketRing(int);
+
+/**
+ * @brief Waits for a block of the ring and handles every frame in it.
+ *
+ *
+ * Waits until the kernel hands the next block over to the stack, or until
+ * the timeout provided expires.
+ * Calls the handler provided for every frame of the block, in place in the
+ * ring, without copying the frame.
+ * The block stays with the stack until it is released.
+ *
+ * @param[in, out] PacketRing * The ring to receive from.
+ * @param[in] void (*)(void *, char *, int) The handler called for every
+ * frame.
+ * @param[in] void * The context passed to the handler.
+ * @param[in] int The milliseconds to wait at most for the block.
+ * @return int The number of frames handled, or -1 if the kernel did not
+ * hand the block over before the timeout.
+ */
+
+int receivePacketBlock(PacketRing *, void (*)(void *, char *, int), void *, int);
+
+/**
+ * @brief Hands the block received last back to the kernel.
+ *
+ * @param[in, out] PacketRing * The ring the block belongs to.
+ * @pre Every reply built in the block has been written.
+ */
+
+void releasePacketBlock(PacketRing *);
+
+#endif
@@ -0,0 +1,120 @@
+/**
+ * @file pipeline.h
+ * @author Aryan Chopra
+ * @brief Contains the declarations of the transmit thread the workers hand
+ * their replies to, and of the counters of the receive, handle and transmit
+ * pipeline.
+ */
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "netdev.h"
+#include "spsc_ring.h"
+
+#define PIPELINE_RING_LEN 1024 ///Number of frames waiting for the transmit thread per worker at most.
+#define PIPELINE_REPORT_MS 10000 ///Interval, in milliseconds, the counters are printed at when they changed.
+
+#define PIPELINE_RX_FRAMES 0 ///Frames handed to a worker by the dispatcher.
+#define PIPELINE_RX_DROPS 1 ///Frames dropped by the dispatcher as the ring of their worker was full.
+#define PIPELINE_TX_FRAMES 2 ///Frames written by the transmit thread.
+#define PIPELINE_TX_STALLS 3 ///Times a worker waited for room in its full transmit ring.
+#define PIPELINE_TX_DROPS 4 ///Frames dropped by a worker as the packet pool was exhausted.
+#define PIPELINE_POOL_DROPS 5 ///Frames read and dropped by a worker as the packet pool was exhausted.
+#define PIPELINE_ARP_DROPS 6 ///Packets dropped as too many packets were queued on the neighbours being resolved.
+#define PIPELINE_COUNTERS 7 ///Number of counters of the pipeline.
+
+/**
+ * @struct Transmitter
+ * @brief A struct representing the thread writing the frames the workers
+ * transmit to the TAP queue.
+ *
+ * @var Transmitter::descriptor
+ * File descriptor of the TAP queue the frames are written to.
+ *
+ * @var Transmitter::rings
+ * The rings every worker hands its frames through, indexed by worker.
+ *
+ * @var Transmitter::count
+ * Number of rings, one per worker.
+ *
+ * @var Transmitter::batch
+ * Maximum number of frames popped from a ring per pass.
+ *
+ * @var Transmitter::thread
+ * The thread writing the frames.
+ */
+
+typedef struct {
+  int descriptor;
+  SpscRing **rings;
+  int count;
+  int batch;
+  pthread_t thread;
+} Transmitter;
+
+/**
+ * @brief Adds to a counter of the pipeline.
+ *
+ * @param[in] int The counter, one of the PIPELINE_ counters.
+ * @param[in] uint64_t The amount added.
+ */
+
+void countPipeline(int, uint64_t);
+
+/**
+ * @brief Returns the value of a counter of the pipeline.
+ *
+ * @param[in] int The counter, one of the PIPELINE_ counters.
+ * @return uint64_t The value of the counter.
+ */
+
+uint64_t pipelineCount(int);
+
+/**
+ * @brief Prints the counters of the pipeline, and the requests dropped by
+ * the rate limits, at most once every PIPELINE_REPORT_MS, and only when
+ * they changed.
+ *
+ *
+ * Called by a single thread.
+ */
+
+void reportPipeline();
+
+/**
+ * @brief Starts the thread writing the frames the workers transmit.
+ *
+ *
+ * Allocates one ring per worker, which the worker's copy of the device
+ * pushes its frames to instead of writing them.
+ * Prints the error and exits the process if the thread cannot be started.
+ *
+ * @param[in] int File descriptor of the TAP queue the frames are written to.
+ * @param[in] int Number of workers, SPSC_WAIT_RINGS at most.
+ * @param[in] int Maximum number of frames popped from a ring per pass.
+ * @return Transmitter * The transmit thread.
+ */
+
+Transmitter *startTransmitter(int, int, int);
+
+/**
+ * @brief Hands every frame queued on a device to the transmit thread.
+ *
+ *
+ * Copies every frame into a buffer of the packet pool, so the buffers the
+ * frames point into can be reused as soon as the device is flushed.
+ * Waits for the transmit thread while the ring is full, so a slow TAP
+ * device slows the worker down rather than losing its replies.
+ * Empties the batch.
+ *
+ * @param[in, out] SpscRing * The ring of the worker.
+ * @param[in, out] Netdev * The worker's copy of the device.
+ */
+
+void pushPipeline(SpscRing *, Netdev *);
+
+#endif
@@ -0,0 +1,58 @@
+/**
+ * @file rate_limit.h
+ * @author Aryan Chopra
+ * @brief Contains the declarations of the per-source token buckets limiting
+ * the requests the stack answers.
+ */
+
+#ifndef RATE_LIMIT_H
+#define RATE_LIMIT_H
+
+#include <stdint.h>
+
+#define RATE_ARP 0 ///Limits the ARP packets handled per sender.
+#define RATE_ICMP 1 ///Limits the ICMP packets handled per source.
+#define RATE_PROTOCOLS 2 ///Number of protocols limited.
+
+#define RATE_SETS 256 ///Number of sets of buckets per protocol and per worker, a power of two.
+#define RATE_WAYS 4 ///Number of buckets of a set, filling one cache line.
+#define RATE_TABLES 64 ///Number of threads which can keep their own buckets, one per worker.
+
+/**
+ * @brief Sets the number of requests per second each source may send.
+ *
+ *
+ * A source may send a burst of one second's worth of requests at once.
+ *
+ * @param[in] int The protocol limited, RATE_ARP or RATE_ICMP.
+ * @param[in] uint32_t The number of requests per second, 0 to answer every
+ * request.
+ */
+
+void setRateLimit(int, uint32_t);
+
+/**
+ * @brief Takes a token from the bucket of a source, if it has one left.
+ *
+ *
+ * Counts the request as dropped otherwise.
+ * Prints the error and exits the process if the buckets of the calling
+ * thread cannot be allocated.
+ *
+ * @param[in] int The protocol of the request, RATE_ARP or RATE_ICMP.
+ * @param[in] uint32_t The source of the request.
+ * @return int 1 if the request may be answered, 0 if it is dropped.
+ */
+
+int allowRate(int, uint32_t);
+
+/**
+ * @brief Returns the number of requests dropped by all the workers.
+ *
+ * @param[in] int The protocol, RATE_ARP or RATE_ICMP.
+ * @return uint64_t The number of requests dropped.
+ */
+
+uint64_t rateDrops(int);
+
+#endif
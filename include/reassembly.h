@@ -0,0 +1,71 @@
+/**
+ * @file reassembly.h
+ * @author Aryan Chopra
+ * @brief Contains the declarations of the reassembly of fragmented IPv4
+ * datagrams.
+ */
+
+#ifndef REASSEMBLY_H
+#define REASSEMBLY_H
+
+#include "packet.h"
+
+#define REASSEMBLY_TIMEOUT 30000 ///Milliseconds a datagram is given to receive all its fragments, from its first one.
+#define REASSEMBLY_DATAGRAMS 64 ///Maximum number of datagrams a worker reassembles at once.
+#define REASSEMBLY_BUCKETS 128 ///Number of buckets of the hash of the datagrams of a worker, a power of two.
+#define REASSEMBLY_MAX_LEN 65535 ///Maximum total length of a reassembled datagram.
+
+/**
+ * @brief Sets the maximum number of fragments held by all the workers,
+ * waiting for the rest of their datagram.
+ *
+ *
+ * Every fragment held keeps a packet buffer, so the limit bounds the memory
+ * of the reassembly whatever the fragments received.
+ * Called before the workers are started.
+ *
+ * @param[in] int The maximum number of fragments held, 0 to drop every
+ * fragment.
+ */
+
+void setReassemblyLimit(int);
+
+/**
+ * @brief Adds a fragment to the datagram it belongs to, and describes the
+ * datagram once it is complete.
+ *
+ *
+ * The fragment is held without copying it, or copied once into a packet
+ * buffer if it was not received in one.
+ * Once the fragments cover the whole datagram, they are copied, in order,
+ * behind the ethernet and IP headers of the first one, and the descriptor
+ * is filled with the datagram reassembled.
+ * The datagram reassembled is only valid until the next fragment is added.
+ * Drops the datagram if its fragments overlap or exceed
+ * REASSEMBLY_MAX_LEN.
+ *
+ * @param[in, out] Packet * The descriptor of the fragment received, whose
+ * checksum is verified, filled with the datagram reassembled.
+ * @return int 0 if the datagram is complete, -1 if the fragment is held
+ * or dropped.
+ */
+
+int reassembleIp(Packet *);
+
+/**
+ * @brief Drops the datagrams of the calling worker which did not receive
+ * all their fragments in time.
+ */
+
+void runReassemblyTimers();
+
+/**
+ * @brief Returns the tick the next datagram of the calling worker times out
+ * at, at the latest.
+ *
+ * @return uint64_t The tick, UINT64_MAX if the worker holds no fragment.
+ */
+
+uint64_t reassemblyTimerDeadline();
+
+#endif
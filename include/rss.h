@@ -0,0 +1,45 @@
+/**
+ * @file rss.h
+ * @author Aryan Chopra
+ * @brief Contains the declarations of the flow hash spreading the frames of
+ * a single queue over several workers, like the receive side scaling of a
+ * network card.
+ */
+
+#ifndef RSS_H
+#define RSS_H
+
+#include <stdint.h>
+
+#include "packet.h"
+
+#define RSS_KEY_LEN 40 ///Length of the Toeplitz key, in bytes.
+#define RSS_INPUT_LEN 12 ///Longest input of the hash, the addresses and ports of an IPv4 flow.
+#define RSS_RING_LEN 1024 ///Number of frames waiting for a worker at most.
+
+/**
+ * @brief Precomputes the tables of the Toeplitz hash from the key used by
+ * the network cards by default.
+ *
+ *
+ * Called once, before the frames are dispatched.
+ */
+
+void initRss();
+
+/**
+ * @brief Computes the Toeplitz hash of the flow a frame belongs to.
+ *
+ *
+ * The flow of a TCP or UDP packet is its addresses and ports, the flow of
+ * any other IP packet, and of every fragment, its addresses only, so all
+ * the fragments of a datagram belong to the same flow.
+ * The flow of an ARP packet is its sender address.
+ *
+ * @param[in] Packet * The descriptor of the frame.
+ * @return uint32_t The hash, 0 for the frames of any other ethertype.
+ */
+
+uint32_t hashFlow(Packet *);
+
+#endif
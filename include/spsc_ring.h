@@ -0,0 +1,135 @@
+/**
+ * @file spsc_ring.h
+ * @author Aryan Chopra
+ * @brief Contains the declarations of the bounded lock-free rings handing
+ * pointers from one thread to another.
+ */
+
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <stdint.h>
+
+#define SPSC_WAIT_RINGS 64 ///Maximum number of rings a consumer waits on at once.
+
+/**
+ * @struct SpscRing
+ * @brief A struct holding a bounded ring of pointers with a single producer
+ * and a single consumer.
+ *
+ * The producer only writes the head and the consumer only writes the tail,
+ * each on its own cache line, so pushing and popping takes no lock and no
+ * atomic read-modify-write.
+ * Each side caches the last index of the other side it read, and only
+ * reads the other side's cache line again once the ring looks full or
+ * empty.
+ * A consumer finding the ring empty can sleep on an eventfd, which the
+ * producer only writes to when the consumer announced it is sleeping.
+ *
+ * @var SpscRing::head
+ * Number of pointers pushed, written by the producer.
+ *
+ * @var SpscRing::cachedTail
+ * The tail last read by the producer.
+ *
+ * @var SpscRing::tail
+ * Number of pointers popped, written by the consumer.
+ *
+ * @var SpscRing::cachedHead
+ * The head last read by the consumer.
+ *
+ * @var SpscRing::sleeping
+ * Set by the consumer while it waits for pointers to be pushed.
+ *
+ * @var SpscRing::eventDescriptor
+ * The eventfd the consumer waits on.
+ *
+ * @var SpscRing::mask
+ * Number of slots of the ring minus one.
+ *
+ * @var SpscRing::items
+ * The slots of the ring.
+ */
+
+typedef struct {
+  uint32_t head __attribute__((aligned(64)));
+  uint32_t cachedTail;
+  uint32_t tail __attribute__((aligned(64)));
+  uint32_t cachedHead;
+  int sleeping __attribute__((aligned(64)));
+  int eventDescriptor;
+  uint32_t mask;
+  void **items;
+} SpscRing;
+
+/**
+ * @brief Allocates an empty ring.
+ *
+ *
+ * Prints the error and exits the process if the ring cannot be allocated.
+ *
+ * @param[in] int The number of slots, rounded up to a power of two.
+ * @return SpscRing * The ring.
+ */
+
+SpscRing *newSpscRing(int);
+
+/**
+ * @brief Pushes pointers to the ring, as many as it has free slots for.
+ *
+ *
+ * Called by the producer only.
+ * Wakes the consumer up if it is sleeping.
+ *
+ * @param[in, out] SpscRing * The ring.
+ * @param[in] void ** The pointers.
+ * @param[in] int The number of pointers.
+ * @return int The number of pointers pushed, the first ones.
+ */
+
+int pushSpscRing(SpscRing *, void **, int);
+
+/**
+ * @brief Pops pointers from the ring, oldest first.
+ *
+ *
+ * Called by the consumer only.
+ *
+ * @param[in, out] SpscRing * The ring.
+ * @param[out] void ** The pointers popped.
+ * @param[in] int The maximum number of pointers popped.
+ * @return int The number of pointers popped.
+ */
+
+int popSpscRing(SpscRing *, void **, int);
+
+/**
+ * @brief Waits until pointers are pushed to an empty ring, or the timeout
+ * expires.
+ *
+ *
+ * Called by the consumer only, returns right away if the ring is not
+ * empty.
+ *
+ * @param[in, out] SpscRing * The ring.
+ * @param[in] int The timeout, in milliseconds.
+ */
+
+void waitSpscRing(SpscRing *, int);
+
+/**
+ * @brief Waits until pointers are pushed to any of several empty rings, or
+ * the timeout expires.
+ *
+ *
+ * Called by the consumer of all the rings only, returns right away if any
+ * ring is not empty.
+ *
+ * @param[in, out] SpscRing ** The rings.
+ * @param[in] int The number of rings, SPSC_WAIT_RINGS at most.
+ * @param[in] int The timeout, in milliseconds.
+ */
+
+void waitSpscRings(SpscRing **, int, int);
+
+#endif
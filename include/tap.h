@@ -37,5 +37,25 @@
 
 int initTap(char *);
 
+/**
+ * @brief Opens a multi-queue TAP device and activates it.
+ *
+ *
+ * Opens the first queue with IFF_MULTI_QUEUE, creating the device.
+ * Every further queue is attached to the same device by name.
+ * Sets the device as UP and assigns the route once all the queues exist.
+ *
+ * @param[in, out] char * A character array containing the name of the
+ * device.
+ * In case the buffer is empty, the default name assigned is copied to the
+ * buffer.
+ * @param[out] int * An array which receives the file descriptor of every
+ * queue.
+ * @param[in] int The number of queues to open.
+ * @pre The array has space for the requested number of descriptors.
+ */
+
+void initTapQueues(char *, int *, int);
+
 #endif
 
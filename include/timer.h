@@ -0,0 +1,151 @@
+/**
+ * @file timer.h
+ * @author Aryan Chopra
+ * @brief Contains the declarations of the hierarchical timer wheel the
+ * protocol timers are armed on.
+ */
+
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TIMER_TICK_MS 10 ///Resolution of the timers, and longest time a worker waits for frames before running them.
+#define TIMER_LEVELS 4 ///Number of levels of the wheel, each one 64 times coarser than the one below.
+#define TIMER_SLOTS 64 ///Number of slots in every level of the wheel.
+#define TIMER_SLOT_BITS 6 ///Number of bits of the expiry tick indexing a slot of a level.
+
+#define TIMER_TICKS(ms) (((ms) + TIMER_TICK_MS - 1) / TIMER_TICK_MS) ///Converts milliseconds to ticks, rounding up.
+
+/**
+ * @brief Returns the structure a timer is embedded in.
+ */
+
+#define timerOwner(timer, type, member) ((type *) ((char *) (timer) - offsetof(type, member)))
+
+/**
+ * @struct Timer
+ * @brief A struct holding a timer, embedded in the structure it belongs to.
+ *
+ * @var Timer::next
+ * Next timer of the slot, NULL when the timer is not armed.
+ *
+ * @var Timer::previous
+ * Previous timer of the slot.
+ *
+ * @var Timer::expires
+ * Tick at which the timer expires.
+ *
+ * @var Timer::callback
+ * Function called once the timer expires, with the timer and the context
+ * the wheel is advanced with.
+ */
+
+typedef struct Timer {
+  struct Timer *next;
+  struct Timer *previous;
+  uint64_t expires;
+  void (*callback)(struct Timer *, void *);
+} Timer;
+
+/**
+ * @struct TimerWheel
+ * @brief A struct holding a hierarchical timer wheel.
+ *
+ * A level holds the timers expiring within 64 times the span of a slot of
+ * the level below.
+ * The timers of a slot of a higher level are cascaded down once the level
+ * below has gone through all its slots.
+ * The wheel is not synchronized, the owner of the wheel serializes its
+ * accesses.
+ *
+ * @var TimerWheel::slots
+ * Heads of the circular lists of timers of every slot.
+ *
+ * @var TimerWheel::now
+ * The last tick the wheel was advanced to.
+ *
+ * @var TimerWheel::count
+ * Number of timers armed on the wheel.
+ */
+
+typedef struct {
+  Timer slots[TIMER_LEVELS][TIMER_SLOTS];
+  uint64_t now;
+  uint32_t count;
+} TimerWheel;
+
+/**
+ * @brief Returns the current tick, from the monotonic clock.
+ *
+ * @return uint64_t The current tick.
+ */
+
+uint64_t timerNow();
+
+/**
+ * @brief Initializes an empty timer wheel, starting at the current tick.
+ *
+ * @param[out] TimerWheel * The wheel.
+ */
+
+void initTimerWheel(TimerWheel *);
+
+/**
+ * @brief Arms a timer on the wheel, in constant time.
+ *
+ *
+ * Rearms the timer if it is already armed.
+ *
+ * @param[in, out] TimerWheel * The wheel.
+ * @param[in, out] Timer * The timer, whose callback is set.
+ * @param[in] uint64_t The number of ticks after which the timer expires, at
+ * least one.
+ */
+
+void addTimer(TimerWheel *, Timer *, uint64_t);
+
+/**
+ * @brief Disarms a timer, in constant time.
+ *
+ *
+ * Does nothing if the timer is not armed.
+ *
+ * @param[in, out] TimerWheel * The wheel the timer is armed on.
+ * @param[in, out] Timer * The timer.
+ */
+
+void cancelTimer(TimerWheel *, Timer *);
+
+/**
+ * @brief Advances the wheel to the tick provided, and runs every timer
+ * expired on the way.
+ *
+ *
+ * The timers of a tick are detached from the wheel as a batch before their
+ * callbacks are called, so a callback can rearm its own timer.
+ *
+ * @param[in, out] TimerWheel * The wheel.
+ * @param[in] uint64_t The current tick.
+ * @param[in] void * The context passed to the callbacks.
+ * @return int The number of timers run.
+ */
+
+int advanceTimerWheel(TimerWheel *, uint64_t, void *);
+
+/**
+ * @brief Returns the tick the next timer of the wheel is due at, at the
+ * latest.
+ *
+ *
+ * The tick returned can be earlier than the next expiry, when the wheel
+ * cascades a higher level down at that tick, but never later.
+ *
+ * @param[in] TimerWheel * The wheel.
+ * @return uint64_t The tick, UINT64_MAX when no timer is armed.
+ */
+
+uint64_t nextTimerExpiry(TimerWheel *);
+
+#endif
@@ -0,0 +1,194 @@
+/**
+ * @file uring.h
+ * @author Aryan Chopra
+ * @brief Contains the declaration of the struct holding an io_uring instance
+ * used to receive and transmit the frames of one queue of the TAP device.
+ */
+
+#ifndef URING_H
+#define URING_H
+
+#include <linux/io_uring.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+#define URING_COPIES 256 ///Number of frames built outside the receive buffers whose writes can be in flight at once.
+#define URING_COPY_SIZE 9216 ///Room for a frame built outside the receive buffers, larger than any frame of the largest MTU.
+
+/**
+ * @struct Uring
+ * @brief A struct holding an io_uring instance bound to one TAP queue.
+ *
+ * Every receive buffer always has exactly one operation in flight, either a
+ * read waiting for a frame, or the write of the reply built in place in the
+ * frame it received.
+ *
+ * @var Uring::ringDescriptor
+ * File descriptor of the io_uring instance.
+ *
+ * @var Uring::deviceDescriptor
+ * File descriptor of the TAP queue the reads and writes are posted on.
+ *
+ * @var Uring::sqHead
+ * Head of the submission queue, advanced by the kernel.
+ *
+ * @var Uring::sqTail
+ * Tail of the submission queue, advanced when entries are submitted.
+ *
+ * @var Uring::sqMask
+ * Mask wrapping an index into the submission queue.
+ *
+ * @var Uring::sqArray
+ * Indirection array of the submission queue.
+ *
+ * @var Uring::sqes
+ * The submission queue entries.
+ *
+ * @var Uring::cqHead
+ * Head of the completion queue, advanced when completions are reaped.
+ *
+ * @var Uring::cqTail
+ * Tail of the completion queue, advanced by the kernel.
+ *
+ * @var Uring::cqMask
+ * Mask wrapping an index into the completion queue.
+ *
+ * @var Uring::cqes
+ * The completion queue entries.
+ *
+ * @var Uring::pending
+ * Number of entries queued since the last submission.
+ *
+ * @var Uring::buffers
+ * The fixed receive buffers, registered with the kernel as one region.
+ *
+ * @var Uring::bufferSize
+ * Size of a single receive buffer.
+ *
+ * @var Uring::bufferCount
+ * Number of receive buffers, which is also the number of reads kept posted.
+ *
+ * @var Uring::replied
+ * Set when the frame being handled was transmitted, so the completion of its
+ * read does not post a new read on the buffer until the write completes.
+ *
+ * @var Uring::copies
+ * The buffers the frames built outside the receive buffers are copied
+ * into, each held until the write of its frame completes.
+ *
+ * @var Uring::copyParts
+ * The parts every copied frame is written from, pointing into its buffer.
+ *
+ * @var Uring::freeCopies
+ * The indices of the buffers of copies not in flight.
+ *
+ * @var Uring::freeCopyCount
+ * Number of buffers of copies not in flight.
+ */
+
+typedef struct {
+  int ringDescriptor;
+  int deviceDescriptor;
+
+  unsigned *sqHead;
+  unsigned *sqTail;
+  unsigned sqMask;
+  unsigned *sqArray;
+  struct io_uring_sqe *sqes;
+
+  unsigned *cqHead;
+  unsigned *cqTail;
+  unsigned cqMask;
+  struct io_uring_cqe *cqes;
+
+  unsigned pending;
+
+  char *buffers;
+  int bufferSize;
+  int bufferCount;
+  int replied;
+
+  char *copies;
+  struct iovec copyParts[URING_COPIES][2];
+  int freeCopies[URING_COPIES];
+  int freeCopyCount;
+} Uring;
+
+/**
+ * @brief Creates an io_uring instance for a TAP queue and posts its reads.
+ *
+ *
+ * Sets up the submission and completion queues and maps them.
+ * Allocates the receive buffers and registers them with the kernel as fixed
+ * buffers, so the kernel does not map them again on every operation.
+ * Posts one fixed-buffer read per receive buffer.
+ * Prints the error and exits the process if io_uring, or its timed waits,
+ * are not available.
+ *
+ * @param[in] int The file descriptor of the TAP queue.
+ * @param[in] int The number of reads kept posted on the queue.
+ * @param[in] int The size of a single receive buffer.
+ * @return Uring * The io_uring instance created.
+ */
+
+Uring *initUring(int, int, int);
+
+/**
+ * @brief Queues the write of a frame on the io_uring instance.
+ *
+ *
+ * If the frame lies in one of the fixed receive buffers, which is the case
+ * for every reply built in place, a fixed-buffer write is queued and the
+ * buffer is held until the write completes.
+ * Any other frame is copied and written like transmitUringParts().
+ * The write is submitted with the next wait, so transmitting never blocks.
+ *
+ * @param[in, out] Uring * The io_uring instance.
+ * @param[in] char * The frame to write.
+ * @param[in] int The length of the frame.
+ */
+
+void transmitUring(Uring *, char *, int);
+
+/**
+ * @brief Queues the write of a frame built outside the receive buffers,
+ * gathered from its parts, on the io_uring instance.
+ *
+ *
+ * Copies the parts into a buffer held until the write completes, as the
+ * memory they point into is released once the frame is transmitted, and
+ * queues a writev of them.
+ * The write is submitted with the next wait, so transmitting never blocks.
+ * Drops the frame if URING_COPIES writes of copies are in flight already,
+ * or if it is larger than URING_COPY_SIZE.
+ *
+ * @param[in, out] Uring * The io_uring instance.
+ * @param[in] struct iovec * The parts of the frame.
+ * @param[in] int The number of parts, two at most.
+ */
+
+void transmitUringParts(Uring *, struct iovec *, int);
+
+/**
+ * @brief Submits the queued entries and handles the completed reads.
+ *
+ *
+ * Submits every queued read and write, and waits for at least one
+ * completion in the same system call, or until the timeout expires.
+ * Calls the handler provided for every frame read, then posts a new read on
+ * the buffer, unless the handler transmitted a reply from it.
+ * Posts a new read on every buffer whose write completed, and releases
+ * the buffer of every copy written.
+ * Prints the error and exits the process if a read fails.
+ *
+ * @param[in, out] Uring * The io_uring instance.
+ * @param[in] void (*)(void *, char *, int) The handler called for every
+ * frame read.
+ * @param[in] void * The context passed to the handler.
+ * @param[in] int The milliseconds to wait at most for a completion.
+ * @return int The number of frames read.
+ */
+
+int runUring(Uring *, void (*)(void *, char *, int), void *, int);
+
+#endif
@@ -0,0 +1,175 @@
+/**
+ * @file worker.h
+ * @author Aryan Chopra
+ * @brief Contains the declaration of the struct representing a worker, which
+ * receives and handles the frames of one queue of every TAP device.
+ */
+
+#ifndef WORKER_H
+#define WORKER_H
+
+#include <pthread.h>
+
+#include "config.h"
+#include "ethernet.h"
+#include "netdev.h"
+#include "packet_buffer.h"
+#include "spsc_ring.h"
+
+/**
+ * @struct Worker
+ * @brief A struct representing a thread serving one queue of every TAP
+ * device.
+ *
+ * @var Worker::index
+ * Index of the queue served by the worker.
+ *
+ * @var Worker::core
+ * The CPU core the worker thread is pinned to.
+ *
+ * @var Worker::thread
+ * The thread running the worker.
+ *
+ * @var Worker::devices
+ * The worker's own copies of the network devices, indexed by their index.
+ * The device descriptor of every copy is the file descriptor of the
+ * worker's queue of the device, so the replies are transmitted through the
+ * queue the request arrived on, and the packets forwarded through the
+ * worker's queue of their egress device.
+ *
+ * @var Worker::deviceCount
+ * Number of network devices.
+ *
+ * @var Worker::batch
+ * Maximum number of frames drained from the queue per wakeup.
+ *
+ * @var Worker::uringReads
+ * Number of reads kept posted on the queue through io_uring, zero when the
+ * queue is read with read().
+ *
+ * @var Worker::packetRing
+ * Set when the worker's queue is a packet socket with a TPACKET_V3 receive
+ * ring, instead of a TAP queue.
+ *
+ * @var Worker::xdpInterface
+ * Name of the interface whose queue the worker serves through an AF_XDP
+ * socket, NULL when the worker serves a TAP queue or a packet socket.
+ *
+ * @var Worker::ring
+ * The ring the dispatcher hands the worker the frames of its flows
+ * through, NULL when the worker reads its queue itself.
+ * The replies are written to the TAP queue directly, or handed to the
+ * transmit thread through the worker's copy of the device.
+ *
+ * @var Worker::busyPoll
+ * Time, in microseconds, the worker busy polls its TAP queues for after
+ * traffic before sleeping, zero to sleep right away.
+ */
+
+typedef struct {
+  int index;
+  int core;
+  pthread_t thread;
+  Netdev *devices;
+  int deviceCount;
+  int batch;
+  int uringReads;
+  int packetRing;
+  char *xdpInterface;
+  SpscRing *ring;
+  int busyPoll;
+} Worker;
+
+/**
+ * @brief Handles the incoming frame.
+ *
+ *
+ * Parses the incoming ethernet frame into its descriptor once, and drops
+ * it if it is truncated or malformed.
+ * Handles the frame based on the type of payload.
+ * Calls various functions designed to handle the ethernet packet.
+ * Logs the incoming ethernet header for an ARP type payload.
+ * Only ARP and IP type payloads are supported yet.
+ * The frame is not recorded as a buffer of the packet pool, so the layers
+ * copy whatever they keep of it.
+ *
+ * @param[in] Netdev * A struct emulating a network device having an IP and a
+ * MAC address.
+ * @param[in, out] char * The frame received, the reply is built in place
+ * in it.
+ * @param[in] int The length of the frame received.
+ */
+
+void handleFrame(Netdev *, char *, int);
+
+/**
+ * @brief Handles the frame received in a buffer of the packet pool.
+ *
+ *
+ * Handles the frame like handleFrame(), recording the buffer in the
+ * descriptor so the layers can hold on to it, such as the reassembly
+ * holding a fragment without copying it.
+ *
+ * @param[in] Netdev * A struct emulating a network device having an IP and a
+ * MAC address.
+ * @param[in, out] PacketBuffer * The buffer holding the frame received, the
+ * reply is built in place in it.
+ */
+
+void handleBuffer(Netdev *, PacketBuffer *);
+
+/**
+ * @brief Continually receives and handles the frames of the worker's queue.
+ *
+ *
+ * Reads ethernet frames from the queue's file descriptor and handles every
+ * frame.
+ * With several devices, waits for any of the worker's queues to become
+ * readable, and drains them in batches.
+ * Waits for the TAP queues in an event loop, which busy polls after traffic
+ * when configured to, and sleeps until the next protocol timer is due.
+ * With a batch larger than one, waits for the queue to become readable,
+ * drains up to a batch of frames without blocking, handles them one after
+ * another, and then flushes every reply of the batch together.
+ * With io_uring, keeps fixed-buffer reads posted on the queue and handles
+ * every completed read, submitting the replies without blocking.
+ * With a packet socket, handles the frames in place in the blocks of its
+ * receive ring.
+ * With an AF_XDP socket, handles the frames in place in its UMEM.
+ * With a ring, handles the frames the dispatcher pushes to it.
+ * Prints the error and exits the process if reading fails.
+ *
+ * @param[in] Worker * The worker whose queue is served.
+ */
+
+void runWorker(Worker *);
+
+/**
+ * @brief Starts a worker thread for every queue, and waits for them.
+ *
+ *
+ * Copies every network device provided for every worker, assigning the file
+ * descriptor of the worker's queue of the device to the copy.
+ * Starts one thread per queue, each pinned to its own core.
+ * Cores are assigned round robin when there are more queues than cores.
+ * Runs the worker in the calling thread instead, without pinning it, when
+ * there is a single queue.
+ * When the frames are spread by flow hash, starts the configured number of
+ * workers, each with its own ring, and dispatches the frames of the single
+ * queue to them from the calling thread, the replies being written by a
+ * transmit thread when a transmit batch is configured.
+ * Waits for the threads, which run until the process exits.
+ *
+ * @param[in] Netdev * The network devices the queues belong to.
+ * @param[in] int The number of network devices.
+ * @param[in] int (*)[MAX_QUEUES] The file descriptors of the queues of every
+ * device.
+ * @param[in] Config * The configuration, providing the number of queues,
+ * the batch size, the io_uring reads, whether the queues are packet or
+ * AF_XDP sockets, and the number of workers and transmit batch of the flow
+ * hash dispatch.
+ */
+
+void startWorkers(Netdev *, int, int (*)[MAX_QUEUES], Config *);
+
+#endif
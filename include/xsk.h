@@ -0,0 +1,174 @@
+/**
+ * @file xsk.h
+ * @author Aryan Chopra
+ * @brief Contains the declarations required to receive and transmit the
+ * frames of an existing interface through an AF_XDP socket.
+ */
+
+#ifndef XSK_H
+#define XSK_H
+
+#include <stdint.h>
+
+#define XSK_FRAME_SIZE 2048 ///Size of a frame of the UMEM.
+#define XSK_FRAME_COUNT 4096 ///Number of frames in the UMEM of a socket.
+#define XSK_RING_SIZE 2048 ///Number of descriptors in each of the rings of a socket.
+
+/**
+ * @struct XskRing
+ * @brief A struct holding one of the four rings shared with the kernel.
+ *
+ * @var XskRing::producer
+ * Index of the next descriptor to be produced.
+ *
+ * @var XskRing::consumer
+ * Index of the next descriptor to be consumed.
+ *
+ * @var XskRing::descriptors
+ * The descriptors of the ring, either UMEM addresses for the fill and
+ * completion rings, or struct xdp_desc for the receive and transmit rings.
+ *
+ * @var XskRing::mask
+ * Mask wrapping an index into the ring.
+ */
+
+typedef struct {
+  uint32_t *producer;
+  uint32_t *consumer;
+  void *descriptors;
+  uint32_t mask;
+} XskRing;
+
+/**
+ * @struct Xsk
+ * @brief A struct holding an AF_XDP socket bound to one queue of an
+ * interface, and its UMEM.
+ *
+ * @var Xsk::socketDescriptor
+ * File descriptor of the AF_XDP socket.
+ *
+ * @var Xsk::umem
+ * The frame pool shared with the kernel, which the frames are received into
+ * and transmitted from.
+ *
+ * @var Xsk::fill
+ * Ring handing free frames to the kernel to receive into.
+ *
+ * @var Xsk::completion
+ * Ring handing the frames transmitted back from the kernel.
+ *
+ * @var Xsk::rx
+ * Ring of the frames received.
+ *
+ * @var Xsk::tx
+ * Ring of the frames to transmit.
+ *
+ * @var Xsk::spare
+ * Frames kept out of the fill ring, to copy a frame into when it does not
+ * already lie in the UMEM.
+ *
+ * @var Xsk::spareCount
+ * Number of spare frames.
+ *
+ * @var Xsk::queued
+ * Number of frames posted to the transmit ring since the kernel was last
+ * woken up.
+ *
+ * @var Xsk::replied
+ * Set when the frame being handled was posted to the transmit ring, so it
+ * is not handed back to the fill ring until its transmission completes.
+ */
+
+typedef struct {
+  int socketDescriptor;
+  char *umem;
+
+  XskRing fill;
+  XskRing completion;
+  XskRing rx;
+  XskRing tx;
+
+  uint64_t *spare;
+  int spareCount;
+  int queued;
+  int replied;
+} Xsk;
+
+/**
+ * @brief Attaches the XDP program redirecting the frames of an interface to
+ * the AF_XDP sockets.
+ *
+ *
+ * Creates the XSKMAP the sockets register in, one entry per queue.
+ * Loads a program redirecting every frame to the socket of its receive
+ * queue, or passing it to the kernel if the queue has no socket.
+ * Attaches the program to the interface in generic mode, which works on
+ * every driver, including veth.
+ * The program stays attached until the process exits.
+ * Prints the error and exits the process on failure.
+ *
+ * @param[in] char * The name of the interface.
+ */
+
+void attachXdpProgram(char *);
+
+/**
+ * @brief Opens an AF_XDP socket on one queue of an interface.
+ *
+ *
+ * Allocates and registers the UMEM, and sets up and maps the fill,
+ * completion, receive and transmit rings.
+ * Binds the socket to the queue in copy mode.
+ * Hands all the frames but a few spares to the fill ring.
+ * Registers the socket in the XSKMAP, so the program redirects the queue's
+ * frames to it.
+ * Prints the error and exits the process on failure.
+ *
+ * @param[in] char * The name of the interface.
+ * @param[in] int The queue of the interface.
+ * @return Xsk * The socket opened.
+ * @pre attachXdpProgram was called on the interface.
+ */
+
+Xsk *openXsk(char *, int);
+
+/**
+ * @brief Posts a frame to the transmit ring of the socket.
+ *
+ *
+ * A frame lying in the UMEM, which is the case for every reply rewritten in
+ * place, is posted without any copy, and held until its transmission
+ * completes.
+ * Any other frame is copied into a spare frame first.
+ * The frame is dropped if the transmit ring is full.
+ *
+ * @param[in, out] Xsk * The socket.
+ * @param[in] char * The frame to transmit.
+ * @param[in] int The length of the frame.
+ */
+
+void transmitXsk(Xsk *, char *, int);
+
+/**
+ * @brief Handles the frames received on the socket.
+ *
+ *
+ * Waits until frames are received, or the timeout expires, if the receive
+ * ring is empty.
+ * Calls the handler provided for every descriptor of the receive ring, with
+ * the frame in place in the UMEM.
+ * Hands every frame not transmitted back to the fill ring.
+ * Wakes the kernel up to transmit the frames posted, and hands the frames
+ * whose transmission completed back to the fill ring.
+ *
+ * @param[in, out] Xsk * The socket.
+ * @param[in] void (*)(void *, char *, int) The handler called for every
+ * frame.
+ * @param[in] void * The context passed to the handler.
+ * @param[in] int The milliseconds to wait at most for a frame.
+ * @return int The number of frames handled.
+ */
+
+int runXsk(Xsk *, void (*)(void *, char *, int), void *, int);
+
+#endif
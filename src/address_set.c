@@ -0,0 +1,295 @@
+/**
+ * @file address_set.c
+ * @author Aryan Chopra
+ * @brief A set of IPv4 addresses and prefixes, looked up in constant time
+ * whatever its size.
+ *
+ * The prefixes of every length are held in their own open-addressing hash
+ * table, keyed by the prefix with its host bits cleared.
+ * An address belongs to the set if, for one of the lengths present, the
+ * address masked to that length is found in the table of the length, so a
+ * lookup makes one probe per length present, usually one or two, and never
+ * more than 33.
+ * Whole subnets are added as a single prefix, so a /16 answered by proxy
+ * costs one slot rather than 65536.
+ */
+
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "address_set.h"
+#include "hash.h"
+
+/**
+ * @brief Returns the mask of a prefix length, in host notation.
+ *
+ * @param[in] length The length of the prefix.
+ * @return The mask.
+ */
+
+static uint32_t prefixMask(int length) {
+  return length == 0 ? 0 : 0xffffffffu << (32 - length);
+}
+
+/**
+ * @brief Hashes a prefix.
+ *
+ * @param[in] network The prefix, in host notation.
+ * @return The hash of the prefix.
+ */
+
+static uint32_t hashNetwork(uint32_t network) {
+  return mixHash(network);
+}
+
+/**
+ * @brief Finds the slot of a prefix, or the free slot it would be inserted
+ * in.
+ *
+ * @param[in] set The set.
+ * @param[in] length The length of the prefix, whose table is allocated.
+ * @param[in] network The prefix, in host notation.
+ * @return The slot.
+ */
+
+static AddressSlot *probeAddress(AddressSet *set, int length, uint32_t network) {
+  uint32_t mask = set->masks[length];
+  uint32_t index = hashNetwork(network) & mask;
+
+  while (set->slots[length][index].used && set->slots[length][index].network != network) {
+    index = (index + 1) & mask;
+  }
+
+  return &set->slots[length][index];
+}
+
+/**
+ * @brief Allocates the table of a prefix length with the number of slots
+ * provided, and reinserts the prefixes it held.
+ *
+ *
+ * Prints the error and exits the process if the table cannot be allocated.
+ *
+ * @param[in, out] set The set.
+ * @param[in] length The length of the prefixes.
+ * @param[in] size The number of slots, a power of two.
+ */
+
+static void resizeLength(AddressSet *set, int length, uint32_t size) {
+  AddressSlot *old = set->slots[length];
+  uint32_t oldSize = old != NULL ? set->masks[length] + 1 : 0;
+
+  set->slots[length] = calloc(size, sizeof(AddressSlot));
+
+  if (set->slots[length] == NULL) {
+    printf("Could not allocate %u address slots\n", size);
+    exit(1);
+  }
+
+  set->masks[length] = size - 1;
+
+  for (uint32_t index = 0; index < oldSize; index++) {
+    if (old[index].used) {
+      *probeAddress(set, length, old[index].network) = old[index];
+    }
+  }
+
+  free(old);
+}
+
+/**
+ * @brief Allocates an empty set of addresses.
+ *
+ *
+ * Prints the error and exits the process if the set cannot be allocated.
+ *
+ * @return The set.
+ */
+
+AddressSet *newAddressSet() {
+  AddressSet *set = calloc(1, sizeof(AddressSet));
+
+  if (set == NULL) {
+    printf("Could not allocate an address set\n");
+    exit(1);
+  }
+
+  return set;
+}
+
+/**
+ * @brief Adds a prefix to the set.
+ *
+ *
+ * Allocates the table of the length on its first prefix, and doubles it
+ * once it is loaded above ADDRESS_SET_LOAD.
+ * The set is not synchronized, it is filled before the workers are started
+ * and only read afterwards.
+ * Prints the error and exits the process if the table cannot be grown.
+ *
+ * @param[in, out] set The set.
+ * @param[in] address An address of the prefix, in Network notation(Big
+ * Endian), its host bits ignored.
+ * @param[in] length The length of the prefix, 32 for a single address.
+ * @return 0 if the prefix was added, -1 if the length is invalid.
+ */
+
+int addAddress(AddressSet *set, uint32_t address, int length) {
+  if (length < 0 || length > 32) {
+    return -1;
+  }
+
+  uint32_t network = ntohl(address) & prefixMask(length);
+
+  if (set->slots[length] == NULL) {
+    resizeLength(set, length, ADDRESS_SET_LEN);
+  }
+  else if ((uint64_t) (set->counts[length] + 1) * 100 > ((uint64_t) set->masks[length] + 1) * ADDRESS_SET_LOAD) {
+    resizeLength(set, length, (set->masks[length] + 1) * 2);
+  }
+
+  AddressSlot *slot = probeAddress(set, length, network);
+
+  if (!slot->used) {
+    slot->network = network;
+    slot->used = 1;
+    set->counts[length]++;
+  }
+
+  set->lengths |= 1ULL << length;
+
+  return 0;
+}
+
+/**
+ * @brief Checks whether an address belongs to a prefix of the set.
+ *
+ *
+ * Probes the table of every length present, from the longest one.
+ *
+ * @param[in] set The set.
+ * @param[in] address The address, in Network notation(Big Endian).
+ * @return 1 if the address belongs to the set, 0 otherwise.
+ */
+
+int containsAddress(AddressSet *set, uint32_t address) {
+  uint32_t host = ntohl(address);
+  uint64_t lengths = set->lengths;
+
+  while (lengths != 0) {
+    int length = 63 - __builtin_clzll(lengths);
+
+    if (probeAddress(set, length, host & prefixMask(length))->used) {
+      return 1;
+    }
+
+    lengths &= ~(1ULL << length);
+  }
+
+  return 0;
+}
+
+/**
+ * @brief Parses an address or a prefix in decimal notation, such as
+ * 10.1.0.0/16.
+ *
+ * @param[in] text The address, followed by the length of the prefix if it
+ * is not a single address.
+ * @param[out] address The address, in Network notation(Big Endian).
+ * @param[out] length The length of the prefix, 32 for a single address.
+ * @return 0 if the prefix was parsed, -1 otherwise.
+ */
+
+int parsePrefix(char *text, uint32_t *address, int *length) {
+  char decimal[INET_ADDRSTRLEN];
+  char *slash = strchr(text, '/');
+  size_t size = slash != NULL ? (size_t) (slash - text) : strlen(text);
+
+  if (size >= sizeof(decimal)) {
+    return -1;
+  }
+
+  memcpy(decimal, text, size);
+  decimal[size] = '\0';
+
+  if (inet_pton(AF_INET, decimal, address) != 1) {
+    return -1;
+  }
+
+  *length = 32;
+
+  if (slash != NULL) {
+    char *end;
+
+    *length = (int) strtol(slash + 1, &end, 10);
+
+    if (end == slash + 1 || *end != '\0' || *length < 0 || *length > 32) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * @brief Parses an address or a prefix in decimal notation, such as
+ * 10.1.0.0/16, and adds it to the set.
+ *
+ * @param[in, out] set The set.
+ * @param[in] text The address, followed by the length of the prefix if it
+ * is not a single address.
+ * @return 0 if the prefix was added, -1 if it could not be parsed.
+ */
+
+int parseAddress(AddressSet *set, char *text) {
+  uint32_t address;
+  int length;
+
+  if (parsePrefix(text, &address, &length) != 0) {
+    return -1;
+  }
+
+  return addAddress(set, address, length);
+}
+
+/**
+ * @brief Adds every address or prefix listed in a file to the set, one per
+ * line.
+ *
+ *
+ * Skips the empty lines and the lines starting with #.
+ * Prints the error and exits the process if the file cannot be read or a
+ * line cannot be parsed.
+ *
+ * @param[in, out] set The set.
+ * @param[in] path The path of the file.
+ */
+
+void loadAddresses(AddressSet *set, char *path) {
+  FILE *file = fopen(path, "r");
+  char line[64];
+  int number = 0;
+
+  if (file == NULL) {
+    perror("Could not open the address file");
+    exit(1);
+  }
+
+  while (fgets(line, sizeof(line), file) != NULL) {
+    number++;
+    line[strcspn(line, " \t\r\n")] = '\0';
+
+    if (line[0] == '\0' || line[0] == '#') {
+      continue;
+    }
+
+    if (parseAddress(set, line) != 0) {
+      printf("Invalid address on line %d of %s: %s\n", number, path, line);
+      exit(1);
+    }
+  }
+
+  fclose(file);
+}
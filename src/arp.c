@@ -7,155 +7,851 @@
  * The payload is extracted and is stored in an Arp header, which contains information such as device type.
  * ARP query is run on the IP data extracted from the ARP header's payload, containing information about sending and receiving device.
  * If the requested IP address is found in the cache maintained, an ARP reply is sent modifying the contents of the received ethernet packet.
+ * Only the senders of the ARP packets asking for a local address are inserted in the cache, the other senders only
+ * refresh the entries they already have, as RFC 826 specifies.
+ * Every entry of the cache ages on a timer wheel: it turns stale once the neighbour has not been heard from for a while,
+ * is probed with unicast ARP requests if a transmit used it since, and expires if it was not used or none of the probes
+ * is answered.
+ * Packets sent to a neighbour missing from the cache are queued on a waiting entry, while broadcast ARP requests
+ * resolve its MAC address, and are transmitted once the neighbour answers.
+ * Requests for any local address are answered from a prebuilt reply frame, with only the requester's addresses and the
+ * requested address patched in.
+ * The cache can be saved to a snapshot file periodically, and restored from it when the process restarts.
+ * The workers look the neighbours up without any lock, only the updates to the cache are serialized, and the entries
+ * removed are retired until no worker can still be reading them.
  */
 
 #include <arpa/inet.h>
 #include <fcntl.h>
 #include <inttypes.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <unistd.h>
 
 #include "arp.h"
+#include "arp_snapshot.h"
+#include "epoch.h"
 #include "log.h"
 #include "netdev.h"
+#include "packet.h"
+#include "packet_buffer.h"
+#include "pipeline.h"
+#include "rate_limit.h"
+#include "timer.h"
 
-ArpCacheEntry cache[ARP_CACHE_LEN];
+/**
+ * Serializes the updates to the ARP cache made by the workers of different
+ * queues, and the timers aging its entries, lookups take no lock.
+ */
+
+static pthread_mutex_t cacheLock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * The wheel the timers of the entries are armed on, guarded by cacheLock.
+ */
+
+static TimerWheel arpTimers;
+
+/**
+ * The tick the next timer of arpTimers is due at, at the latest, UINT64_MAX when none is armed, written under
+ * cacheLock and read without it by the workers computing how long they may sleep.
+ */
+
+static uint64_t arpDeadline = UINT64_MAX;
+
+/**
+ * The number of packets queued on all the entries waiting for their MAC address, ARP_PENDING_MAX at most, guarded by
+ * cacheLock.
+ */
+
+static int pendingTotal;
+
+/**
+ * The path of the snapshot file, and the timer saving the cache to it, armed on arpTimers.
+ */
+
+static char *snapshotPath;
+static Timer snapshotTimer;
+
+/**
+ * The reply frame sent from the local addresses of the network device, only the requester's addresses and the
+ * requested address left to fill in.
+ */
+
+static unsigned char replyTemplate[ARP_FRAME_LEN];
+
+/**
+ * @brief Builds the template of the replies sent from the local addresses of a network device.
+ *
+ *
+ * Fills in every field which is the same for all the replies, in Network notation(Big Endian): our MAC address as the
+ * source of the ethernet header and as the sender, and the reply opcode.
+ * The address of the device is filled in as the sender, the reply patching in the address requested.
+ *
+ * @param[out] template The template.
+ * @param[in] netdev The network device the replies are sent from.
+ */
+
+static void buildReplyTemplate(unsigned char *template, Netdev *netdev) {
+  EthernetHeader *ethHeader = (EthernetHeader *) template;
+  ArpHeader *arpHeader = (ArpHeader *) ethHeader->payload;
+  arp_ipv4 *arpData = (arp_ipv4 *) arpHeader->data;
+
+  memset(template, 0, ARP_FRAME_LEN);
+  memcpy(ethHeader->sourceMac, netdev->macOctets, 6);
+  ethHeader->payloadType = htons(ETH_P_ARP);
+
+  arpHeader->hardwareType = htons(ARP_ETHERNET);
+  arpHeader->protocol = htons(ARP_IPV4);
+  arpHeader->hardwareSize = 6;
+  arpHeader->prosize = 4;
+  arpHeader->opcode = htons(ARP_REPLY);
+
+  memcpy(arpData->sourceMac, netdev->macOctets, 6);
+  arpData->sourceIp = netdev->address;
+}
+
+/**
+ * @brief Arms a timer on the wheel of the ARP cache, and publishes its expiry if it is due before the next deadline.
+ *
+ * @param[in, out] timer The timer.
+ * @param[in] ticks The number of ticks after which the timer expires.
+ * @pre cacheLock is held.
+ */
+
+static void armArpTimer(Timer *timer, uint64_t ticks) {
+  addTimer(&arpTimers, timer, ticks);
+
+  if (timer->expires < arpDeadline) {
+    __atomic_store_n(&arpDeadline, timer->expires, __ATOMIC_RELAXED);
+  }
+}
 
 /**
- * @brief This function initializes the ArpCache buffer by setting it to zero(0).
+ * @brief Transmits an ARP request for an IP address from the network device.
  *
- * @pre An array containing ArpCacheEntry of size ARP_CACHE_LEN exists.
+ *
+ * Builds the request in a buffer taken from the packet pool, asking for the MAC address of the IP address provided.
+ * Sends it to the MAC address provided, or broadcasts it if none is provided.
+ * Flushes the device, so the buffer can go back to the pool right away.
+ * Drops the request if the packet pool is exhausted.
+ *
+ * @param[in] netdev A struct emulating a network device having IP and MAC address.
+ * @param[in] ip The IP address whose MAC address is requested.
+ * @param[in] mac The MAC address the request is sent to, or NULL to broadcast it.
  */
 
-void initArp() {
-  memset(cache, 0, ARP_CACHE_LEN * sizeof(ArpCacheEntry));
+static void transmitArpRequest(Netdev *netdev, uint32_t ip, unsigned char *mac) {
+  static unsigned char broadcast[6] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+  PacketBuffer *buffer = allocPacket();
+
+  if (buffer == NULL) {
+    return;
+  }
+
+  EthernetHeader *ethHeader = (EthernetHeader *) buffer->data;
+  ArpHeader *arpHeader = (ArpHeader *) ethHeader->payload;
+  arp_ipv4 *arpData = (arp_ipv4 *) arpHeader->data;
+
+  arpHeader->hardwareType = htons(ARP_ETHERNET);
+  arpHeader->protocol = htons(ARP_IPV4);
+  arpHeader->hardwareSize = 6;
+  arpHeader->prosize = 4;
+  arpHeader->opcode = htons(ARP_REQUEST);
+
+  memcpy(arpData->sourceMac, netdev->macOctets, 6);
+  arpData->sourceIp = netdev->address;
+  memset(arpData->destinationMac, 0, 6);
+  arpData->destinationIp = ip;
+
+  log(arpData, L_ARP);
+  transmitNetdev(netdev, ethHeader, ETH_P_ARP, sizeof(ArpHeader) + sizeof(arp_ipv4), mac != NULL ? mac : broadcast);
+  flushNetdev(netdev);
+  freePacket(buffer);
 }
 
 /**
- * @brief Creates a new ARP entry for the ARP header passed.
+ * @struct ArpProbe
+ * @brief A struct holding an ARP request decided while cacheLock is held, to be sent once it is released.
  *
+ * @var ArpProbe::ip
+ * The IP address whose MAC address is requested.
  *
- * The function browses through the already existing cache and finds and an entry which is free, or not initialized yet.
- * Creates a new entry in the cache from, a struct, containing the state of the entry, hardware type of the device,
- * source IP Address and source MAC Address.
+ * @var ArpProbe::mac
+ * The MAC address the request is sent to, when it is not broadcast.
  *
- * @param[in] header Struct containing the information about the device sending the ARP request.
- * @param[in] data Struct containing the source and destination IP and MAC address.
- * @return 0, if the entry is inserted successfully, -1, if the cache is full.
- * @pre ARP_CACHE_LEN is initialized, Arp Cache is initialized.
+ * @var ArpProbe::broadcast
+ * Whether the request is broadcast.
+ *
+ * @var ArpProbe::device
+ * The index of the network device the request is sent from.
  */
 
-int insertArpEntry(ArpHeader *header, arp_ipv4 *data) {
-  int length = ARP_CACHE_LEN;
+typedef struct {
+  uint32_t ip;
+  unsigned char mac[6];
+  int broadcast;
+  int device;
+} ArpProbe;
 
-  ArpCacheEntry *entry;
+/**
+ * The requests of the timers which expired, left for runArpTimers() to send once it released cacheLock, guarded by
+ * cacheLock.
+ */
 
-  for (int index = 0; index < length; index++) {
-    entry = &(cache[index]);
+static ArpProbe *probes;
+static int probeCount;
+static int probeCapacity;
 
-    if (entry->state == ARP_FREE) {
-      entry->state = ARP_RESOLVED;
+/**
+ * @brief Records an ARP request to be sent by runArpTimers() once it released the lock of the cache.
+ *
+ *
+ * Grows the list of requests as needed, and drops the request if it cannot.
+ *
+ * @param[in] entry The entry of the neighbour, probed with a unicast request unless it is waiting.
+ * @pre cacheLock is held.
+ */
 
-      entry->hardwareType = header->hardwareType;
-      entry->sourceIp = data->sourceIp;
-      memcpy(entry->sourceMac, data->sourceMac, sizeof(entry->sourceMac));
+static void queueProbe(ArpCacheEntry *entry) {
+  if (probeCount == probeCapacity) {
+    int capacity = probeCapacity > 0 ? probeCapacity * 2 : ARP_PROBE_BATCH;
+    ArpProbe *grown = realloc(probes, capacity * sizeof(ArpProbe));
 
-      return 0;
+    if (grown == NULL) {
+      return;
     }
+
+    probes = grown;
+    probeCapacity = capacity;
   }
 
-  return -1;
+  ArpProbe *probe = &probes[probeCount++];
+
+  probe->ip = entry->sourceIp;
+  probe->broadcast = entry->neighbour.state == ARP_WAITING;
+  probe->device = entry->device;
+  memcpy(probe->mac, entry->neighbour.mac, 6);
 }
 
 /**
- * @brief Updates the ARP cache's mac address for the corresponding IP address contained in the ARP data
+ * @brief Drops every packet queued on an entry.
  *
- * 
- * Updates the ARP cache browsing through every entry.
- * Confirms whether the entry is resolved, then checks if the hardware type and IP address of the source matches.
- * If the above conditions are satisfied, the entry's corresponding MAC address is updated.
+ * @param[in, out] entry The entry of the neighbour.
+ */
+
+static void dropPending(ArpCacheEntry *entry) {
+  while (entry->pending != NULL) {
+    PacketBuffer *buffer = entry->pending;
+
+    entry->pending = buffer->next;
+    freePacket(buffer);
+  }
+
+  pendingTotal -= entry->pendingCount;
+  entry->pendingCount = 0;
+}
+
+/**
+ * @brief Takes every packet queued on an entry off it, now that the MAC address of its neighbour is resolved.
  *
- * @param[in] header Struct containing the information about the device sending the ARP request.
- * @param[in] data Struct containing the source and destination IP and MAC address.
- * @return 0, if the entry is updated successfully, -1 if the entry having the IP address of the source does not exist.
- * @pre ARP_CACHE_LEN is initialized, Arp Cache is initalized.
+ * @param[in, out] entry The entry of the neighbour.
+ * @return The packets queued, linked in the order they were queued in, NULL if there are none.
+ * @pre cacheLock is held.
  */
 
-int updateArpTable(ArpHeader *header, arp_ipv4 *data) {
-  int length = ARP_CACHE_LEN;
+static PacketBuffer *detachPending(ArpCacheEntry *entry) {
+  PacketBuffer *pending = entry->pending;
 
-  ArpCacheEntry *entry;
+  pendingTotal -= entry->pendingCount;
+  entry->pending = NULL;
+  entry->pendingCount = 0;
 
-  for (int index = 0; index < length; index++) {
-    entry = &cache[index];
+  return pending;
+}
 
-    if (entry->state == ARP_RESOLVED) {
-      if (entry->hardwareType == header->hardwareType && entry->sourceIp == data->sourceIp) {
-        memcpy(entry->sourceMac, data->sourceMac, 6);
-        return 1;
-      }
+/**
+ * @brief Transmits the packets taken off an entry whose MAC address was resolved, and frees their buffers.
+ *
+ *
+ * Called without cacheLock, so the other workers resolving neighbours do not wait for the device.
+ * Flushes the device after every packet, so its buffer can go back to the pool right away.
+ *
+ * @param[in] netdev The network device the packets are sent from.
+ * @param[in] pending The packets, as returned by detachPending().
+ * @param[in] mac The MAC address of the neighbour.
+ */
+
+static void transmitPending(Netdev *netdev, PacketBuffer *pending, unsigned char *mac) {
+  while (pending != NULL) {
+    PacketBuffer *buffer = pending;
+    EthernetHeader *ethHeader = (EthernetHeader *) buffer->data;
+
+    pending = buffer->next;
+    transmitNetdev(netdev, ethHeader, ntohs(ethHeader->payloadType), buffer->length - sizeof(EthernetHeader), mac);
+    flushNetdev(netdev);
+    freePacket(buffer);
+  }
+}
+
+/**
+ * @brief Queues a copy of a packet on an entry whose MAC address is being resolved.
+ *
+ *
+ * Drops the oldest packet queued if ARP_PENDING_LEN packets are queued already.
+ * Fails if ARP_PENDING_MAX packets are queued on all the entries, so the neighbours never answering cannot hold the
+ * packet pool, or if the packet pool is exhausted.
+ * The type of payload is kept in the ethernet header of the copy, in Network notation(Big Endian).
+ *
+ * @param[in, out] entry The entry of the neighbour.
+ * @param[in] ethHeader The frame carrying the packet.
+ * @param[in] ethertype The type of payload of the frame.
+ * @param[in] length The length of the payload of the frame.
+ * @return 0 if the packet was queued, -1 if it was dropped.
+ * @pre cacheLock is held.
+ */
+
+static int queuePending(ArpCacheEntry *entry, EthernetHeader *ethHeader, uint16_t ethertype, int length) {
+  if (entry->pendingCount < ARP_PENDING_LEN && pendingTotal == ARP_PENDING_MAX) {
+    return -1;
+  }
+
+  PacketBuffer *buffer = allocPacket();
+
+  if (buffer == NULL || appendPacket(buffer, sizeof(EthernetHeader) + length) == NULL) {
+    if (buffer != NULL) {
+      freePacket(buffer);
     }
+
+    return -1;
+  }
+
+  memcpy(buffer->data, ethHeader, buffer->length);
+  ((EthernetHeader *) buffer->data)->payloadType = htons(ethertype);
+
+  if (entry->pendingCount == ARP_PENDING_LEN) {
+    PacketBuffer *oldest = entry->pending;
+
+    entry->pending = oldest->next;
+    entry->pendingCount--;
+    pendingTotal--;
+    freePacket(oldest);
   }
+
+  PacketBuffer **tail = &entry->pending;
+
+  while (*tail != NULL) {
+    tail = &(*tail)->next;
+  }
+
+  *tail = buffer;
+  entry->pendingCount++;
+  pendingTotal++;
+
   return 0;
 }
 
+/**
+ * @brief Removes an entry from the cache along with the packets queued on it, and retires it, as workers may still be
+ * reading it.
+ *
+ * @param[in, out] entry The entry.
+ * @pre cacheLock is held.
+ */
+
+static void expireArpEntry(ArpCacheEntry *entry) {
+  deleteArpEntry(entry->hardwareType, entry->sourceIp);
+  dropPending(entry);
+  retireEpoch(entry, free);
+}
+
+/**
+ * @brief Records that a transmit used an entry, if it is stale, so it is probed rather than left to expire.
+ *
+ *
+ * Called without the lock of the cache, the flag being written only when it changes, so the transmits of a busy
+ * neighbour do not write to its entry.
+ *
+ * @param[in, out] entry The entry of the neighbour.
+ * @param[in] neighbour The MAC address and the state read from the entry.
+ */
+
+static void useArpEntry(ArpCacheEntry *entry, ArpNeighbour neighbour) {
+  if (neighbour.state == ARP_STALE && !__atomic_load_n(&entry->used, __ATOMIC_RELAXED)) {
+    __atomic_store_n(&entry->used, 1, __ATOMIC_RELAXED);
+  }
+}
+
+/**
+ * @brief Ages an entry of the ARP cache once its timer expires.
+ *
+ *
+ * A reachable entry turns stale, without any probe, and waits ARP_DELAY_TIME milliseconds for a transmit to use it.
+ * A stale entry which was not used then expires, so the neighbours nothing sends to cost neither memory nor probes.
+ * A stale entry which was used is probed with a unicast ARP request to the MAC address it holds, every
+ * ARP_PROBE_INTERVAL milliseconds.
+ * A waiting entry retransmits its broadcast ARP request every ARP_PROBE_INTERVAL milliseconds.
+ * The probes and requests are only recorded, runArpTimers() sending them once it released cacheLock.
+ * The entry expires, and is removed from the cache along with the packets queued on it, once ARP_PROBE_COUNT probes
+ * or requests are left unanswered, then retired, as workers may still be reading it.
+ *
+ * @param[in, out] timer The timer of the entry.
+ * @param[in] context Unused.
+ * @pre cacheLock is held.
+ */
+
+static void arpEntryExpired(Timer *timer, void *context) {
+  ArpCacheEntry *entry = timerOwner(timer, ArpCacheEntry, timer);
+
+  (void) context;
+
+  if (entry->neighbour.state == ARP_REACHABLE) {
+    __atomic_store_n(&entry->used, 0, __ATOMIC_RELAXED);
+    writeArpNeighbour(entry, entry->neighbour.mac, ARP_STALE);
+    entry->probes = 0;
+    armArpTimer(&entry->timer, TIMER_TICKS(ARP_DELAY_TIME));
+    return;
+  }
+
+  if (entry->probes == ARP_PROBE_COUNT || (entry->neighbour.state == ARP_STALE && entry->probes == 0 && !__atomic_load_n(&entry->used, __ATOMIC_RELAXED))) {
+    expireArpEntry(entry);
+    return;
+  }
+
+  entry->probes++;
+  queueProbe(entry);
+  armArpTimer(&entry->timer, TIMER_TICKS(ARP_PROBE_INTERVAL));
+}
+
+/**
+ * @brief Marks an entry as reachable, as its neighbour was just heard from.
+ *
+ *
+ * Rearms the timer of the entry, which turns it stale after ARP_REACHABLE_TIME milliseconds.
+ *
+ * @param[in, out] entry The entry of the neighbour.
+ * @pre cacheLock is held.
+ */
+
+static void confirmArpEntry(ArpCacheEntry *entry) {
+  writeArpNeighbour(entry, entry->neighbour.mac, ARP_REACHABLE);
+  entry->probes = 0;
+  entry->timer.callback = arpEntryExpired;
+
+  armArpTimer(&entry->timer, TIMER_TICKS(ARP_REACHABLE_TIME));
+}
+
+/**
+ * @struct ArpSnapshotWalk
+ * @brief A struct holding the records collected while walking the cache.
+ *
+ * @var ArpSnapshotWalk::records
+ * The records, one per reachable entry.
+ *
+ * @var ArpSnapshotWalk::count
+ * Number of records collected.
+ *
+ * @var ArpSnapshotWalk::now
+ * The wall-clock time the walk started at, in milliseconds since the epoch.
+ */
+
+typedef struct {
+  ArpSnapshotRecord *records;
+  uint32_t count;
+  uint64_t now;
+} ArpSnapshotWalk;
+
+/**
+ * The records collected by the snapshot timer, left for runArpTimers() to save once it released cacheLock, guarded
+ * by cacheLock, its records NULL when no snapshot is due.
+ */
+
+static ArpSnapshotWalk snapshotWalk;
+
+/**
+ * @brief Records an entry of the cache, if it is reachable.
+ *
+ *
+ * The wall-clock time the entry turns stale at is derived from the ticks left on its timer.
+ *
+ * @param[in] entry The entry.
+ * @param[in, out] context The walk.
+ * @pre cacheLock is held.
+ */
+
+static void collectArpEntry(ArpCacheEntry *entry, void *context) {
+  ArpSnapshotWalk *walk = context;
+  ArpSnapshotRecord *record = &walk->records[walk->count];
+
+  if (entry->neighbour.state != ARP_REACHABLE) {
+    return;
+  }
+
+  record->expires = walk->now + (entry->timer.expires - arpTimers.now) * TIMER_TICK_MS;
+  record->ip = entry->sourceIp;
+  record->hardwareType = entry->hardwareType;
+  memcpy(record->mac, entry->neighbour.mac, 6);
+  walk->count++;
+}
+
+/**
+ * @brief Copies the reachable entries of the cache once the snapshot timer expires, and rearms it.
+ *
+ *
+ * Only collects the records, runArpTimers() writing them to the snapshot file after releasing cacheLock, so the
+ * workers resolving neighbours do not wait for the file system.
+ *
+ * @param[in, out] timer The snapshot timer.
+ * @param[in] context Unused.
+ * @pre cacheLock is held.
+ */
+
+static void snapshotExpired(Timer *timer, void *context) {
+  (void) context;
+
+  if (snapshotWalk.records == NULL) {
+    snapshotWalk.records = malloc(((size_t) arpCacheCount() + 1) * sizeof(ArpSnapshotRecord));
+    snapshotWalk.count = 0;
+    snapshotWalk.now = snapshotNow();
+
+    if (snapshotWalk.records != NULL) {
+      walkArpCache(collectArpEntry, &snapshotWalk);
+    }
+  }
+
+  armArpTimer(timer, TIMER_TICKS(ARP_SNAPSHOT_INTERVAL));
+}
+
+/**
+ * @brief Restores a neighbour saved in the snapshot file as reachable.
+ *
+ *
+ * Arms the timer of the entry for the time it had left to stay reachable when it was saved, ARP_REACHABLE_TIME
+ * milliseconds at most.
+ *
+ * @param[in] record The neighbour saved, which has not expired.
+ * @param[in] now The current wall-clock time, in milliseconds since the epoch.
+ * @param[in] context Unused.
+ */
+
+static void restoreArpEntry(ArpSnapshotRecord *record, uint64_t now, void *context) {
+  (void) context;
+
+  ArpCacheEntry *entry = insertArpEntry(record->hardwareType, record->ip, record->mac, ARP_REACHABLE);
+  uint64_t left = record->expires - now;
+
+  entry->probes = 0;
+  entry->timer.callback = arpEntryExpired;
+
+  armArpTimer(&entry->timer, TIMER_TICKS(left < ARP_REACHABLE_TIME ? left : ARP_REACHABLE_TIME));
+}
+
+/**
+ * @brief This function initializes the ArpCache, allocating ARP_CACHE_LEN free slots, and the wheel aging its entries.
+ *
+ *
+ * Builds the template of the replies sent from the local addresses of the network device.
+ * Restores the neighbours saved in the snapshot file provided which are still reachable, before any worker starts,
+ * and saves the cache to it every ARP_SNAPSHOT_INTERVAL milliseconds.
+ *
+ * @param[in] netdev The network device the replies are sent from.
+ * @param[in] snapshot The path of the snapshot file, NULL to start with an empty cache and not save it.
+ */
+
+void initArp(Netdev *netdev, char *snapshot) {
+  initArpCache(ARP_CACHE_LEN);
+  initTimerWheel(&arpTimers);
+  buildReplyTemplate(replyTemplate, netdev);
+
+  if (snapshot == NULL) {
+    return;
+  }
+
+  snapshotPath = snapshot;
+  printf("Restored %d neighbours from %s\n", loadArpSnapshot(snapshot, restoreArpEntry, NULL), snapshot);
+
+  snapshotTimer.callback = snapshotExpired;
+  armArpTimer(&snapshotTimer, TIMER_TICKS(ARP_SNAPSHOT_INTERVAL));
+}
+
+/**
+ * @brief Inserts a neighbour missing from the cache as waiting, the caller broadcasting an ARP request for it once it
+ * released the lock of the cache.
+ *
+ *
+ * The request is retransmitted every ARP_PROBE_INTERVAL milliseconds until it is answered, or ARP_PROBE_COUNT
+ * requests are left unanswered and the entry is removed.
+ *
+ * @param[in] netdev The network device the ARP requests are sent from.
+ * @param[in] ip The IP address of the neighbour.
+ * @return The entry of the neighbour.
+ * @pre cacheLock is held, and the neighbour is missing from the cache.
+ */
+
+static ArpCacheEntry *startResolution(Netdev *netdev, uint32_t ip) {
+  static unsigned char unknown[6];
+  ArpCacheEntry *entry = insertArpEntry(ARP_ETHERNET, ip, unknown, ARP_WAITING);
+
+  entry->probes = 1;
+  entry->device = netdev->index;
+  entry->timer.callback = arpEntryExpired;
+
+  armArpTimer(&entry->timer, TIMER_TICKS(ARP_PROBE_INTERVAL));
+
+  return entry;
+}
+
+/**
+ * @brief Transmits a packet to a neighbour, resolving its MAC address first if needed.
+ *
+ *
+ * Sends the packet right away to the MAC address held in the ARP cache if the neighbour is reachable or stale, looking
+ * it up without any lock.
+ * Otherwise takes the lock of the cache, copies the packet into a buffer taken from the packet pool and queues it on
+ * the neighbour's entry, which holds ARP_PENDING_LEN packets at most, the oldest being dropped first.
+ * Counts the packet with the counters of the pipeline if it is dropped, rather than printing under the lock.
+ * A neighbour missing from the cache is inserted waiting, and a broadcast ARP request is sent for it once the lock is
+ * released, which is retransmitted every ARP_PROBE_INTERVAL milliseconds until it is answered, or ARP_PROBE_COUNT
+ * requests are left unanswered and the queued packets are dropped.
+ *
+ * @param[in] netdev The network device the packet is sent from.
+ * @param[in, out] ethHeader The frame carrying the packet, whose ethernet header is filled in.
+ * @param[in] ethertype The type of payload of the frame.
+ * @param[in] length The length of the payload of the frame.
+ * @param[in] ip The IP address of the neighbour.
+ */
+
+void resolveAndTransmit(Netdev *netdev, EthernetHeader *ethHeader, uint16_t ethertype, int length, uint32_t ip) {
+  ArpCacheEntry *entry = lookupArpEntry(ARP_ETHERNET, ip);
+  ArpNeighbour neighbour;
+
+  if (entry != NULL && (neighbour = readArpNeighbour(entry)).state != ARP_WAITING) {
+    useArpEntry(entry, neighbour);
+    transmitNetdev(netdev, ethHeader, ethertype, length, neighbour.mac);
+    return;
+  }
+
+  pthread_mutex_lock(&cacheLock);
+  entry = lookupArpEntry(ARP_ETHERNET, ip);
+
+  if (entry != NULL && entry->neighbour.state != ARP_WAITING) {
+    neighbour = entry->neighbour;
+    useArpEntry(entry, neighbour);
+    pthread_mutex_unlock(&cacheLock);
+
+    transmitNetdev(netdev, ethHeader, ethertype, length, neighbour.mac);
+    return;
+  }
+
+  int resolving = entry == NULL;
+
+  if (resolving) {
+    entry = startResolution(netdev, ip);
+  }
+
+  if (queuePending(entry, ethHeader, ethertype, length) != 0) {
+    countPipeline(PIPELINE_ARP_DROPS, 1);
+  }
+
+  pthread_mutex_unlock(&cacheLock);
+
+  if (resolving) {
+    transmitArpRequest(netdev, ip, NULL);
+  }
+}
+
+/**
+ * @brief Looks up the MAC address of a neighbour, starting its resolution if it is not known.
+ *
+ *
+ * Reads the MAC address held in the ARP cache without any lock if the neighbour is reachable or stale.
+ * A neighbour missing from the cache is inserted waiting, and a broadcast ARP request is sent for it, as for
+ * resolveAndTransmit(), but nothing is queued on its entry.
+ *
+ * @param[in] netdev The network device the ARP request is sent from.
+ * @param[in] ip The IP address of the neighbour.
+ * @param[out] mac The MAC address of the neighbour, if it is known.
+ * @return 0 if the MAC address is known, -1 if the neighbour is being resolved.
+ */
+
+int resolveArp(Netdev *netdev, uint32_t ip, unsigned char *mac) {
+  ArpCacheEntry *entry = lookupArpEntry(ARP_ETHERNET, ip);
+  ArpNeighbour neighbour;
+
+  if (entry != NULL && (neighbour = readArpNeighbour(entry)).state != ARP_WAITING) {
+    useArpEntry(entry, neighbour);
+    memcpy(mac, neighbour.mac, 6);
+    return 0;
+  }
+
+  pthread_mutex_lock(&cacheLock);
+  entry = lookupArpEntry(ARP_ETHERNET, ip);
+
+  if (entry != NULL && entry->neighbour.state != ARP_WAITING) {
+    useArpEntry(entry, entry->neighbour);
+    memcpy(mac, entry->neighbour.mac, 6);
+    pthread_mutex_unlock(&cacheLock);
+    return 0;
+  }
+
+  if (entry == NULL) {
+    startResolution(netdev, ip);
+  }
+
+  pthread_mutex_unlock(&cacheLock);
+
+  if (entry == NULL) {
+    transmitArpRequest(netdev, ip, NULL);
+  }
+
+  return -1;
+}
+
+/**
+ * @brief Runs the timers of the ARP cache which expired.
+ *
+ *
+ * Does nothing if the wheel was already advanced during the current tick, or if another worker holds the cache, in
+ * which case the timers run on the next call.
+ * Publishes the tick the next timer is due at, for arpTimerDeadline().
+ * Sends the ARP requests and saves the records collected by the timers once the lock of the cache is released, the
+ * requests from the calling worker's copy of the device of their entry.
+ *
+ * @param[in] netdev The network device of the calling worker, the probes are sent from.
+ */
+
+void runArpTimers(Netdev *netdev) {
+  uint64_t now = timerNow();
+
+  if (__atomic_load_n(&arpTimers.now, __ATOMIC_RELAXED) >= now) {
+    return;
+  }
+
+  if (pthread_mutex_trylock(&cacheLock) != 0) {
+    return;
+  }
+
+  advanceTimerWheel(&arpTimers, now, netdev);
+  __atomic_store_n(&arpDeadline, nextTimerExpiry(&arpTimers), __ATOMIC_RELAXED);
+
+  ArpSnapshotWalk walk = snapshotWalk;
+  ArpProbe *sent = probes;
+  int count = probeCount;
+
+  snapshotWalk.records = NULL;
+  probes = NULL;
+  probeCount = 0;
+  probeCapacity = 0;
+  pthread_mutex_unlock(&cacheLock);
+
+  for (int index = 0; index < count; index++) {
+    transmitArpRequest(peerNetdev(netdev, sent[index].device), sent[index].ip, sent[index].broadcast ? NULL : sent[index].mac);
+  }
+
+  free(sent);
+
+  if (walk.records != NULL) {
+    saveArpSnapshot(snapshotPath, walk.records, walk.count);
+    free(walk.records);
+  }
+}
+
+/**
+ * @brief Returns the tick the next timer of the ARP cache is due at, at the latest.
+ *
+ *
+ * Reads the deadline published whenever the wheel is advanced or a timer armed, without the lock of the cache, as
+ * every worker calls it before every wait, busy polling included.
+ *
+ * @return The tick, UINT64_MAX when no timer is armed.
+ */
+
+uint64_t arpTimerDeadline() {
+  return __atomic_load_n(&arpDeadline, __ATOMIC_RELAXED);
+}
+
 /**
  * @brief Handles the incoming ARP request.
  *
  *
- * Extracts the ARP header from the Ethernet header's payload and ARP devices' informtion.
- * Converts the required information from network notation(Big Endian) to host's notation(mostly Little Endian).
+ * Extracts the ARP devices' information from the ARP header at the offset recorded in the descriptor.
+ * Reads the hardware type and opcode from the descriptor, in host's notation, instead of converting them in the frame.
  * Logs the incoming ARP packet to a log file.
- * Checks if the hardware type is supported and whether the Internet Protocol is version 4.
+ * Checks if the hardware type is supported, the protocol being checked to be IPv4 when the frame is parsed.
+ * Drops the packet, before taking the lock of the cache, if the sender exceeds its rate of ARP packets.
  * Updates the MAC address of the IP address in the ARP cache and updates a flag if the operation is successful.
  * Flag conveys whether the IP address exists in the ARP cache or not.
- * Checks whether the requested IP's MAC exists in the ARP cache.
- * Replies with the requested MAC address.
+ * Inserts the sender in the ARP cache otherwise, which grows as needed, but only if the packet asks for one of the
+ * local addresses, as RFC 826 specifies, so a sweep of ARP requests for other addresses does not fill the cache.
+ * Marks the sender's entry as reachable, whether the packet is a request or the reply to a probe, and records the
+ * device it was heard on.
+ * Transmits the packets queued on the sender's entry while its MAC address was being resolved, once the lock of the
+ * cache is released.
+ * Checks whether the requested IP address is one of the local addresses of the device, in constant time.
+ * Replies with the requested MAC address if it is.
  *
  * @param[in] netdev A struct emulating a network device having IP and MAC address.
- * @param[in] header A struct containing the information of an ethernet header.
+ * @param[in] packet The descriptor of the frame carrying the ARP header.
  */
 
-void incomingRequest(Netdev *netdev, EthernetHeader *header) {
+void incomingRequest(Netdev *netdev, Packet *packet) {
 
   ArpHeader *arpHeader;
   arp_ipv4 *arpData;
+  ArpCacheEntry *entry;
+  PacketBuffer *pending;
   int merge = 0;
+  int local;
 
-  arpHeader = (ArpHeader *) header->payload;
-  arpHeader->hardwareType = ntohs(arpHeader->hardwareType);
-  arpHeader->protocol = ntohs(arpHeader->protocol);
-  arpHeader->opcode = ntohs(arpHeader->opcode);
-
+  arpHeader = (ArpHeader *) ((char *) packet->ethernet + packet->networkOffset);
   arpData = (arp_ipv4 *) arpHeader->data;
 
   log(arpData, L_ARP | L_INCOMING);
 
-  if (arpHeader->hardwareType != ARP_ETHERNET) {
+  if (packet->hardwareType != ARP_ETHERNET) {
     printf("Only ethernet is supported\n");
     return;
   }
 
-  if (arpHeader->protocol != ARP_IPV4) {
-    printf("Only IPv4 is supported\n");
+  if (!allowRate(RATE_ARP, arpData->sourceIp)) {
     return;
   }
 
-  merge = updateArpTable(arpHeader, arpData);
+  local = containsAddress(netdev->locals, arpData->destinationIp);
 
-  if (netdev->address!= arpData->destinationIp) {
+  pthread_mutex_lock(&cacheLock);
+  entry = updateArpEntry(packet->hardwareType, arpData->sourceIp, arpData->sourceMac);
+  merge = entry != NULL;
+
+  if (!local) {
     printf("ARP not for our own address\n");
   }
 
-  if (!merge && insertArpEntry(arpHeader, arpData) != 0) {
-    printf("ARP Table full!\n");
+  if (!merge && !local) {
+    pthread_mutex_unlock(&cacheLock);
+    return;
+  }
+
+  if (!merge) {
+    entry = insertArpEntry(packet->hardwareType, arpData->sourceIp, arpData->sourceMac, ARP_REACHABLE);
   }
 
-  switch (arpHeader-> opcode) {
+  entry->device = netdev->index;
+  confirmArpEntry(entry);
+  pending = detachPending(entry);
+  pthread_mutex_unlock(&cacheLock);
+
+  transmitPending(netdev, pending, arpData->sourceMac);
+
+  switch (packet->opcode) {
     case ARP_REQUEST:
-      replyArp(netdev, header, arpHeader);
+      if (local) {
+        replyArp(netdev, packet);
+      }
+      break;
+    case ARP_REPLY:
       break;
     default:
       printf("Invalid Request\n");
@@ -167,37 +863,32 @@ void incomingRequest(Netdev *netdev, EthernetHeader *header) {
  * @brief Replies the MAC address back to the sender
  *
  *
- * Updates the ARP devices' header marking the destination(our device) as the source,
- * Fills in the requested MAC address.
- * Converts the fields back to Network notation(Big Endian).
- * Updates the opcode of ARP header from request, to response.
- * Updates the length, logs the outgoing ARP packet, and calls the function required to transmit the packet over the network.
+ * Copies the template of the replies sent from our addresses over the frame, its headers already in Network
+ * notation(Big Endian), and patches in the MAC and IP addresses of the sender and the local address requested, so a
+ * reply costs a few dozen bytes copied.
+ * Patches in the MAC address of the device the request arrived on too, the template being shared by every device.
+ * Transmits the frame as it is, without rewriting or logging it again.
  *
  * @param[in] netdev A struct emulating a network device having IP and MAC address.
- * @param[in, out] etherHeader A struct containing the information of an ethernet header.
- * @param[in, out] arpHeader A struct containing the information about the device sending the ARP request.
+ * @param[in, out] packet The descriptor of the frame carrying the ARP request, the reply is built in place in the frame.
  */
 
-void replyArp(Netdev *netdev, EthernetHeader *etherHeader, ArpHeader *arpHeader) {
-  arp_ipv4 *arpData;
-  int length;
+void replyArp(Netdev *netdev, Packet *packet) {
+  EthernetHeader *ethHeader = packet->ethernet;
+  arp_ipv4 *arpData = (arp_ipv4 *) ((char *) ethHeader + packet->networkOffset + sizeof(ArpHeader));
+  unsigned char requesterMac[6];
+  uint32_t requesterIp = arpData->sourceIp;
+  uint32_t requestedIp = arpData->destinationIp;
 
-  arpData = (arp_ipv4 *) arpHeader->data;
+  memcpy(requesterMac, arpData->sourceMac, 6);
+  memcpy(ethHeader, replyTemplate, ARP_FRAME_LEN);
 
-  memcpy(arpData->destinationMac, arpData->sourceMac, 6);
-  arpData->destinationIp = arpData->sourceIp;
+  memcpy(ethHeader->destinationMac, requesterMac, 6);
+  memcpy(ethHeader->sourceMac, netdev->macOctets, 6);
   memcpy(arpData->sourceMac, netdev->macOctets, 6);
-  arpData->sourceIp = netdev->address;
-
-  arpHeader->opcode = ARP_REPLY;
+  memcpy(arpData->destinationMac, requesterMac, 6);
+  arpData->sourceIp = requestedIp;
+  arpData->destinationIp = requesterIp;
 
-  arpHeader->opcode = htons(arpHeader->opcode);
-  arpHeader->hardwareType = htons(arpHeader->hardwareType);
-  arpHeader->protocol = htons(arpHeader->protocol);
-
-  length = sizeof(ArpHeader) + sizeof(arp_ipv4);
-
-  log(arpData, L_ARP);
-  transmitNetdev(netdev, etherHeader,  ETH_P_ARP, length, arpData->destinationMac);
+  sendNetdev(netdev, (char *) ethHeader, ARP_FRAME_LEN);
 }
-
@@ -0,0 +1,446 @@
+/**
+ * @file arp_cache.c
+ * @author Aryan Chopra
+ * @brief An open-addressing hash table holding the ARP cache.
+ *
+ * The neighbours are keyed by their IP address and hardware type.
+ * A slot of the table holds the key and a pointer to the entry, 16 bytes,
+ * so a cache line holds four slots and a lookup compares keys without
+ * touching the entries it passes over.
+ * Collisions are resolved by linear probing, so a lookup walks adjacent
+ * slots, usually within one cache line.
+ * Deleted entries leave a marker which keeps the probes going, and which is
+ * reused by the next insertion.
+ * The table doubles once it is loaded above ARP_CACHE_LOAD, and is rebuilt
+ * at the same size when the load comes from deleted entries, so it grows
+ * with the segment instead of dropping new neighbours.
+ * Only the slots move when the table is rebuilt, the entries stay where
+ * they were allocated.
+ * Lookups take no lock and never wait: a slot is published by storing its
+ * entry last, a rebuilt table by swapping the table pointer, and the key of
+ * an entry never changes, so a reader always finds a consistent entry.
+ * The tables and entries unlinked are retired, and released once no worker
+ * can still be reading them.
+ * The writers serialize their accesses.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arp_cache.h"
+#include "epoch.h"
+#include "hash.h"
+
+#define SLOT_DELETED (&deletedEntry) ///The slot held an entry which was deleted, and does not end a probe.
+
+/**
+ * @struct ArpCacheSlot
+ * @brief A slot of the table, holding the key of a neighbour and its entry.
+ *
+ * @var ArpCacheSlot::ip
+ * The IP address of the neighbour.
+ *
+ * @var ArpCacheSlot::hardwareType
+ * The hardware type of the neighbour.
+ *
+ * @var ArpCacheSlot::entry
+ * The entry of the neighbour, NULL if the slot has never held an entry and
+ * ends a probe, SLOT_DELETED if the entry it held was deleted.
+ */
+
+typedef struct {
+  uint32_t ip;
+  uint16_t hardwareType;
+  ArpCacheEntry *entry;
+} ArpCacheSlot;
+
+/**
+ * @struct ArpCacheTable
+ * @brief A struct holding the slots of the cache, swapped as a whole when
+ * the cache is rebuilt.
+ *
+ * @var ArpCacheTable::slots
+ * The slots, a power of two of them.
+ *
+ * @var ArpCacheTable::mask
+ * The number of slots minus one.
+ */
+
+typedef struct {
+  ArpCacheSlot *slots;
+  uint32_t mask;
+} ArpCacheTable;
+
+/**
+ * The table of the cache, and its usage.
+ */
+
+static ArpCacheTable *table;
+static uint32_t count;
+static uint32_t deleted;
+
+/**
+ * The entry deleted slots point to.
+ */
+
+static ArpCacheEntry deletedEntry;
+
+/**
+ * @brief Hashes the key of a neighbour.
+ *
+ *
+ * Mixes the address and the hardware type so that consecutive addresses of
+ * a subnet spread over the whole table.
+ *
+ * @param[in] hardwareType The hardware type of the neighbour.
+ * @param[in] ip The IP address of the neighbour.
+ * @return The hash of the key.
+ */
+
+static uint32_t hashArpKey(uint16_t hardwareType, uint32_t ip) {
+  return mixHash(ip ^ ((uint32_t) hardwareType << 16));
+}
+
+/**
+ * @brief Allocates a table of free slots.
+ *
+ *
+ * Prints the error and exits the process if the table cannot be allocated.
+ *
+ * @param[in] size The number of slots, a power of two.
+ * @return The table.
+ */
+
+static ArpCacheTable *allocTable(uint32_t size) {
+  ArpCacheTable *allocated = malloc(sizeof(ArpCacheTable));
+  ArpCacheSlot *slots = aligned_alloc(64, (size_t) size * sizeof(ArpCacheSlot));
+
+  if (allocated == NULL || slots == NULL) {
+    printf("Could not allocate %u ARP cache slots\n", size);
+    exit(1);
+  }
+
+  memset(slots, 0, (size_t) size * sizeof(ArpCacheSlot));
+  allocated->slots = slots;
+  allocated->mask = size - 1;
+
+  return allocated;
+}
+
+/**
+ * @brief Releases a table which was rebuilt, once no reader can still be
+ * probing it.
+ *
+ * @param[in] retired The table.
+ */
+
+static void freeTable(void *retired) {
+  ArpCacheTable *old = retired;
+
+  free(old->slots);
+  free(old);
+}
+
+/**
+ * @brief Finds the entry of a neighbour and its slot, or the slot it would
+ * be inserted in.
+ *
+ *
+ * Probes from the slot the key hashes to until the neighbour or a free slot
+ * is found, remembering the first deleted slot met on the way.
+ * Loads the entry of a slot before its key, so the key read is the one the
+ * entry was published with, and checks the key of the entry itself, as the
+ * slot may be reused meanwhile.
+ *
+ * @param[in] probed The table probed.
+ * @param[in] hardwareType The hardware type of the neighbour.
+ * @param[in] ip The IP address of the neighbour.
+ * @param[out] found The slot of the neighbour, or if it is not found the
+ * slot to insert it in, the first deleted slot met or else the free slot
+ * ending the probe.
+ * @return The entry of the neighbour, or NULL if it is not in the cache.
+ */
+
+static ArpCacheEntry *probe(ArpCacheTable *probed, uint16_t hardwareType, uint32_t ip, ArpCacheSlot **found) {
+  uint32_t index = hashArpKey(hardwareType, ip) & probed->mask;
+  ArpCacheSlot *reuse = NULL;
+
+  while (1) {
+    ArpCacheSlot *slot = &probed->slots[index];
+    ArpCacheEntry *entry = __atomic_load_n(&slot->entry, __ATOMIC_ACQUIRE);
+
+    if (entry == NULL) {
+      *found = reuse != NULL ? reuse : slot;
+      return NULL;
+    }
+
+    if (entry == SLOT_DELETED) {
+      if (reuse == NULL) {
+        reuse = slot;
+      }
+    }
+    else if (__atomic_load_n(&slot->ip, __ATOMIC_RELAXED) == ip &&
+             __atomic_load_n(&slot->hardwareType, __ATOMIC_RELAXED) == hardwareType &&
+             entry->sourceIp == ip && entry->hardwareType == hardwareType) {
+      *found = slot;
+      return entry;
+    }
+
+    index = (index + 1) & probed->mask;
+  }
+}
+
+/**
+ * @brief Publishes an entry in a slot.
+ *
+ *
+ * Stores the key first, and the entry last, so a reader loading the entry
+ * sees the key it is published with.
+ *
+ * @param[out] slot The slot.
+ * @param[in] entry The entry.
+ */
+
+static void publishSlot(ArpCacheSlot *slot, ArpCacheEntry *entry) {
+  __atomic_store_n(&slot->ip, entry->sourceIp, __ATOMIC_RELAXED);
+  __atomic_store_n(&slot->hardwareType, entry->hardwareType, __ATOMIC_RELAXED);
+  __atomic_store_n(&slot->entry, entry, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Rebuilds the cache with the number of slots provided.
+ *
+ *
+ * Reinserts the slot of every entry into a new table, dropping the deleted
+ * ones, then swaps the table, and retires the old one.
+ *
+ * @param[in] size The new number of slots, a power of two.
+ */
+
+static void resize(uint32_t size) {
+  ArpCacheTable *old = table;
+  ArpCacheTable *rebuilt = allocTable(size);
+
+  for (uint32_t index = 0; index <= old->mask; index++) {
+    ArpCacheSlot *insert;
+
+    if (old->slots[index].entry == NULL || old->slots[index].entry == SLOT_DELETED) {
+      continue;
+    }
+
+    probe(rebuilt, old->slots[index].hardwareType, old->slots[index].ip, &insert);
+    *insert = old->slots[index];
+  }
+
+  deleted = 0;
+  __atomic_store_n(&table, rebuilt, __ATOMIC_RELEASE);
+  retireEpoch(old, freeTable);
+}
+
+/**
+ * @brief Allocates the ARP cache with the number of slots provided.
+ *
+ *
+ * Called before any worker reads the cache.
+ * Prints the error and exits the process if the cache cannot be allocated.
+ *
+ * @param[in] size The number of slots, rounded up to a power of two.
+ */
+
+void initArpCache(uint32_t size) {
+  uint32_t rounded = 1;
+
+  while (rounded < size) {
+    rounded <<= 1;
+  }
+
+  if (table != NULL) {
+    freeTable(table);
+  }
+
+  table = allocTable(rounded);
+  count = 0;
+  deleted = 0;
+}
+
+/**
+ * @brief Looks up the entry of a neighbour, without any lock.
+ *
+ *
+ * Called by a registered epoch reader, or by a writer, the entry stays
+ * valid until the reader's next quiescent state.
+ *
+ * @param[in] hardwareType The hardware type of the neighbour.
+ * @param[in] ip The IP address of the neighbour.
+ * @return The entry, or NULL if the neighbour is not in the cache.
+ */
+
+ArpCacheEntry *lookupArpEntry(uint16_t hardwareType, uint32_t ip) {
+  ArpCacheSlot *slot;
+
+  return probe(__atomic_load_n(&table, __ATOMIC_ACQUIRE), hardwareType, ip, &slot);
+}
+
+/**
+ * @brief Reads the MAC address and the state of a neighbour at once.
+ *
+ * @param[in] entry The entry of the neighbour.
+ * @return The MAC address and the state of the neighbour.
+ */
+
+ArpNeighbour readArpNeighbour(ArpCacheEntry *entry) {
+  ArpNeighbour neighbour;
+
+  neighbour.word = __atomic_load_n(&entry->neighbour.word, __ATOMIC_ACQUIRE);
+
+  return neighbour;
+}
+
+/**
+ * @brief Publishes the MAC address and the state of a neighbour at once.
+ *
+ * @param[in, out] entry The entry of the neighbour.
+ * @param[in] mac The MAC address of the neighbour.
+ * @param[in] state The state of the entry.
+ */
+
+void writeArpNeighbour(ArpCacheEntry *entry, unsigned char *mac, uint16_t state) {
+  ArpNeighbour neighbour;
+
+  memcpy(neighbour.mac, mac, sizeof(neighbour.mac));
+  neighbour.state = state;
+
+  __atomic_store_n(&entry->neighbour.word, neighbour.word, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Updates the MAC address of a neighbour already in the cache.
+ *
+ * @param[in] hardwareType The hardware type of the neighbour.
+ * @param[in] ip The IP address of the neighbour.
+ * @param[in] mac The MAC address of the neighbour.
+ * @return The entry of the neighbour, or NULL if it was not in the cache.
+ */
+
+ArpCacheEntry *updateArpEntry(uint16_t hardwareType, uint32_t ip, unsigned char *mac) {
+  ArpCacheEntry *entry = lookupArpEntry(hardwareType, ip);
+
+  if (entry != NULL) {
+    writeArpNeighbour(entry, mac, entry->neighbour.state);
+  }
+
+  return entry;
+}
+
+/**
+ * @brief Inserts a neighbour in the cache, or updates its MAC address if it
+ * is already there.
+ *
+ *
+ * A new neighbour is inserted in the state provided, with its timer
+ * disarmed, and is published once its entry is complete.
+ * Resizes the cache first if the insertion would load it above
+ * ARP_CACHE_LOAD, doubling it unless most of the load comes from deleted
+ * entries.
+ * Prints the error and exits the process if the entry cannot be allocated.
+ *
+ * @param[in] hardwareType The hardware type of the neighbour.
+ * @param[in] ip The IP address of the neighbour.
+ * @param[in] mac The MAC address of the neighbour.
+ * @param[in] state The state of the entry of a new neighbour.
+ * @return The entry of the neighbour.
+ */
+
+ArpCacheEntry *insertArpEntry(uint16_t hardwareType, uint32_t ip, unsigned char *mac, uint16_t state) {
+  ArpCacheSlot *insert;
+  ArpCacheEntry *entry = probe(table, hardwareType, ip, &insert);
+
+  if (entry != NULL) {
+    writeArpNeighbour(entry, mac, entry->neighbour.state);
+    return entry;
+  }
+
+  entry = calloc(1, sizeof(ArpCacheEntry));
+
+  if (entry == NULL) {
+    printf("Could not allocate an ARP cache entry\n");
+    exit(1);
+  }
+
+  entry->sourceIp = ip;
+  entry->hardwareType = hardwareType;
+  writeArpNeighbour(entry, mac, state);
+
+  uint64_t size = (uint64_t) table->mask + 1;
+
+  if ((uint64_t) (count + deleted + 1) * 100 > size * ARP_CACHE_LOAD) {
+    resize(count + 1 > deleted ? size * 2 : size);
+    probe(table, hardwareType, ip, &insert);
+  }
+
+  if (insert->entry == SLOT_DELETED) {
+    deleted--;
+  }
+
+  publishSlot(insert, entry);
+  count++;
+
+  return entry;
+}
+
+/**
+ * @brief Removes the entry of a neighbour from the cache.
+ *
+ *
+ * Marks the slot as deleted rather than free, so the probes of the
+ * neighbours inserted after it still reach them.
+ * The entry is handed to the caller, who disarms its timer and retires it,
+ * as readers may still hold it.
+ *
+ * @param[in] hardwareType The hardware type of the neighbour.
+ * @param[in] ip The IP address of the neighbour.
+ * @return The entry removed, or NULL if the neighbour was not in the cache.
+ */
+
+ArpCacheEntry *deleteArpEntry(uint16_t hardwareType, uint32_t ip) {
+  ArpCacheSlot *slot;
+  ArpCacheEntry *entry = probe(table, hardwareType, ip, &slot);
+
+  if (entry == NULL) {
+    return NULL;
+  }
+
+  __atomic_store_n(&slot->entry, SLOT_DELETED, __ATOMIC_RELEASE);
+  count--;
+  deleted++;
+
+  return entry;
+}
+
+/**
+ * @brief Calls a function on every entry of the cache.
+ *
+ * @param[in] visit The function, called with every entry and the context.
+ * @param[in] context The context passed to the function.
+ */
+
+void walkArpCache(void (*visit)(ArpCacheEntry *, void *), void *context) {
+  for (uint32_t index = 0; index <= table->mask; index++) {
+    ArpCacheEntry *entry = table->slots[index].entry;
+
+    if (entry != NULL && entry != SLOT_DELETED) {
+      visit(entry, context);
+    }
+  }
+}
+
+/**
+ * @brief Returns the number of neighbours in the cache.
+ *
+ * @return The number of entries.
+ */
+
+uint32_t arpCacheCount() {
+  return count;
+}
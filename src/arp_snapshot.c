@@ -0,0 +1,177 @@
+/**
+ * @file arp_snapshot.c
+ * @author Aryan Chopra
+ * @brief Saves the neighbours of the ARP cache to a compact binary file,
+ * and maps it back when the process restarts.
+ *
+ * A snapshot is a fixed header followed by one packed record per
+ * neighbour, so it is mapped and walked in place, without parsing.
+ * Every record carries the wall-clock time its entry turns stale at, so the
+ * neighbours which were not confirmed recently enough before the restart
+ * are dropped, and the others stay reachable for the time they had left.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "arp_snapshot.h"
+
+/**
+ * @brief Returns the wall-clock time, in milliseconds since the epoch.
+ *
+ *
+ * Reads the wall clock rather than the monotonic one, as the snapshot
+ * outlives the process, and possibly the boot.
+ *
+ * @return The current time.
+ */
+
+uint64_t snapshotNow() {
+  struct timespec now;
+
+  clock_gettime(CLOCK_REALTIME, &now);
+
+  return (uint64_t) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/**
+ * @brief Saves records to a snapshot file.
+ *
+ *
+ * Writes the header and the records at once to a temporary file, which is
+ * renamed over the file provided, so a snapshot is never read half written.
+ * Prints the error if the snapshot cannot be written, the previous snapshot
+ * being left in place.
+ *
+ * @param[in] path The path of the snapshot file.
+ * @param[in] records The records.
+ * @param[in] count The number of records.
+ * @return 0 if the snapshot was saved, -1 otherwise.
+ */
+
+int saveArpSnapshot(char *path, ArpSnapshotRecord *records, uint32_t count) {
+  ArpSnapshotHeader header = {
+    .magic = ARP_SNAPSHOT_MAGIC,
+    .version = ARP_SNAPSHOT_VERSION,
+    .count = count,
+    .recordSize = sizeof(ArpSnapshotRecord),
+    .saved = snapshotNow(),
+  };
+  struct iovec parts[2] = {
+    {.iov_base = &header, .iov_len = sizeof(header)},
+    {.iov_base = records, .iov_len = (size_t) count * sizeof(ArpSnapshotRecord)},
+  };
+  size_t length = parts[0].iov_len + parts[1].iov_len;
+  char *temporary = malloc(strlen(path) + 5);
+
+  if (temporary == NULL) {
+    printf("Could not save the ARP snapshot\n");
+    return -1;
+  }
+
+  sprintf(temporary, "%s.tmp", path);
+
+  int descriptor = open(temporary, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+  if (descriptor < 0 || writev(descriptor, parts, 2) != (ssize_t) length) {
+    perror("Could not save the ARP snapshot");
+
+    if (descriptor >= 0) {
+      close(descriptor);
+      unlink(temporary);
+    }
+
+    free(temporary);
+    return -1;
+  }
+
+  close(descriptor);
+
+  if (rename(temporary, path) < 0) {
+    perror("Could not save the ARP snapshot");
+    unlink(temporary);
+    free(temporary);
+    return -1;
+  }
+
+  free(temporary);
+  return 0;
+}
+
+/**
+ * @brief Maps a snapshot file, and hands every record which has not expired
+ * to the function provided.
+ *
+ *
+ * Checks the magic, the version, the size of the records and the length of
+ * the file before reading any record.
+ * Does nothing if the file does not exist.
+ * Prints the error and ignores the file if it is not a valid snapshot.
+ *
+ * @param[in] path The path of the snapshot file.
+ * @param[in] restore The function restoring a record, called with the
+ * record, the current wall-clock time, and the context.
+ * @param[in] context The context passed to the function.
+ * @return The number of records restored.
+ */
+
+int loadArpSnapshot(char *path, void (*restore)(ArpSnapshotRecord *, uint64_t, void *), void *context) {
+  int descriptor = open(path, O_RDONLY);
+  struct stat status;
+
+  if (descriptor < 0) {
+    if (errno != ENOENT) {
+      perror("Could not open the ARP snapshot");
+    }
+
+    return 0;
+  }
+
+  if (fstat(descriptor, &status) < 0 || status.st_size < (off_t) sizeof(ArpSnapshotHeader)) {
+    printf("Ignoring the invalid ARP snapshot %s\n", path);
+    close(descriptor);
+    return 0;
+  }
+
+  char *mapping = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+
+  close(descriptor);
+
+  if (mapping == MAP_FAILED) {
+    perror("Could not map the ARP snapshot");
+    return 0;
+  }
+
+  ArpSnapshotHeader *header = (ArpSnapshotHeader *) mapping;
+  ArpSnapshotRecord *records = (ArpSnapshotRecord *) (mapping + sizeof(ArpSnapshotHeader));
+  uint64_t now = snapshotNow();
+  int restored = 0;
+
+  if (header->magic != ARP_SNAPSHOT_MAGIC || header->version != ARP_SNAPSHOT_VERSION ||
+      header->recordSize != sizeof(ArpSnapshotRecord) ||
+      (uint64_t) status.st_size != sizeof(ArpSnapshotHeader) + (uint64_t) header->count * sizeof(ArpSnapshotRecord)) {
+    printf("Ignoring the invalid ARP snapshot %s\n", path);
+    munmap(mapping, status.st_size);
+    return 0;
+  }
+
+  for (uint32_t index = 0; index < header->count; index++) {
+    if (records[index].expires <= now) {
+      continue;
+    }
+
+    restore(&records[index], now, context);
+    restored++;
+  }
+
+  munmap(mapping, status.st_size);
+  return restored;
+}
@@ -0,0 +1,471 @@
+/**
+ * @file checksum.c
+ * @author Aryan Chopra
+ * @brief Computes the Internet checksum with the widest instructions the
+ * processor supports.
+ *
+ * The ones' complement sum does not depend on the order the 16-bit words are
+ * added in, nor on how many carries are left unfolded until the end, so the
+ * words are widened and added in bulk, SSE2, AVX2 or AVX-512 registers adding
+ * 8, 16 or 32 of them at once, and the scalar routine adding four at a time
+ * in a 64-bit register.
+ * The routine is selected once, at startup, and every routine is checked
+ * against the reference routine, adding one word at a time, before it is
+ * used.
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CHECKSUM_SIMD
+#endif
+
+#include "checksum.h"
+
+#define CHECKSUM_BLOCKS 16384 ///Vectors added into 32-bit lanes before the lanes are spilled, so no lane overflows.
+#define CHECKSUM_CHECK_LEN 65536 ///Length of the bytes the routines are checked on at startup.
+
+/**
+ * @brief A routine returning the ones' complement sum of bytes, with its
+ * carries unfolded.
+ */
+
+typedef uint64_t (*SumRoutine)(const unsigned char *, size_t);
+
+/**
+ * @struct ChecksumRoutine
+ * @brief A struct naming a routine computing the sums.
+ *
+ * @var ChecksumRoutine::name
+ * The name of the routine.
+ *
+ * @var ChecksumRoutine::sum
+ * The routine.
+ *
+ * @var ChecksumRoutine::supported
+ * Whether the processor supports the instructions of the routine.
+ */
+
+typedef struct {
+  const char *name;
+  SumRoutine sum;
+  int supported;
+} ChecksumRoutine;
+
+/**
+ * @brief Returns the value a trailing odd byte adds to the sum, the byte
+ * being the first one of a word padded with zero.
+ *
+ * @param[in] byte The byte.
+ * @return The value added to the sum.
+ */
+
+static uint64_t trailingByte(unsigned char byte) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  return (uint64_t) byte << 8;
+#else
+  return byte;
+#endif
+}
+
+/**
+ * @brief Adds the bytes provided one 16-bit word at a time.
+ *
+ *
+ * The reference the other routines are checked against.
+ *
+ * @param[in] data The bytes.
+ * @param[in] length The number of bytes.
+ * @return The sum, with its carries unfolded.
+ */
+
+static uint64_t sumReference(const unsigned char *data, size_t length) {
+  uint64_t sum = 0;
+  uint16_t word;
+
+  while (length > 1) {
+    memcpy(&word, data, 2);
+    sum += word;
+    data += 2;
+    length -= 2;
+  }
+
+  if (length > 0) {
+    sum += trailingByte(*data);
+  }
+
+  return sum;
+}
+
+/**
+ * @brief Adds the bytes provided 8 bytes at a time, in a 64-bit register.
+ *
+ *
+ * Adds the two 32-bit halves of every 8 bytes, so the sum cannot overflow,
+ * and keeps four sums to hide the latency of the additions.
+ *
+ * @param[in] data The bytes.
+ * @param[in] length The number of bytes.
+ * @return The sum, with its carries unfolded.
+ */
+
+static uint64_t sumScalar(const unsigned char *data, size_t length) {
+  uint64_t sums[4] = {0, 0, 0, 0};
+  uint64_t words[4];
+  uint32_t word;
+  uint16_t half;
+
+  while (length >= 32) {
+    memcpy(words, data, 32);
+
+    for (int index = 0; index < 4; index++) {
+      sums[index] += (words[index] & 0xffffffff) + (words[index] >> 32);
+    }
+
+    data += 32;
+    length -= 32;
+  }
+
+  uint64_t sum = sums[0] + sums[1] + sums[2] + sums[3];
+
+  while (length >= 4) {
+    memcpy(&word, data, 4);
+    sum += word;
+    data += 4;
+    length -= 4;
+  }
+
+  if (length >= 2) {
+    memcpy(&half, data, 2);
+    sum += half;
+    data += 2;
+    length -= 2;
+  }
+
+  if (length > 0) {
+    sum += trailingByte(*data);
+  }
+
+  return sum;
+}
+
+#ifdef CHECKSUM_SIMD
+
+/**
+ * @brief Adds the bytes provided 16 at a time, in SSE2 registers.
+ *
+ *
+ * Widens the 16-bit words to 32-bit lanes, spilling the lanes to a 64-bit
+ * sum every CHECKSUM_BLOCKS vectors.
+ * The remaining bytes are added by the scalar routine.
+ *
+ * @param[in] data The bytes.
+ * @param[in] length The number of bytes.
+ * @return The sum, with its carries unfolded.
+ */
+
+__attribute__((target("sse2")))
+static uint64_t sumSse2(const unsigned char *data, size_t length) {
+  const __m128i zero = _mm_setzero_si128();
+  uint32_t lanes[4];
+  uint64_t sum = 0;
+
+  while (length >= 16) {
+    size_t blocks = length / 16 < CHECKSUM_BLOCKS ? length / 16 : CHECKSUM_BLOCKS;
+    __m128i low = zero;
+    __m128i high = zero;
+
+    for (size_t block = 0; block < blocks; block++) {
+      __m128i words = _mm_loadu_si128((const __m128i *) data);
+
+      low = _mm_add_epi32(low, _mm_unpacklo_epi16(words, zero));
+      high = _mm_add_epi32(high, _mm_unpackhi_epi16(words, zero));
+      data += 16;
+    }
+
+    _mm_storeu_si128((__m128i *) lanes, low);
+
+    for (int lane = 0; lane < 4; lane++) {
+      sum += lanes[lane];
+    }
+
+    _mm_storeu_si128((__m128i *) lanes, high);
+
+    for (int lane = 0; lane < 4; lane++) {
+      sum += lanes[lane];
+    }
+
+    length -= blocks * 16;
+  }
+
+  return sum + sumScalar(data, length);
+}
+
+/**
+ * @brief Adds the bytes provided 32 at a time, in AVX2 registers.
+ *
+ *
+ * Widens the 16-bit words to 32-bit lanes, spilling the lanes to a 64-bit
+ * sum every CHECKSUM_BLOCKS vectors.
+ * The remaining bytes are added by the scalar routine.
+ *
+ * @param[in] data The bytes.
+ * @param[in] length The number of bytes.
+ * @return The sum, with its carries unfolded.
+ */
+
+__attribute__((target("avx2")))
+static uint64_t sumAvx2(const unsigned char *data, size_t length) {
+  const __m256i zero = _mm256_setzero_si256();
+  uint32_t lanes[8];
+  uint64_t sum = 0;
+
+  while (length >= 32) {
+    size_t blocks = length / 32 < CHECKSUM_BLOCKS ? length / 32 : CHECKSUM_BLOCKS;
+    __m256i low = zero;
+    __m256i high = zero;
+
+    for (size_t block = 0; block < blocks; block++) {
+      __m256i words = _mm256_loadu_si256((const __m256i *) data);
+
+      low = _mm256_add_epi32(low, _mm256_unpacklo_epi16(words, zero));
+      high = _mm256_add_epi32(high, _mm256_unpackhi_epi16(words, zero));
+      data += 32;
+    }
+
+    _mm256_storeu_si256((__m256i *) lanes, _mm256_add_epi32(low, high));
+
+    for (int lane = 0; lane < 8; lane++) {
+      sum += lanes[lane];
+    }
+
+    length -= blocks * 32;
+  }
+
+  return sum + sumScalar(data, length);
+}
+
+/**
+ * @brief Adds the bytes provided 64 at a time, in AVX-512 registers.
+ *
+ *
+ * Widens the 16-bit words to 32-bit lanes, spilling the lanes to a 64-bit
+ * sum every CHECKSUM_BLOCKS vectors.
+ * The remaining bytes are added by the scalar routine.
+ *
+ * @param[in] data The bytes.
+ * @param[in] length The number of bytes.
+ * @return The sum, with its carries unfolded.
+ */
+
+__attribute__((target("avx512f")))
+static uint64_t sumAvx512(const unsigned char *data, size_t length) {
+  const __m512i zero = _mm512_setzero_si512();
+  uint32_t lanes[16];
+  uint64_t sum = 0;
+
+  while (length >= 64) {
+    size_t blocks = length / 64 < CHECKSUM_BLOCKS ? length / 64 : CHECKSUM_BLOCKS;
+    __m512i low = zero;
+    __m512i high = zero;
+
+    for (size_t block = 0; block < blocks; block++) {
+      __m512i words = _mm512_loadu_si512((const void *) data);
+
+      low = _mm512_add_epi32(low, _mm512_cvtepu16_epi32(_mm512_castsi512_si256(words)));
+      high = _mm512_add_epi32(high, _mm512_cvtepu16_epi32(_mm512_extracti64x4_epi64(words, 1)));
+      data += 64;
+    }
+
+    _mm512_storeu_si512((void *) lanes, _mm512_add_epi32(low, high));
+
+    for (int lane = 0; lane < 16; lane++) {
+      sum += lanes[lane];
+    }
+
+    length -= blocks * 64;
+  }
+
+  return sum + sumScalar(data, length);
+}
+
+#endif
+
+/**
+ * The routines, from the widest one, and the routine selected.
+ */
+
+static ChecksumRoutine routines[] = {
+#ifdef CHECKSUM_SIMD
+  {"avx512", sumAvx512, 0},
+  {"avx2", sumAvx2, 0},
+  {"sse2", sumSse2, 0},
+#endif
+  {"scalar", sumScalar, 1},
+};
+
+static ChecksumRoutine *selected = &routines[sizeof(routines) / sizeof(routines[0]) - 1];
+
+/**
+ * @brief Folds the carries of a sum into its 16 bits.
+ *
+ * @param[in] sum The sum.
+ * @return The folded sum.
+ */
+
+static uint16_t foldSum(uint64_t sum) {
+  while (sum >> 16) {
+    sum = (sum & 0xffff) + (sum >> 16);
+  }
+
+  return sum;
+}
+
+/**
+ * @brief Checks a routine against the reference routine.
+ *
+ *
+ * Compares the sums of every length up to 2048 bytes, at every alignment
+ * modulo 4, and of lengths up to CHECKSUM_CHECK_LEN, on random bytes and on
+ * bytes all set, which carry the most.
+ *
+ * @param[in] routine The routine.
+ * @param[in] data A buffer of CHECKSUM_CHECK_LEN + 4 bytes.
+ * @return 1 if the routine agrees with the reference, 0 otherwise.
+ */
+
+static int checkRoutine(ChecksumRoutine *routine, unsigned char *data) {
+  static const size_t lengths[] = {4095, 4096, 16383, 32769, 65535, CHECKSUM_CHECK_LEN};
+  uint32_t seed = 0x2545f491;
+
+  for (int pattern = 0; pattern < 2; pattern++) {
+    for (size_t index = 0; index < CHECKSUM_CHECK_LEN + 4; index++) {
+      seed = seed * 1103515245 + 12345;
+      data[index] = pattern == 0 ? seed >> 24 : 0xff;
+    }
+
+    for (size_t offset = 0; offset < 4; offset++) {
+      for (size_t length = 0; length <= 2048; length++) {
+        if (foldSum(routine->sum(data + offset, length)) != foldSum(sumReference(data + offset, length))) {
+          return 0;
+        }
+      }
+
+      for (size_t index = 0; index < sizeof(lengths) / sizeof(lengths[0]); index++) {
+        if (foldSum(routine->sum(data + offset, lengths[index])) != foldSum(sumReference(data + offset, lengths[index]))) {
+          return 0;
+        }
+      }
+    }
+  }
+
+  return 1;
+}
+
+/**
+ * @brief Selects the routine computing the checksums, from the instructions
+ * the processor supports.
+ *
+ *
+ * Uses the widest routine the processor supports and which agrees with the
+ * reference routine, printing the routines skipped for disagreeing.
+ * Called once, before the workers are started; until then the checksums are
+ * computed by the scalar routine.
+ */
+
+void initChecksum() {
+  static unsigned char data[CHECKSUM_CHECK_LEN + 4];
+
+#ifdef CHECKSUM_SIMD
+  __builtin_cpu_init();
+  routines[0].supported = __builtin_cpu_supports("avx512f");
+  routines[1].supported = __builtin_cpu_supports("avx2");
+  routines[2].supported = __builtin_cpu_supports("sse2");
+#endif
+
+  for (size_t index = 0; index < sizeof(routines) / sizeof(routines[0]); index++) {
+    if (!routines[index].supported) {
+      continue;
+    }
+
+    if (!checkRoutine(&routines[index], data)) {
+      printf("The %s checksum disagrees with the reference, skipping it\n", routines[index].name);
+      continue;
+    }
+
+    selected = &routines[index];
+    break;
+  }
+
+  printf("Computing checksums with %s\n", selected->name);
+}
+
+/**
+ * @brief Returns the name of the routine computing the checksums.
+ *
+ * @return The name of the routine.
+ */
+
+const char *checksumRoutine() {
+  return selected->name;
+}
+
+/**
+ * @brief Computes the Internet checksum of the bytes provided.
+ *
+ *
+ * A trailing odd byte is added as the first byte of a word padded with
+ * zero.
+ *
+ * @param[in] address The bytes on which the checksum is to be computed.
+ * @param[in] count The number of bytes.
+ * @return Checksum computed, in the byte order of the bytes.
+ */
+
+uint16_t checksum(void *address, int count) {
+  return ~foldSum(selected->sum(address, count));
+}
+
+/**
+ * @brief Updates a checksum for a 16-bit word of the bytes it covers being
+ * rewritten, without summing the bytes again, as per RFC 1624.
+ *
+ *
+ * Computes ~(~checksum + ~old + new), which, unlike subtracting the old word
+ * from the checksum, never turns a sum of 0 into the negative zero 0xffff.
+ * The words are used as stored in the bytes, the ones' complement sum not
+ * depending on the byte order.
+ *
+ * @param[in] check The checksum, as stored in the bytes.
+ * @param[in] old The word before it was rewritten.
+ * @param[in] new The word after it was rewritten.
+ * @return The updated checksum.
+ */
+
+uint16_t updateChecksum(uint16_t check, uint16_t old, uint16_t new) {
+  uint64_t sum = (uint16_t) ~check + (uint16_t) ~old + new;
+
+  return ~foldSum(sum);
+}
+
+/**
+ * @brief Updates a checksum for a 32-bit field of the bytes it covers being
+ * rewritten, such as an IP address, as per RFC 1624.
+ *
+ *
+ * Updates the checksum for both 16-bit halves of the field at once.
+ *
+ * @param[in] check The checksum, as stored in the bytes.
+ * @param[in] old The field before it was rewritten.
+ * @param[in] new The field after it was rewritten.
+ * @return The updated checksum.
+ */
+
+uint16_t updateChecksum32(uint16_t check, uint32_t old, uint32_t new) {
+  uint64_t sum = (uint16_t) ~check + (uint64_t) (~old >> 16) + (~old & 0xffff) + (new >> 16) + (new & 0xffff);
+
+  return ~foldSum(sum);
+}
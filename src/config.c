@@ -0,0 +1,221 @@
+/**
+ * @file config.c
+ * @author Aryan Chopra
+ * @brief Parses the command line arguments into the runtime configuration.
+ *
+ * Supported options:
+ * -q <queues> Opens the TAP device with the given number of queues.
+ * -b <batch> Drains up to the given number of frames per wakeup.
+ * -u <reads> Receives and transmits through io_uring, with the given number
+ * of reads posted per queue.
+ * -p <interface> Receives the frames of an existing interface through a
+ * TPACKET_V3 ring instead of the TAP device.
+ * -x <interface> Receives and transmits the frames of an existing interface
+ * through AF_XDP sockets instead of the TAP device.
+ * -a <rate> Handles up to the given number of ARP packets per second from
+ * every sender, 0 for no limit.
+ * -i <rate> Answers up to the given number of ICMP requests per second from
+ * every source, 0 for no limit.
+ * -l <prefix> Answers for the given address or prefix too, can be repeated.
+ * -L <file> Answers for every address or prefix listed in the given file.
+ * -s <file> Restores the ARP cache from the given snapshot file, and saves
+ * it there periodically.
+ * -f <fragments> Holds up to the given number of fragments while their
+ * datagrams are reassembled, 0 to drop every fragment.
+ * -m <mtu> Fragments the IP packets larger than the given MTU.
+ * -r <file> Adds every route listed in the given file to the forwarding
+ * table.
+ * -d <devices> Opens the given number of TAP devices and forwards between
+ * them.
+ * -w <workers> Spreads the frames of the TAP queue over the given number of
+ * worker threads by the hash of their flow.
+ * -t <batch> With -w, writes the replies from a transmit thread, popping up
+ * to the given number of frames per worker and wakeup.
+ * -y <usecs> Busy polls the TAP queues for the given number of microseconds
+ * after traffic before sleeping, 0 to always sleep.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "netdev.h"
+
+/**
+ * @brief Prints the supported options and exits the process.
+ *
+ * @param[in] program The name the process was started with.
+ */
+
+static void usage(char *program) {
+  printf("Usage: %s [-q queues] [-b batch] [-u reads] [-p interface] [-x interface] [-a rate] [-i rate] [-l prefix]... [-L file] [-s file] [-f fragments] [-m mtu] [-r file] [-d devices] [-w workers] [-t batch] [-y usecs]\n", program);
+  printf("  -q queues   Number of TAP queues, one worker thread per queue (1 - %d)\n", MAX_QUEUES);
+  printf("  -b batch    Frames drained per wakeup, replies flushed together (1 - %d)\n", MAX_BATCH);
+  printf("  -u reads    Use io_uring with the given number of fixed-buffer reads posted per queue (1 - %d)\n", MAX_URING_READS);
+  printf("  -p iface    Attach to an existing interface through a TPACKET_V3 ring instead of tap0\n");
+  printf("  -x iface    Attach to an existing interface through AF_XDP sockets in copy mode instead of tap0\n");
+  printf("  -a rate     ARP packets handled per second from every sender, 0 for no limit (default %d)\n", DEFAULT_ARP_RATE);
+  printf("  -i rate     ICMP requests answered per second from every source, 0 for no limit (default %d)\n", DEFAULT_ICMP_RATE);
+  printf("  -l prefix   Answer ARP and ICMP for the given address or prefix too, eg. 10.1.0.0/16, can be repeated\n");
+  printf("  -L file     Answer ARP and ICMP for every address or prefix listed in the file, one per line\n");
+  printf("  -s file     Restore the ARP cache from the snapshot file at startup, and save it there periodically\n");
+  printf("  -f count    Fragments held while their datagrams are reassembled, 0 to drop every fragment (default %d, max %d)\n", DEFAULT_FRAGMENTS, MAX_FRAGMENTS);
+  printf("  -m mtu      Largest IP packet sent in one frame, larger ones are fragmented (%d - %d, default %d)\n", MIN_MTU, MAX_MTU, NETDEV_MTU);
+  printf("  -r file     Add every route listed in the file to the forwarding table, one \"prefix [gateway [device]]\" per line\n");
+  printf("  -d devices  Open that many TAP devices, tapN answering as 10.0.N.4, and forward between them (1 - %d)\n", MAX_DEVICES);
+  printf("  -w workers  Spread the frames of the single TAP queue over worker threads by flow hash (1 - %d)\n", MAX_QUEUES);
+  printf("  -t batch    With -w, write the replies from a transmit thread, up to batch frames per worker and wakeup (1 - %d)\n", MAX_BATCH);
+  printf("  -y usecs    Busy poll the TAP queues for that long after traffic before sleeping, 0 to always sleep (max %d)\n", MAX_BUSY_POLL);
+  exit(1);
+}
+
+/**
+ * @brief Parses an integer option, bounded by the minimum and maximum provided.
+ *
+ * @param[in] program The name the process was started with, used for the usage.
+ * @param[in] value The value of the option in decimal notation.
+ * @param[in] min The minimum value allowed for the option.
+ * @param[in] max The maximum value allowed for the option.
+ * @return The parsed value.
+ */
+
+static int parseCount(char *program, char *value, int min, int max) {
+  char *end;
+  long count = strtol(value, &end, 10);
+
+  if (end == value || *end != '\0' || count < min || count > max) {
+    printf("Invalid value: %s\n", value);
+    usage(program);
+  }
+
+  return (int) count;
+}
+
+/**
+ * @brief Fills the configuration from the command line arguments.
+ *
+ *
+ * Sets every field to its default value.
+ * Parses the options provided on the command line and overrides the
+ * corresponding fields.
+ * Prints the usage and exits the process on an unknown option or an
+ * invalid value.
+ * The local prefixes are only parsed once the network device is
+ * initialized.
+ *
+ * @param[out] config The configuration to be filled.
+ * @param[in] argc The number of command line arguments.
+ * @param[in] argv The command line arguments.
+ */
+
+void parseConfig(Config *config, int argc, char **argv) {
+  int option;
+
+  config->queues = DEFAULT_QUEUES;
+  config->batch = DEFAULT_BATCH;
+  config->uringReads = 0;
+  config->packetInterface = NULL;
+  config->xdpInterface = NULL;
+  config->arpRate = DEFAULT_ARP_RATE;
+  config->icmpRate = DEFAULT_ICMP_RATE;
+  config->localPrefixes = calloc(argc, sizeof(char *));
+  config->localPrefixCount = 0;
+  config->localFile = NULL;
+  config->arpSnapshot = NULL;
+  config->fragments = DEFAULT_FRAGMENTS;
+  config->mtu = NETDEV_MTU;
+  config->routeFile = NULL;
+  config->devices = 1;
+  config->rssWorkers = 0;
+  config->txBatch = 0;
+  config->busyPoll = 0;
+
+  if (config->localPrefixes == NULL) {
+    printf("Could not allocate the configuration\n");
+    exit(1);
+  }
+
+  while ((option = getopt(argc, argv, "q:b:u:p:x:a:i:l:L:s:f:m:r:d:w:t:y:")) != -1) {
+    switch (option) {
+      case 'q':
+        config->queues = parseCount(argv[0], optarg, 1, MAX_QUEUES);
+        break;
+      case 'b':
+        config->batch = parseCount(argv[0], optarg, 1, MAX_BATCH);
+        break;
+      case 'u':
+        config->uringReads = parseCount(argv[0], optarg, 1, MAX_URING_READS);
+        break;
+      case 'p':
+        config->packetInterface = optarg;
+        break;
+      case 'x':
+        config->xdpInterface = optarg;
+        break;
+      case 'a':
+        config->arpRate = parseCount(argv[0], optarg, 0, MAX_RATE);
+        break;
+      case 'i':
+        config->icmpRate = parseCount(argv[0], optarg, 0, MAX_RATE);
+        break;
+      case 'l':
+        config->localPrefixes[config->localPrefixCount++] = optarg;
+        break;
+      case 'L':
+        config->localFile = optarg;
+        break;
+      case 's':
+        config->arpSnapshot = optarg;
+        break;
+      case 'f':
+        config->fragments = parseCount(argv[0], optarg, 0, MAX_FRAGMENTS);
+        break;
+      case 'm':
+        config->mtu = parseCount(argv[0], optarg, MIN_MTU, MAX_MTU);
+        break;
+      case 'r':
+        config->routeFile = optarg;
+        break;
+      case 'd':
+        config->devices = parseCount(argv[0], optarg, 1, MAX_DEVICES);
+        break;
+      case 'w':
+        config->rssWorkers = parseCount(argv[0], optarg, 1, MAX_QUEUES);
+        break;
+      case 't':
+        config->txBatch = parseCount(argv[0], optarg, 1, MAX_BATCH);
+        break;
+      case 'y':
+        config->busyPoll = parseCount(argv[0], optarg, 0, MAX_BUSY_POLL);
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+
+  if ((config->packetInterface != NULL || config->xdpInterface != NULL) && config->uringReads > 0) {
+    printf("io_uring is only supported on the TAP device\n");
+    usage(argv[0]);
+  }
+
+  if (config->packetInterface != NULL && config->xdpInterface != NULL) {
+    printf("Only one of -p and -x can be used\n");
+    usage(argv[0]);
+  }
+
+  if (config->devices > 1 && (config->packetInterface != NULL || config->xdpInterface != NULL || config->uringReads > 0)) {
+    printf("Forwarding between several devices is only supported on TAP devices, without io_uring\n");
+    usage(argv[0]);
+  }
+
+  if (config->rssWorkers > 0 && (config->queues > 1 || config->devices > 1 || config->packetInterface != NULL || config->xdpInterface != NULL || config->uringReads > 0)) {
+    printf("Flow hash dispatch is only supported on a single TAP queue, without io_uring\n");
+    usage(argv[0]);
+  }
+
+  if (config->txBatch > 0 && config->rssWorkers == 0) {
+    printf("A transmit thread is only supported with flow hash dispatch, -w\n");
+    usage(argv[0]);
+  }
+}
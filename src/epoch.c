@@ -0,0 +1,214 @@
+/**
+ * @file epoch.c
+ * @author Aryan Chopra
+ * @brief Epoch-based reclamation of the memory unlinked from the shared
+ * tables, so the workers read them without any lock.
+ *
+ * A writer never frees what it unlinks from a table, it retires it, tagged
+ * with a new epoch.
+ * A reader reads the tables freely, and announces a quiescent state between
+ * two iterations of its loop, recording the epoch it has seen, as it holds
+ * no pointer into the tables at that point.
+ * Memory retired at an epoch is released once every reader has recorded
+ * that epoch or a later one, as none of them can still be reading it.
+ * A reader only ever stores its own epoch, in its own cache line, so
+ * reading stays wait-free whatever the writers do.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "epoch.h"
+
+/**
+ * @struct EpochReader
+ * @brief A struct holding the epoch last seen by a reader, in a cache line
+ * of its own.
+ *
+ * @var EpochReader::epoch
+ * The epoch the reader had seen when it last announced a quiescent state,
+ * 0 before it first did.
+ */
+
+typedef struct {
+  uint64_t epoch;
+} __attribute__((aligned(64))) EpochReader;
+
+/**
+ * @struct EpochRetired
+ * @brief A struct holding memory retired, waiting for the readers to move
+ * past its epoch.
+ *
+ * @var EpochRetired::next
+ * Next memory retired.
+ *
+ * @var EpochRetired::epoch
+ * The epoch the memory was retired at.
+ *
+ * @var EpochRetired::memory
+ * The memory retired.
+ *
+ * @var EpochRetired::release
+ * The function releasing the memory.
+ */
+
+typedef struct EpochRetired {
+  struct EpochRetired *next;
+  uint64_t epoch;
+  void *memory;
+  void (*release)(void *);
+} EpochRetired;
+
+/**
+ * The current epoch, and the readers registered.
+ */
+
+static uint64_t globalEpoch = 1;
+static EpochReader readers[EPOCH_READERS];
+static int readerCount;
+
+/**
+ * The reader of the calling thread, NULL if it is not registered.
+ */
+
+static __thread EpochReader *reader;
+
+/**
+ * The memory retired, and the lock guarding it.
+ */
+
+static EpochRetired *retired;
+static int retiredCount;
+static pthread_mutex_t retiredLock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Registers the calling thread as a reader of the shared tables.
+ *
+ *
+ * Until it is registered, the memory a thread reads can be reclaimed under
+ * it.
+ * Prints the error and exits the process if EPOCH_READERS threads are
+ * registered already.
+ */
+
+void registerEpochReader() {
+  int index = __atomic_fetch_add(&readerCount, 1, __ATOMIC_SEQ_CST);
+
+  if (index >= EPOCH_READERS) {
+    printf("Could not register more than %d epoch readers\n", EPOCH_READERS);
+    exit(1);
+  }
+
+  reader = &readers[index];
+  quiescentEpoch();
+}
+
+/**
+ * @brief Announces that the calling thread holds no pointer into the shared
+ * tables.
+ *
+ *
+ * Records the current epoch as the one the reader has seen.
+ * The store releases every read the reader made before, and the load of the
+ * epoch makes the reader see every pointer unlinked before it was advanced.
+ */
+
+void quiescentEpoch() {
+  if (reader == NULL) {
+    return;
+  }
+
+  __atomic_store_n(&reader->epoch, __atomic_load_n(&globalEpoch, __ATOMIC_SEQ_CST), __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Retires memory unlinked from a shared table, which the readers may
+ * still be reading.
+ *
+ *
+ * Advances the epoch, and tags the memory with the new one, so it is
+ * released once every reader has seen it.
+ * The writer unlinks the memory before retiring it.
+ * Prints the error and exits the process if the memory cannot be tracked.
+ *
+ * @param[in] memory The memory retired.
+ * @param[in] release The function releasing the memory.
+ */
+
+void retireEpoch(void *memory, void (*release)(void *)) {
+  EpochRetired *item = malloc(sizeof(EpochRetired));
+
+  if (item == NULL) {
+    printf("Could not retire memory\n");
+    exit(1);
+  }
+
+  item->memory = memory;
+  item->release = release;
+  item->epoch = __atomic_add_fetch(&globalEpoch, 1, __ATOMIC_SEQ_CST);
+
+  pthread_mutex_lock(&retiredLock);
+  item->next = retired;
+  retired = item;
+  __atomic_store_n(&retiredCount, retiredCount + 1, __ATOMIC_RELAXED);
+  pthread_mutex_unlock(&retiredLock);
+}
+
+/**
+ * @brief Releases the memory retired which no reader can still be reading.
+ *
+ *
+ * Finds the oldest epoch seen by the readers, and releases the memory
+ * retired at that epoch or before, outside the lock.
+ * Returns right away if no memory is retired, or if another thread is
+ * releasing it already, so the readers can call it on every iteration.
+ */
+
+void reclaimEpoch() {
+  if (__atomic_load_n(&retiredCount, __ATOMIC_RELAXED) == 0) {
+    return;
+  }
+
+  if (pthread_mutex_trylock(&retiredLock) != 0) {
+    return;
+  }
+
+  int count = __atomic_load_n(&readerCount, __ATOMIC_ACQUIRE);
+  uint64_t oldest = UINT64_MAX;
+
+  for (int index = 0; index < count && index < EPOCH_READERS; index++) {
+    uint64_t epoch = __atomic_load_n(&readers[index].epoch, __ATOMIC_ACQUIRE);
+
+    if (epoch < oldest) {
+      oldest = epoch;
+    }
+  }
+
+  EpochRetired *released = NULL;
+  EpochRetired **link = &retired;
+
+  while (*link != NULL) {
+    EpochRetired *item = *link;
+
+    if (item->epoch > oldest) {
+      link = &item->next;
+      continue;
+    }
+
+    *link = item->next;
+    item->next = released;
+    released = item;
+    __atomic_store_n(&retiredCount, retiredCount - 1, __ATOMIC_RELAXED);
+  }
+
+  pthread_mutex_unlock(&retiredLock);
+
+  while (released != NULL) {
+    EpochRetired *item = released;
+
+    released = item->next;
+    item->release(item->memory);
+    free(item);
+  }
+}
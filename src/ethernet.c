@@ -4,8 +4,6 @@
  * @brief Converts the incoming buffer to an Ethernet Header.
  */
 
-#include <arpa/inet.h>
-
 #include "ethernet.h"
 
 /**
@@ -13,6 +11,8 @@
  * marked and named with appropriate name and size.
  *
  *
+ * The frame is left as received, the payload type stays in network order.
+ *
  * @param[in] buffer An incoming Ethernet Packet from the network.
  * @return header A struct which has various fields of the Ethernet Header
  * marked 
@@ -22,10 +22,6 @@
  */
 
 EthernetHeader* initializeEthernet(char *buffer) {
-	EthernetHeader* header = (EthernetHeader *) buffer;
-	
-	header->payloadType = htons(header->payloadType);
-
-	return header;
+	return (EthernetHeader *) buffer;
 }
 
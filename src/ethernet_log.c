@@ -4,6 +4,7 @@
  * @brief Logs the ethernet packet in a log file.
  */
 
+#include <arpa/inet.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <inttypes.h>
@@ -111,7 +112,7 @@ void logEthernetHeader(EthernetHeader *ethHeader, uint8_t incoming) {
   writeEthLog(text);
   logMacAddress(ethHeader->sourceMac);
 
-  snprintf(text, SIZE, "Payload type             : %"PRIu16"\n", ethHeader->payloadType);
+  snprintf(text, SIZE, "Payload type             : %"PRIu16"\n", ntohs(ethHeader->payloadType));
   writeEthLog(text);
 
   snprintf(text, SIZE, "\n-------------------------------------------------\n\n");
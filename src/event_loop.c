@@ -0,0 +1,168 @@
+/**
+ * @file event_loop.c
+ * @author Aryan Chopra
+ * @brief Waits for the queues of a worker and for its timers, busy polling
+ * for a while after traffic and sleeping in epoll otherwise.
+ *
+ * A sleeping thread takes tens of microseconds to be woken up and
+ * scheduled again, which dominates the latency of an echo on an otherwise
+ * idle stack.
+ * Busy polling for a budget after every burst of traffic keeps the worker
+ * on its core while more frames are likely to come, and falling back to
+ * epoll once the budget is spent keeps an idle worker from burning a core
+ * of a shared host.
+ * Either way, the worker wakes up when its next protocol timer is due,
+ * rather than once every tick.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "event_loop.h"
+#include "timer.h"
+
+/**
+ * @brief Returns the time of the monotonic clock, in nanoseconds.
+ *
+ * @return The time.
+ */
+
+static uint64_t nanoseconds() {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/**
+ * @brief Creates the epoll instance of an event loop.
+ *
+ *
+ * Prints the error and exits the process if the instance cannot be
+ * created.
+ *
+ * @param[out] loop The event loop.
+ * @param[in] spinMicroseconds Time the loop busy polls for after traffic,
+ * zero to always sleep.
+ */
+
+void initEventLoop(EventLoop *loop, int spinMicroseconds) {
+  loop->epollDescriptor = epoll_create1(0);
+  loop->spinBudget = (uint64_t) spinMicroseconds * 1000;
+  loop->lastTraffic = 0;
+
+  if (loop->epollDescriptor < 0) {
+    perror("Could not create the epoll instance");
+    exit(1);
+  }
+}
+
+/**
+ * @brief Watches a file descriptor for readability.
+ *
+ *
+ * The descriptor is level triggered, so a queue left with frames after a
+ * batch is reported ready again on the next wait.
+ * Prints the error and exits the process if the descriptor cannot be
+ * watched.
+ *
+ * @param[in, out] loop The event loop.
+ * @param[in] descriptor The file descriptor.
+ * @param[in] index The index the descriptor is reported ready as, below
+ * EVENT_LOOP_DESCRIPTORS.
+ */
+
+void watchEventLoop(EventLoop *loop, int descriptor, int index) {
+  struct epoll_event event = {.events = EPOLLIN, .data.u32 = index};
+
+  if (epoll_ctl(loop->epollDescriptor, EPOLL_CTL_ADD, descriptor, &event) < 0) {
+    printf("Could not watch descriptor %d: %s\n", descriptor, strerror(errno));
+    exit(1);
+  }
+}
+
+/**
+ * @brief Returns the time left until a timer deadline, in milliseconds.
+ *
+ * @param[in] deadline The tick the next timer is due at, UINT64_MAX for
+ * none.
+ * @return The time left, EVENT_LOOP_MAX_SLEEP_MS at most.
+ */
+
+static int sleepTimeout(uint64_t deadline) {
+  uint64_t now = timerNow();
+
+  if (deadline <= now) {
+    return 0;
+  }
+
+  if (deadline - now >= TIMER_TICKS(EVENT_LOOP_MAX_SLEEP_MS)) {
+    return EVENT_LOOP_MAX_SLEEP_MS;
+  }
+
+  return (deadline - now) * TIMER_TICK_MS;
+}
+
+/**
+ * @brief Waits until a watched descriptor is readable, or the deadline is
+ * reached.
+ *
+ *
+ * Busy polls epoll without sleeping while the last traffic is more recent
+ * than the spin budget, and returns once a descriptor is ready, the timer
+ * deadline is reached, or the budget is spent, so the caller runs its
+ * timers before the loop falls back to sleeping.
+ * Sleeps in epoll_wait() otherwise, until a descriptor is ready or the
+ * deadline is reached, for EVENT_LOOP_MAX_SLEEP_MS at most.
+ * Records the time of the traffic whenever a descriptor is ready.
+ * Prints the error and exits the process if waiting fails.
+ *
+ * @param[in, out] loop The event loop.
+ * @param[in] deadline The tick the next timer is due at, UINT64_MAX for
+ * none.
+ * @return The bits of the indices of the descriptors ready, zero when the
+ * deadline was reached or the spin budget ran out.
+ */
+
+uint64_t waitEventLoop(EventLoop *loop, uint64_t deadline) {
+  uint64_t now = nanoseconds();
+  uint64_t ready = 0;
+  int count;
+
+  if (now - loop->lastTraffic < loop->spinBudget) {
+    while ((count = epoll_wait(loop->epollDescriptor, loop->events, EVENT_LOOP_DESCRIPTORS, 0)) == 0) {
+      now = nanoseconds();
+
+      if (now - loop->lastTraffic >= loop->spinBudget || timerNow() >= deadline) {
+        break;
+      }
+    }
+  }
+  else {
+    count = epoll_wait(loop->epollDescriptor, loop->events, EVENT_LOOP_DESCRIPTORS, sleepTimeout(deadline));
+    now = nanoseconds();
+  }
+
+  if (count < 0) {
+    if (errno == EINTR) {
+      return 0;
+    }
+
+    perror("Could not wait for the queues");
+    exit(1);
+  }
+
+  for (int index = 0; index < count; index++) {
+    ready |= 1ULL << loop->events[index].data.u32;
+  }
+
+  if (count > 0) {
+    loop->lastTraffic = now;
+  }
+
+  return ready;
+}
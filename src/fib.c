@@ -0,0 +1,381 @@
+/**
+ * @file fib.c
+ * @author Aryan Chopra
+ * @brief The IPv4 forwarding table, looked up in two memory accesses at
+ * most whatever the number of routes.
+ *
+ * The table is a DIR-24-8 table: the first level has one entry per /24,
+ * and the /24s covered by longer prefixes point to a group of 256 entries
+ * of the second level, one per address.
+ * Every entry holds the index of a next hop rather than the next hop
+ * itself, so the routes through the same gateway and device share it, and
+ * the length of the prefix it was filled from, so a longer prefix is never
+ * overwritten by a shorter one added after it.
+ * A prefix of at most 24 bits fills the range of the first level it covers,
+ * and the groups of the second level hanging from it; a longer prefix fills
+ * the range it covers in the group of its /24, which is created from the
+ * entry of the first level the first time.
+ * The first level takes 64 MiB of address space, backed by memory only
+ * where routes are written.
+ */
+
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "address_set.h"
+#include "fib.h"
+#include "hash.h"
+
+#define FIB_VALID 0x80000000u ///The entry holds a next hop.
+#define FIB_GROUP 0x40000000u ///The entry of the first level points to a group of the second level.
+#define FIB_DEPTH_SHIFT 24 ///Position of the length of the prefix the entry was filled from.
+#define FIB_DEPTH_MASK 0x3f ///Bits of the length of the prefix, once shifted.
+#define FIB_VALUE_MASK 0x00ffffffu ///Bits of the index of the next hop, or of the group.
+
+/**
+ * @brief Allocates an empty forwarding table.
+ *
+ *
+ * Prints the error and exits the process if the table cannot be allocated.
+ *
+ * @return The table.
+ */
+
+Fib *newFib() {
+  Fib *fib = calloc(1, sizeof(Fib));
+
+  if (fib != NULL) {
+    fib->tbl24 = calloc(FIB_TBL24_LEN, sizeof(uint32_t));
+  }
+
+  if (fib == NULL || fib->tbl24 == NULL) {
+    printf("Could not allocate the forwarding table\n");
+    exit(1);
+  }
+
+  return fib;
+}
+
+/**
+ * @brief Hashes a next hop.
+ *
+ * @param[in] gateway The gateway.
+ * @param[in] device The index of the network device.
+ * @return The hash of the next hop.
+ */
+
+static uint32_t hashNextHop(uint32_t gateway, int device) {
+  return mixHash(gateway ^ ((uint32_t) device * 0x9e3779b1));
+}
+
+/**
+ * @brief Allocates the hash of the next hops with the number of slots
+ * provided, and reinserts every next hop.
+ *
+ *
+ * Prints the error and exits the process if the hash cannot be allocated.
+ *
+ * @param[in, out] fib The table.
+ * @param[in] size The number of slots, a power of two.
+ */
+
+static void resizeNextHops(Fib *fib, uint32_t size) {
+  free(fib->nextHopSlots);
+  fib->nextHopSlots = calloc(size, sizeof(uint32_t));
+
+  if (fib->nextHopSlots == NULL) {
+    printf("Could not allocate %u next hop slots\n", size);
+    exit(1);
+  }
+
+  fib->nextHopMask = size - 1;
+
+  for (uint32_t index = 0; index < fib->nextHopCount; index++) {
+    uint32_t slot = hashNextHop(fib->nextHops[index].gateway, fib->nextHops[index].device) & fib->nextHopMask;
+
+    while (fib->nextHopSlots[slot] != 0) {
+      slot = (slot + 1) & fib->nextHopMask;
+    }
+
+    fib->nextHopSlots[slot] = index + 1;
+  }
+}
+
+/**
+ * @brief Returns the index of a next hop, adding it if no route uses it
+ * yet.
+ *
+ *
+ * Prints the error and exits the process if the next hops cannot be grown.
+ *
+ * @param[in, out] fib The table.
+ * @param[in] gateway The gateway.
+ * @param[in] device The index of the network device.
+ * @return The index of the next hop.
+ */
+
+static uint32_t internNextHop(Fib *fib, uint32_t gateway, int device) {
+  if ((uint64_t) (fib->nextHopCount + 1) * 4 > ((uint64_t) fib->nextHopMask + 1) * 3) {
+    resizeNextHops(fib, fib->nextHopSlots == NULL ? 64 : (fib->nextHopMask + 1) * 2);
+  }
+
+  uint32_t slot = hashNextHop(gateway, device) & fib->nextHopMask;
+
+  while (fib->nextHopSlots[slot] != 0) {
+    FibNextHop *nextHop = &fib->nextHops[fib->nextHopSlots[slot] - 1];
+
+    if (nextHop->gateway == gateway && nextHop->device == device) {
+      return fib->nextHopSlots[slot] - 1;
+    }
+
+    slot = (slot + 1) & fib->nextHopMask;
+  }
+
+  if (fib->nextHopCount == fib->nextHopCapacity) {
+    uint32_t capacity = fib->nextHopCapacity == 0 ? 16 : fib->nextHopCapacity * 2;
+    FibNextHop *nextHops = realloc(fib->nextHops, capacity * sizeof(FibNextHop));
+
+    if (nextHops == NULL || fib->nextHopCount > FIB_MAX_INDEX) {
+      printf("Could not allocate %u next hops\n", capacity);
+      exit(1);
+    }
+
+    fib->nextHops = nextHops;
+    fib->nextHopCapacity = capacity;
+  }
+
+  fib->nextHops[fib->nextHopCount].gateway = gateway;
+  fib->nextHops[fib->nextHopCount].device = device;
+  fib->nextHopSlots[slot] = fib->nextHopCount + 1;
+
+  return fib->nextHopCount++;
+}
+
+/**
+ * @brief Adds a group to the second level, filled with an entry of the
+ * first level.
+ *
+ *
+ * Prints the error and exits the process if the second level cannot be
+ * grown.
+ *
+ * @param[in, out] fib The table.
+ * @param[in] entry The entry of the first level the group replaces.
+ * @return The index of the group.
+ */
+
+static uint32_t newGroup(Fib *fib, uint32_t entry) {
+  if (fib->groups == fib->groupCapacity) {
+    uint32_t capacity = fib->groupCapacity == 0 ? 64 : fib->groupCapacity * 2;
+    uint32_t *tbl8 = realloc(fib->tbl8, (size_t) capacity * FIB_TBL8_LEN * sizeof(uint32_t));
+
+    if (tbl8 == NULL || fib->groups > FIB_MAX_INDEX) {
+      printf("Could not allocate %u groups of the forwarding table\n", capacity);
+      exit(1);
+    }
+
+    fib->tbl8 = tbl8;
+    fib->groupCapacity = capacity;
+  }
+
+  uint32_t *group = fib->tbl8 + (size_t) fib->groups * FIB_TBL8_LEN;
+
+  for (int index = 0; index < FIB_TBL8_LEN; index++) {
+    group[index] = entry;
+  }
+
+  return fib->groups++;
+}
+
+/**
+ * @brief Writes the next hop of a prefix to an entry, unless the entry
+ * holds the next hop of a longer prefix.
+ *
+ * @param[in, out] entry The entry.
+ * @param[in] length The length of the prefix.
+ * @param[in] value The entry of the prefix.
+ */
+
+static void fillEntry(uint32_t *entry, int length, uint32_t value) {
+  if (!(*entry & FIB_VALID) || (int) ((*entry >> FIB_DEPTH_SHIFT) & FIB_DEPTH_MASK) <= length) {
+    *entry = value;
+  }
+}
+
+/**
+ * @brief Adds a route to the table, or replaces the route of the same
+ * prefix.
+ *
+ *
+ * The table is not synchronized, it is filled before the workers are
+ * started and only read afterwards.
+ * Prints the error and exits the process if the table cannot be grown.
+ *
+ * @param[in, out] fib The table.
+ * @param[in] address An address of the prefix, its host bits ignored.
+ * @param[in] length The length of the prefix.
+ * @param[in] gateway The gateway, 0 for the destinations on the link of the
+ * device.
+ * @param[in] device The index of the network device.
+ * @return 0 if the route was added, -1 if the length is invalid.
+ */
+
+int addRoute(Fib *fib, uint32_t address, int length, uint32_t gateway, int device) {
+  if (length < 0 || length > 32) {
+    return -1;
+  }
+
+  uint32_t network = ntohl(address) & (length == 0 ? 0 : 0xffffffffu << (32 - length));
+  uint32_t value = FIB_VALID | (uint32_t) length << FIB_DEPTH_SHIFT | internNextHop(fib, gateway, device);
+
+  if (length <= 24) {
+    uint32_t first = network >> 8;
+    uint32_t count = 1u << (24 - length);
+
+    for (uint32_t index = first; index < first + count; index++) {
+      if (!(fib->tbl24[index] & FIB_GROUP)) {
+        fillEntry(&fib->tbl24[index], length, value);
+        continue;
+      }
+
+      uint32_t *group = fib->tbl8 + (size_t) (fib->tbl24[index] & FIB_VALUE_MASK) * FIB_TBL8_LEN;
+
+      for (int slot = 0; slot < FIB_TBL8_LEN; slot++) {
+        fillEntry(&group[slot], length, value);
+      }
+    }
+  }
+  else {
+    uint32_t *entry = &fib->tbl24[network >> 8];
+
+    if (!(*entry & FIB_GROUP)) {
+      *entry = FIB_GROUP | newGroup(fib, *entry);
+    }
+
+    uint32_t *group = fib->tbl8 + (size_t) (*entry & FIB_VALUE_MASK) * FIB_TBL8_LEN;
+    uint32_t first = network & 0xff;
+    uint32_t count = 1u << (32 - length);
+
+    for (uint32_t slot = first; slot < first + count; slot++) {
+      fillEntry(&group[slot], length, value);
+    }
+  }
+
+  fib->routes++;
+
+  return 0;
+}
+
+/**
+ * @brief Looks up the next hop of the longest prefix matching a
+ * destination.
+ *
+ *
+ * Reads the entry of the first level of the destination, and the entry of
+ * the second level only if the first one points to a group.
+ *
+ * @param[in] fib The table.
+ * @param[in] destination The destination, in Network notation(Big Endian).
+ * @return The next hop, or NULL if no route matches.
+ */
+
+FibNextHop *lookupRoute(Fib *fib, uint32_t destination) {
+  uint32_t host = ntohl(destination);
+  uint32_t entry = fib->tbl24[host >> 8];
+
+  if (entry & FIB_GROUP) {
+    entry = fib->tbl8[(size_t) (entry & FIB_VALUE_MASK) * FIB_TBL8_LEN + (host & 0xff)];
+  }
+
+  return entry & FIB_VALID ? &fib->nextHops[entry & FIB_VALUE_MASK] : NULL;
+}
+
+/**
+ * @brief Parses a route and adds it to the table.
+ *
+ *
+ * A route is a prefix in decimal notation, optionally followed by its
+ * gateway, and by the index of its network device, separated by spaces,
+ * such as "10.2.0.0/16 10.0.0.1 0".
+ * A missing gateway, or 0.0.0.0, makes the destinations of the prefix on
+ * the link of the device.
+ * The route is split in place.
+ *
+ * @param[in, out] fib The table.
+ * @param[in, out] text The route.
+ * @param[in] devices The number of network devices.
+ * @return 0 if the route was added, -1 if it could not be parsed.
+ */
+
+int parseRoute(Fib *fib, char *text, int devices) {
+  char *state;
+  char *prefix = strtok_r(text, " \t", &state);
+  char *gateway = strtok_r(NULL, " \t", &state);
+  char *device = strtok_r(NULL, " \t", &state);
+  uint32_t address;
+  uint32_t binary = 0;
+  int length;
+  long index = 0;
+
+  if (prefix == NULL || strtok_r(NULL, " \t", &state) != NULL || parsePrefix(prefix, &address, &length) != 0) {
+    return -1;
+  }
+
+  if (gateway != NULL && inet_pton(AF_INET, gateway, &binary) != 1) {
+    return -1;
+  }
+
+  if (device != NULL) {
+    char *end;
+
+    index = strtol(device, &end, 10);
+
+    if (end == device || *end != '\0' || index < 0 || index >= devices) {
+      return -1;
+    }
+  }
+
+  return addRoute(fib, address, length, binary, (int) index);
+}
+
+/**
+ * @brief Adds every route listed in a file to the table, one per line.
+ *
+ *
+ * Skips the empty lines and the lines starting with #.
+ * Prints the error and exits the process if the file cannot be read or a
+ * line cannot be parsed.
+ *
+ * @param[in, out] fib The table.
+ * @param[in] path The path of the file.
+ * @param[in] devices The number of network devices.
+ */
+
+void loadRoutes(Fib *fib, char *path, int devices) {
+  FILE *file = fopen(path, "r");
+  char line[128];
+  int number = 0;
+
+  if (file == NULL) {
+    perror("Could not open the route file");
+    exit(1);
+  }
+
+  while (fgets(line, sizeof(line), file) != NULL) {
+    number++;
+    line[strcspn(line, "\r\n")] = '\0';
+
+    if (line[strspn(line, " \t")] == '\0' || line[0] == '#') {
+      continue;
+    }
+
+    if (parseRoute(fib, line, devices) != 0) {
+      printf("Invalid route on line %d of %s\n", number, path);
+      exit(1);
+    }
+  }
+
+  fclose(file);
+}
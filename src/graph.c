@@ -0,0 +1,231 @@
+/**
+ * @file graph.c
+ * @author Aryan Chopra
+ * @brief Handles a vector of frames through a graph of nodes, one layer at
+ * a time.
+ *
+ * ethernet-input parses every frame of the vector and dispatches it to
+ * arp-input or ip4-input.
+ * ip4-input checks every IP packet and dispatches it to icmp-echo when it
+ * is an ICMP request sent to the stack, or to ip4-forward when it is to be
+ * forwarded; the fragments and the other protocols sent to the stack are
+ * delivered right away, as the reassembled datagrams are only valid until
+ * the next fragment.
+ * icmp-echo and ip4-forward queue their frames on the transmit batch of
+ * their device, and interface-output writes the batches of every device.
+ * Every node prefetches the headers of the packets GRAPH_PREFETCH packets
+ * ahead of the one it handles.
+ */
+
+#include "arp.h"
+#include "ethernet.h"
+#include "graph.h"
+#include "ip.h"
+#include "log.h"
+#include "netdev.h"
+#include "packet.h"
+
+/**
+ * @brief Hands a packet to the vector of a node.
+ *
+ * @param[in, out] graph The graph.
+ * @param[in] node The node.
+ * @param[in] packet The packet.
+ */
+
+static inline void enqueueNode(Graph *graph, int node, Packet *packet) {
+  graph->vectors[node][graph->counts[node]++] = packet;
+}
+
+/**
+ * @brief Prefetches the network header of a packet of a vector, if the
+ * vector holds it.
+ *
+ * @param[in] vector The vector.
+ * @param[in] count The number of packets of the vector.
+ * @param[in] index The index of the packet.
+ */
+
+static inline void prefetchNetwork(Packet **vector, int count, int index) {
+  if (index < count) {
+    __builtin_prefetch((char *) vector[index]->ethernet + vector[index]->networkOffset);
+  }
+}
+
+/**
+ * @brief Parses every frame of the vector, and dispatches it on its
+ * ethertype.
+ *
+ *
+ * Drops the frames which are truncated or malformed, and the frames of any
+ * other ethertype than ARP and IP.
+ *
+ * @param[in, out] graph The graph, holding the buffers of the vector.
+ * @param[in] buffers The buffers holding the frames.
+ * @param[in] count The number of frames.
+ */
+
+static void ethernetInput(Graph *graph, PacketBuffer **buffers, int count) {
+  for (int index = 0; index < count; index++) {
+    Packet *packet = &graph->packets[index];
+
+    if (index + GRAPH_PREFETCH < count) {
+      __builtin_prefetch(buffers[index + GRAPH_PREFETCH]->data);
+    }
+
+    if (parsePacket(packet, buffers[index]->data, buffers[index]->length) != 0) {
+      continue;
+    }
+
+    packet->buffer = buffers[index];
+
+    switch (packet->ethertype) {
+      case ETH_P_ARP:
+        enqueueNode(graph, NODE_ARP_INPUT, packet);
+        break;
+      case ETH_P_IP:
+        enqueueNode(graph, NODE_IP4_INPUT, packet);
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+/**
+ * @brief Handles every ARP packet of the vector.
+ *
+ * @param[in, out] graph The graph.
+ * @param[in] netdev The device the frames were received on.
+ */
+
+static void arpInput(Graph *graph, Netdev *netdev) {
+  Packet **vector = graph->vectors[NODE_ARP_INPUT];
+  int count = graph->counts[NODE_ARP_INPUT];
+
+  for (int index = 0; index < count; index++) {
+    prefetchNetwork(vector, count, index + GRAPH_PREFETCH);
+
+    log(vector[index]->ethernet, L_ETHERNET | L_INCOMING);
+    incomingRequest(netdev, vector[index]);
+  }
+}
+
+/**
+ * @brief Checks every IP packet of the vector, and dispatches it to the
+ * stack or to the forwarding.
+ *
+ * @param[in, out] graph The graph.
+ * @param[in] netdev The device the frames were received on.
+ */
+
+static void ip4Input(Graph *graph, Netdev *netdev) {
+  Packet **vector = graph->vectors[NODE_IP4_INPUT];
+  int count = graph->counts[NODE_IP4_INPUT];
+
+  for (int index = 0; index < count; index++) {
+    Packet *packet = vector[index];
+
+    prefetchNetwork(vector, count, index + GRAPH_PREFETCH);
+
+    switch (ipInput(netdev, packet)) {
+      case IP_FORWARD:
+        enqueueNode(graph, NODE_IP4_FORWARD, packet);
+        break;
+      case IP_LOCAL:
+        if (packet->protocol == ICMP && !(packet->flags & PACKET_FRAGMENT)) {
+          enqueueNode(graph, NODE_ICMP_ECHO, packet);
+        }
+        else {
+          ipLocal(netdev, packet);
+        }
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+/**
+ * @brief Answers every ICMP request of the vector.
+ *
+ * @param[in, out] graph The graph.
+ * @param[in] netdev The device the frames were received on.
+ */
+
+static void icmpEcho(Graph *graph, Netdev *netdev) {
+  Packet **vector = graph->vectors[NODE_ICMP_ECHO];
+  int count = graph->counts[NODE_ICMP_ECHO];
+
+  for (int index = 0; index < count; index++) {
+    if (index + GRAPH_PREFETCH < count) {
+      __builtin_prefetch((char *) vector[index + GRAPH_PREFETCH]->ethernet + vector[index + GRAPH_PREFETCH]->transportOffset);
+    }
+
+    ipEcho(netdev, vector[index]);
+  }
+}
+
+/**
+ * @brief Forwards every IP packet of the vector which is not sent to the
+ * stack.
+ *
+ * @param[in, out] graph The graph.
+ * @param[in] netdev The device the frames were received on.
+ */
+
+static void ip4Forward(Graph *graph, Netdev *netdev) {
+  Packet **vector = graph->vectors[NODE_IP4_FORWARD];
+  int count = graph->counts[NODE_IP4_FORWARD];
+
+  for (int index = 0; index < count; index++) {
+    prefetchNetwork(vector, count, index + GRAPH_PREFETCH);
+
+    ipForward(netdev, vector[index]);
+  }
+}
+
+/**
+ * @brief Writes the frames queued on every device of the worker.
+ *
+ * @param[in] netdev The device the frames were received on.
+ */
+
+static void interfaceOutput(Netdev *netdev) {
+  int devices = netdev->devices != NULL ? netdev->deviceCount : 1;
+
+  for (int device = 0; device < devices; device++) {
+    flushNetdev(peerNetdev(netdev, device));
+  }
+}
+
+/**
+ * @brief Handles a vector of frames received on a device through the
+ * graph.
+ *
+ *
+ * The frames enter the graph at ethernet-input, and every node hands its
+ * packets to the vector of the next node, before that node runs.
+ * The replies and the packets forwarded are queued on the transmit batch
+ * of their device, which interface-output writes last.
+ *
+ * @param[in, out] graph The graph of the calling worker.
+ * @param[in] netdev The worker's copy of the device the frames were
+ * received on.
+ * @param[in, out] buffers The buffers holding the frames, the replies being
+ * built in place in them.
+ * @param[in] count The number of frames, GRAPH_VECTOR_LEN at most.
+ */
+
+void runGraph(Graph *graph, Netdev *netdev, PacketBuffer **buffers, int count) {
+  for (int node = 0; node < GRAPH_NODES; node++) {
+    graph->counts[node] = 0;
+  }
+
+  ethernetInput(graph, buffers, count);
+  arpInput(graph, netdev);
+  ip4Input(graph, netdev);
+  icmpEcho(graph, netdev);
+  ip4Forward(graph, netdev);
+  interfaceOutput(netdev);
+}
@@ -7,55 +7,69 @@
 #include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "icmp.h"
 #include "ip.h"
+#include "packet.h"
 
 /**
  * @brief Handles the incoming ICMP Reqeust.
  *
  *
- * Extracts the ICMP information from the incoming IP Header.
+ * Extracts the ICMP information from the payload of the incoming IP Header,
+ * at the offset and length recorded in the descriptor.
  * Checks if the request type is Echo, and calls the appropriate function to
  * modify the incoming header accordingly.
+ * Drops the packet if it is shorter than the ICMP header, before reading
+ * or rewriting any of it.
  *
- * @param[in, out] ipHeader A struct containing aptly named and sized fields
- * of an IP Header.
+ * @param[in, out] packet The descriptor of the frame carrying the ICMP
+ * header.
  * If the request type is Echo, calls the appropriate function to modify the
  * incmoing header.
+ * @return 0 if a reply was built in place, -1 if the packet is dropped.
  */
 
-void handleIcmp(IpHeader *ipHeader) {
-  Icmp *icmpInfo = (Icmp *) ipHeader->data;
+int handleIcmp(Packet *packet) {
+  Icmp *icmpInfo = (Icmp *) ((char *) packet->ethernet + packet->transportOffset);
+
+  if (packet->transportLength < (int) sizeof(Icmp)) {
+    printf("Truncated ICMP packet\n");
+    return -1;
+  }
 
   switch (icmpInfo->type) {
     case ICMP_ECHO:
       printf("Is ICMP_ECHO\n");
-      int length = ipHeader->totalLength - (ipHeader->headerLength * 4);
-      structureIcmpReply(icmpInfo, length);
-      break;
+      structureIcmpReply(icmpInfo);
+      return 0;
     default:
       printf("Got ICMP type = %"PRIu8"\n", icmpInfo->type);
-      return;
+      return -1;
   }
 }
 
 /**
- * @brief Changes the info type from Echo to Reply, and recomputes the checksum.
+ * @brief Changes the info type from Echo to Reply, and updates the checksum.
  *
  *
  * @param[in, out] icmpInfo A struct formated with appropriate names and
  * sizes for an ICMP Header.
  * Changes the type from Echo to Reply to reply back to the ICMP(commonly a
  * ping) request.
- * Recomputes the checksum.
- * @param[in] int Conatains length of ICMP Header.
- * @param[in] icmpLength Conatains length of ICMP Header.
+ * Updates the checksum for the word holding the type and the code only, so
+ * the reply costs the same whatever the length of the payload.
  */
 
-void structureIcmpReply(Icmp *icmpInfo, int icmpLength) {
+void structureIcmpReply(Icmp *icmpInfo) {
+  uint16_t old;
+  uint16_t new;
+
+  memcpy(&old, icmpInfo, sizeof(old));
   icmpInfo->type = ICMP_REPLY;
-  icmpInfo->checksum = 0;
-  icmpInfo->checksum = checksum(icmpInfo, icmpLength);
+  memcpy(&new, icmpInfo, sizeof(new));
+
+  icmpInfo->checksum = updateChecksum(icmpInfo->checksum, old, new);
 }
 
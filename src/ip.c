@@ -6,13 +6,13 @@
  * Extracts the IP Packet from the incoming Ethernet Header.
  * Checks whether the implementations of the packet's protocols exist.
  * Calls appropriate functions for handling an ICMP request, if the payload is ICMP.
- * Contains the utility for computing checksum.
  * Replies to the source with an appropriate message(not always).
  */
 
 #include <arpa/inet.h>
 #include <inttypes.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "arp.h"
 #include "ethernet.h"
@@ -20,70 +20,161 @@
 #include "ip.h"
 #include "log.h"
 #include "netdev.h"
+#include "packet.h"
+#include "rate_limit.h"
+#include "reassembly.h"
 
 /**
  * @brief Handles the incoming IP request.
  *
  *
- * Extracts the payload, an IP Packet from the incoming Ethernet Packet.
- * Computes the checksum to verify the integrity of the packet.
- * Checks various parameters of the IP Header to verify the integrity.
- * Checks the type of request the packet is carrying.
- * In case of an ICMP request, calls the appropriate functions to deal with
- * the ICMP request.
- * Replies back to the source with a modified IP/Ethernet Packet.
+ * Checks the packet through ipInput(), then forwards it through
+ * ipForward() or delivers it to the stack through ipLocal().
  *
  * @param[in] netdev A struct emulating a network device. The IP request is
  * directed to the device.
- * @param[in, out] ethHeader A struct containing formated fields for an
- * Ethrnet Header.
+ * @param[in, out] packet The descriptor of the frame carrying the IP packet.
  * The payload and the sender and receiver address of the packet is modified
  * while relaying back.
- * @pre The ethernet header contains an IP Packet;
+ * @pre The frame was parsed and carries an IP Packet;
  */
 
-void ipIncoming(Netdev *netdev, EthernetHeader *ethHeader) {
-  IpHeader *ipHeader = (IpHeader *) ethHeader->payload;
-  uint16_t checksumValue = -1;
-
-  if (ipHeader->version != IPV4) {
-    printf("Version not IPV4 while intercepting got = &0x02\n", ipHeader->version);
-    return;
+void ipIncoming(Netdev *netdev, Packet *packet) {
+  switch (ipInput(netdev, packet)) {
+    case IP_FORWARD:
+      ipForward(netdev, packet);
+      break;
+    case IP_LOCAL:
+      ipLocal(netdev, packet);
+      break;
+    default:
+      return;
   }
+}
 
-  printf("Version and length: %"PRIu8"\n", ipHeader->version);
+/**
+ * @brief Checks an incoming IP packet and decides where it goes.
+ *
+ *
+ * Extracts the payload, an IP Packet from the incoming Ethernet Packet, at
+ * the offset recorded in the descriptor.
+ * Checks various parameters of the IP Header to verify the integrity, the
+ * version and lengths being checked when the frame is parsed.
+ * A packet which is not sent to one of the local addresses of the device,
+ * checked in constant time, is to be forwarded if the stack forwards
+ * between several devices, and dropped otherwise.
+ * Computes the checksum of a packet sent to the stack to verify its
+ * integrity, the forwarded packets being verified when they are forwarded.
+ *
+ * @param[in] netdev A struct emulating a network device. The IP request is
+ * directed to the device.
+ * @param[in] packet The descriptor of the frame carrying the IP packet.
+ * @return IP_LOCAL if the packet is sent to the stack, IP_FORWARD if it is
+ * to be forwarded, IP_DROP if it is dropped.
+ * @pre The frame was parsed and carries an IP Packet;
+ */
 
-  if (ipHeader->headerLength < 5) {
-    printf("Header length must be 5\n");
-    return;
-  }
+int ipInput(Netdev *netdev, Packet *packet) {
+  IpHeader *ipHeader = (IpHeader *) ((char *) packet->ethernet + packet->networkOffset);
+  uint16_t checksumValue = -1;
+
+  printf("Version and length: %"PRIu8"\n", ipHeader->version);
 
   if (ipHeader->ttl == 0) {
     //todo send ICMP error
     printf("Packet ttl = 0\n");
-    return;
+    return IP_DROP;
+  }
+
+  if (!containsAddress(netdev->locals, ipHeader->destinationAddress)) {
+    if (netdev->deviceCount > 1) {
+      return IP_FORWARD;
+    }
+
+    printf("Packet not for our own address\n");
+    return IP_DROP;
   }
 
   checksumValue = checksum(ipHeader, ipHeader->headerLength * 4);
 
   if (checksumValue != 0) {
     printf("Checksum failed to verify in incoming before icmp\n");
-    return;
+    return IP_DROP;
   }
 
-  ipHeader->totalLength = ntohs(ipHeader->totalLength);
+  return IP_LOCAL;
+}
+
+/**
+ * @brief Delivers an IP packet sent to the stack to its protocol.
+ *
+ *
+ * Hands the fragments to the reassembly, and handles their datagram once it
+ * is complete, flushing its reply right away from the device it is sent
+ * from, as the datagram is only valid until the next fragment.
+ * Checks the type of request the packet is carrying.
+ * In case of an ICMP request, answers it through ipEcho().
+ *
+ * @param[in] netdev A struct emulating a network device. The IP request is
+ * directed to the device.
+ * @param[in, out] packet The descriptor of the frame carrying the IP packet,
+ * checked by ipInput().
+ */
 
-  switch (ipHeader->protocol) {
+void ipLocal(Netdev *netdev, Packet *packet) {
+  int reassembled = packet->flags & PACKET_FRAGMENT;
+  Netdev *egress;
+
+  if (reassembled && reassembleIp(packet) != 0) {
+    return;
+  }
+
+  switch (packet->protocol) {
     case ICMP:
-      log(ipHeader, L_IP | L_INCOMING);
-      handleIcmp(ipHeader);
-      ipReply(netdev, ethHeader);
+      egress = ipEcho(netdev, packet);
       break;
     default:
-      printf("Got protocol: %"PRIu8"\n", ipHeader->protocol);
+      printf("Got protocol: %"PRIu8"\n", packet->protocol);
       //diff between uit8 and uint8_t?
       return;
   }
+
+  if (reassembled && egress != NULL) {
+    flushNetdev(egress);
+  }
+}
+
+/**
+ * @brief Answers an ICMP request sent to the stack.
+ *
+ *
+ * Drops the request if the source exceeds its rate of ICMP requests.
+ * Logs the incoming packet, calls the appropriate functions to deal with
+ * the ICMP request, and replies back to the source with a modified
+ * IP/Ethernet Packet, unless the ICMP packet is dropped.
+ *
+ * @param[in] netdev A struct emulating a network device. The IP request is
+ * directed to the device.
+ * @param[in, out] packet The descriptor of the frame carrying the ICMP
+ * request, the reply is built in place in it.
+ * @return The device the reply is sent from, NULL if the request is
+ * dropped.
+ */
+
+Netdev *ipEcho(Netdev *netdev, Packet *packet) {
+  IpHeader *ipHeader = (IpHeader *) ((char *) packet->ethernet + packet->networkOffset);
+
+  if (!allowRate(RATE_ICMP, ipHeader->sourceAddress)) {
+    return NULL;
+  }
+
+  log(ipHeader, L_IP | L_INCOMING);
+
+  if (handleIcmp(packet) != 0) {
+    return NULL;
+  }
+
+  return ipReply(netdev, packet);
 }
 
 /**
@@ -91,60 +182,292 @@ void ipIncoming(Netdev *netdev, EthernetHeader *ethHeader) {
  *
  *
  * Swaps the source and destination IP Addresses, as the Packet is to be
- * send back to the sender.
- * Recomputes the checksum to verify the integrity of the IP Packet.
+ * send back to the sender from the local address it was sent to.
+ * Clears the flags of the header, so the reply can be fragmented, like the
+ * replies of the kernel.
+ * Updates the checksum for the cleared flags only, rather than summing the
+ * header again, as swapping the addresses leaves the sum unchanged.
  * Logs the outgoing Packet to a log file.
+ * Looks up the route to the sender, and drops the Packet if there is none.
+ * Transmits the Packet through ipOutput() from the device of the route, to
+ * the gateway of the route, or to the sender itself when it is on the link,
+ * fragmenting it if it is larger than the MTU of the device.
  *
  * @param[in] netdev A struct emulating a device on the network, through
- * which the request is received
- * and is to be sent back from.
- * @param[in, out] ethHeader A struct containing formated fields to contain
- * an ethernet header/packet.
+ * which the request is received.
+ * @param[in, out] packet The descriptor of the frame carrying the IP packet.
  * The payload(Ip Packet) is modified with the appropriate information and
  * is transmitted back to the sender.
+ * @return The device the Packet is sent from, NULL if there is no route to
+ * the sender.
  */
 
-void ipReply(Netdev *netdev, EthernetHeader *ethHeader){
-  IpHeader *ipHeader = (IpHeader *) ethHeader->payload;
-  uint8_t length = ipHeader->totalLength;
+Netdev *ipReply(Netdev *netdev, Packet *packet){
+  EthernetHeader *ethHeader = packet->ethernet;
+  IpHeader *ipHeader = (IpHeader *) ((char *) ethHeader + packet->networkOffset);
+  int length = packet->networkLength;
 
-  ipHeader->destinationAddress = ipHeader->sourceAddress;
-  ipHeader->sourceAddress = netdev->address;
+  uint32_t localAddress = ipHeader->destinationAddress;
+  uint32_t remoteAddress = ipHeader->sourceAddress;
+  uint16_t check = ipHeader->checksum;
 
-  ipHeader->totalLength = htons(ipHeader->totalLength);
+  ipHeader->destinationAddress = remoteAddress;
+  ipHeader->sourceAddress = localAddress;
 
-  ipHeader->checksum = 0;
-  ipHeader->checksum = checksum(ipHeader, ipHeader->headerLength * 4);
+  // Swapping the addresses leaves the one's complement sum of the header unchanged.
+  check = updateChecksum(check, htons(ipFragment(ipHeader)), 0);
+  setIpFragment(ipHeader, 0);
+  ipHeader->checksum = check;
 
   log(ipHeader, L_IP);
-  transmitNetdev(netdev, ethHeader, ETH_P_IP, length, ethHeader->sourceMac); 
+
+  FibNextHop *route = lookupRoute(netdev->routes, remoteAddress);
+
+  if (route == NULL) {
+    printf("No route to the sender\n");
+    return NULL;
+  }
+
+  Netdev *egress = peerNetdev(netdev, route->device);
+
+  ipOutput(egress, ethHeader, length, route->gateway != 0 ? route->gateway : remoteAddress);
+
+  return egress;
 }
 
 /**
- * @brief Computes the checksum for the IP Header provided.
+ * @brief Forwards an IP packet which is not sent to the stack towards its
+ * destination.
+ *
+ *
+ * Only forwards the packets sent to the MAC address of the device they
+ * arrived on, whose header checksum verifies and whose TTL does not expire.
+ * Looks up the next hop and the egress device of the destination in the
+ * forwarding table, and drops the packet if there is no route, or if the
+ * destination is an address of the egress device, which only answers on
+ * its own link.
+ * Decrements the TTL, updating the checksum for the word it shares with the
+ * protocol rather than summing the header again.
+ * Transmits the packet in place through ipOutput(), from the worker's copy
+ * of the egress device, so it is queued on the transmit batch of that
+ * device, its MAC addresses rewritten from the ARP cache.
  *
- * @param[in] address The IP header on which the checksum is to be computed.
- * @param[in] length The length of the IP Header provided.
- * @return Checksum computed.
+ * @param[in] netdev The network device the packet arrived on.
+ * @param[in, out] packet The descriptor of the frame carrying the IP packet,
+ * rewritten in place.
  */
 
-uint16_t checksum(void *address, int count) {
-  int sum = 0;
-  uint16_t *ptr = address;
+void ipForward(Netdev *netdev, Packet *packet) {
+  EthernetHeader *ethHeader = packet->ethernet;
+  IpHeader *ipHeader = (IpHeader *) ((char *) ethHeader + packet->networkOffset);
+  uint32_t destination = ipHeader->destinationAddress;
+  uint16_t word;
+  uint16_t decremented;
 
-  while (count > 1) {
-    sum += * ptr++;
-    count -= 2;
+  if (memcmp(ethHeader->destinationMac, netdev->macOctets, 6) != 0) {
+    return;
   }
-  
-  if (count > 0) {
-    sum += * (uint8_t *) address;
+
+  if (checksum(ipHeader, ipHeader->headerLength * 4) != 0) {
+    printf("Checksum failed to verify in forwarded packet\n");
+    return;
   }
 
-  while (sum >> 16) {
-    sum = (sum & 0xffff) + (sum >> 16);
+  if (ipHeader->ttl <= 1) {
+    //todo send ICMP time exceeded
+    printf("Packet ttl expired while forwarding\n");
+    return;
   }
 
-  return ~sum;
+  FibNextHop *route = lookupRoute(netdev->routes, destination);
+
+  if (route == NULL) {
+    printf("No route to the destination\n");
+    return;
+  }
+
+  Netdev *egress = peerNetdev(netdev, route->device);
+
+  if (containsAddress(egress->locals, destination)) {
+    printf("Packet for the address of another device\n");
+    return;
+  }
+
+  memcpy(&word, &ipHeader->ttl, sizeof(word));
+  ipHeader->ttl--;
+  memcpy(&decremented, &ipHeader->ttl, sizeof(decremented));
+  ipHeader->checksum = updateChecksum(ipHeader->checksum, word, decremented);
+
+  ipOutput(egress, ethHeader, packet->networkLength, route->gateway != 0 ? route->gateway : destination);
+}
+
+/**
+ * @brief Keeps only the options of a header copied into every fragment.
+ *
+ *
+ * Moves the options with the copied flag to the start of the options, in
+ * place, drops the other ones, and pads the options kept with end of
+ * options bytes to a multiple of 4 bytes.
+ * Stops at the end of the options, or at an option whose length is
+ * invalid.
+ *
+ * @param[in, out] options The options of the header.
+ * @param[in] length The length of the options.
+ * @return The length of the options kept, padding included.
+ */
+
+static int copiedOptions(unsigned char *options, int length) {
+  int kept = 0;
+  int index = 0;
+
+  while (index < length && options[index] != IP_OPTION_END) {
+    int size = options[index] == IP_OPTION_NOP ? 1 : (index + 1 < length ? options[index + 1] : 0);
+
+    if (size < 1 || (size == 1 && options[index] != IP_OPTION_NOP) || index + size > length) {
+      break;
+    }
+
+    if (options[index] & IP_OPTION_COPIED) {
+      memmove(options + kept, options + index, size);
+      kept += size;
+    }
+
+    index += size;
+  }
+
+  while (kept % 4 != 0) {
+    options[kept++] = IP_OPTION_END;
+  }
+
+  return kept;
+}
+
+/**
+ * @brief Transmits an IP packet in fragments of the MTU of the device.
+ *
+ *
+ * Every fragment is made of a copy of the ethernet and IP headers, followed
+ * by its slice of the payload, gathered from the packet when the fragment
+ * is written, so the payload is never copied.
+ * Every fragment but the last one carries a multiple of 8 bytes, and keeps
+ * the offset and the more fragments flag of a packet which is a fragment
+ * itself.
+ * The first fragment carries all the options of the header, the following
+ * ones only the options with the copied flag, their header and their slice
+ * of the payload sized accordingly.
+ *
+ * @param[in] netdev The network device the fragments are sent from.
+ * @param[in, out] ethHeader The frame carrying the packet, whose ethernet
+ * header is filled in.
+ * @param[in] length The length of the IP packet.
+ * @param[in] destination The MAC address of the next hop.
+ */
+
+static void fragmentIp(Netdev *netdev, EthernetHeader *ethHeader, int length, unsigned char *destination) {
+  IpHeader *ipHeader = (IpHeader *) ethHeader->payload;
+  int headerLength = ipHeader->headerLength * 4;
+  int chunk = (netdev->mtu - headerLength) & ~7;
+  int payloadLength = length - headerLength;
+  char *payload = (char *) ipHeader + headerLength;
+  uint16_t fragment = ipFragment(ipHeader);
+  char header[sizeof(EthernetHeader) + 60];
+  IpHeader *copy = (IpHeader *) (header + sizeof(EthernetHeader));
+
+  ethHeader->payloadType = htons(ETH_P_IP);
+  memcpy(ethHeader->destinationMac, destination, 6);
+  memcpy(ethHeader->sourceMac, netdev->macOctets, 6);
+  memcpy(header, ethHeader, sizeof(EthernetHeader) + headerLength);
+
+  for (int offset = 0, size; offset < payloadLength; offset += size) {
+    size = payloadLength - offset < chunk ? payloadLength - offset : chunk;
+    int more = offset + size < payloadLength || (fragment & IP_MORE_FRAGMENTS);
+
+    copy->totalLength = htons(headerLength + size);
+    setIpFragment(copy, ((fragment & IP_OFFSET_MASK) + offset / 8) | (more ? IP_MORE_FRAGMENTS : 0));
+    copy->checksum = 0;
+    copy->checksum = checksum(copy, headerLength);
+
+    log((EthernetHeader *) header, L_ETHERNET);
+    sendNetdevParts(netdev, header, sizeof(EthernetHeader) + headerLength, payload + offset, size);
+
+    if (offset == 0 && headerLength > (int) sizeof(IpHeader)) {
+      headerLength = sizeof(IpHeader) + copiedOptions((unsigned char *) copy + sizeof(IpHeader), headerLength - sizeof(IpHeader));
+      copy->headerLength = headerLength / 4;
+      chunk = (netdev->mtu - headerLength) & ~7;
+    }
+  }
 }
 
+/**
+ * @brief Transmits an IP packet to the next hop, fragmenting it if it is
+ * larger than the MTU of the device.
+ *
+ *
+ * A packet which fits in the MTU is handed to the ARP layer as it is,
+ * queued until the next hop is resolved if needed.
+ * A larger packet is dropped if it must not be fragmented, or if the next
+ * hop is not resolved yet, its resolution being started; otherwise it is
+ * transmitted in fragments, one after another, without copying its
+ * payload.
+ *
+ * @param[in] netdev The network device the packet is sent from.
+ * @param[in, out] ethHeader The frame carrying the packet, whose ethernet
+ * header is filled in.
+ * @param[in] length The length of the IP packet.
+ * @param[in] nextHop The IP address of the next hop, in Network
+ * notation(Big Endian).
+ */
+
+void ipOutput(Netdev *netdev, EthernetHeader *ethHeader, int length, uint32_t nextHop) {
+  IpHeader *ipHeader = (IpHeader *) ethHeader->payload;
+  unsigned char destination[6];
+
+  if (length <= netdev->mtu) {
+    resolveAndTransmit(netdev, ethHeader, ETH_P_IP, length, nextHop);
+    return;
+  }
+
+  if (ipFragment(ipHeader) & IP_DONT_FRAGMENT || ipHeader->headerLength * 4 + 8 > netdev->mtu) {
+    printf("Dropping a packet larger than the MTU which cannot be fragmented\n");
+    return;
+  }
+
+  if (resolveArp(netdev, nextHop, destination) != 0) {
+    return;
+  }
+
+  fragmentIp(netdev, ethHeader, length, destination);
+}
+
+/**
+ * @brief Reads the flags and the fragment offset of an IP header.
+ *
+ *
+ * The flags and fragmentOffset fields of IpHeader do not match the bits of
+ * the header on a Little Endian host, so the 16 bits following the id are
+ * read as a whole.
+ *
+ * @param[in] ipHeader The IP header.
+ * @return The flags and the offset, in host notation.
+ */
+
+uint16_t ipFragment(IpHeader *ipHeader) {
+  uint16_t field;
+
+  memcpy(&field, (char *) &ipHeader->id + sizeof(ipHeader->id), sizeof(field));
+
+  return ntohs(field);
+}
+
+/**
+ * @brief Writes the flags and the fragment offset of an IP header.
+ *
+ * @param[in, out] ipHeader The IP header.
+ * @param[in] fragment The flags and the offset, in host notation.
+ */
+
+void setIpFragment(IpHeader *ipHeader, uint16_t fragment) {
+  uint16_t field = htons(fragment);
+
+  memcpy((char *) &ipHeader->id + sizeof(ipHeader->id), &field, sizeof(field));
+}
@@ -72,11 +72,8 @@ void writeIpLog(char *text) {
  * function in a different file.
  * The function writes the formated string using snprintf to a buffer which
  * is then logged to the log file.
- * inet_atoa requires in_addr struct which contains a single field
- * equivalent to uint32_t.
- * The address provided is casted to the struct which is then used to covert
- * the 
- * IP address in commonl understandable format.
+ * inet_ntop is used instead of inet_ntoa, as it writes to the buffer
+ * provided instead of a static one, so several workers can log at once.
  *
  * @param[in] address 32 bit unsigned int which contains the IP address in
  * binary, Big Endian notation.
@@ -84,8 +81,10 @@ void writeIpLog(char *text) {
 
 static void logIpAddress(uint32_t address) {
   char *text = calloc(SIZE, 1);
+  char legible[INET_ADDRSTRLEN];
 
-  snprintf(text, SIZE, "%s\n", inet_ntoa(*((struct in_addr *)&address)));
+  inet_ntop(AF_INET, &address, legible, sizeof(legible));
+  snprintf(text, SIZE, "%s\n", legible);
         
   writeIpLog(text);
 
@@ -128,7 +127,7 @@ void logIpHeader(IpHeader *hdr, uint8_t incoming) {
   snprintf(text, SIZE, "tos                  : %"PRIu8"\n", hdr->tos);
   writeIpLog(text);
 
-  snprintf(text, SIZE, "totalLength          : %"PRIu16"\n", hdr->totalLength);
+  snprintf(text, SIZE, "totalLength          : %"PRIu16"\n", ntohs(hdr->totalLength));
   writeIpLog(text);
 
   snprintf(text, SIZE, "ID                   : %"PRIu16"\n", hdr->id);
@@ -14,6 +14,7 @@
  * defined in a macro.
  */
 
+#include <pthread.h>
 #include <stdio.h>
 
 #include "arp_log.h"
@@ -21,6 +22,13 @@
 #include "ip_log.h"
 #include "log.h"
 
+/**
+ * Serializes the logging of the workers of different queues, as every header
+ * is written with several writes which must not interleave.
+ */
+
+static pthread_mutex_t logLock = PTHREAD_MUTEX_INITIALIZER;
+
 /**
  * @brief Opens all the log files at once.
  */
@@ -51,6 +59,8 @@ void log(void *header, uint8_t flags) {
   uint8_t headerType = flags & 0x0E;
   uint8_t incoming = flags & 0x01;
 
+  pthread_mutex_lock(&logLock);
+
   switch(headerType) {
     case L_ARP:
       logArpHeader((arp_ipv4 *)header, incoming);
@@ -64,5 +74,7 @@ void log(void *header, uint8_t flags) {
     default:
       printf("Unidentified header type\n");
   }
+
+  pthread_mutex_unlock(&logLock);
 }
 
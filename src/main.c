@@ -6,7 +6,7 @@
  * Opens all the log files.
  * Initializes the network device(virtual/emulated) with IP and MAC address.
  * Initializes the TAP device to be used.
- * Receives ethernet frames over the network.
+ * Receives ethernet frames over the network, from one or several queues.
  * Calls various functions to handle the frame based on the type of request.
  */
 
@@ -17,80 +17,140 @@
 #include <unistd.h>
 #include <fcntl.h>
 
+#include "address_set.h"
 #include "arp.h"
-#include "ethernet.h"
-#include "icmp.h"
-#include "ip.h"
+#include "checksum.h"
+#include "config.h"
+#include "fib.h"
 #include "log.h"
 #include "netdev.h"
+#include "packet_buffer.h"
+#include "packet_mmap.h"
+#include "pipeline.h"
+#include "rate_limit.h"
+#include "reassembly.h"
+#include "rss.h"
 #include "tap.h"
-
-/*
- * @brief Handles the incoming frame.
- *
- *
- * Handles the incoming ethernet frame based on the type of payload.
- * Calls various functions designed to handle the ethernet packet.
- * Logs the incoming ethernet header for an ARP type payload.
- * Only ARP and IP type payloads are supported yet.
- *
- * @param[in] netdev A struct emulating a network device having an IP and a MAC address.
- * @param[in, out] header A struct having an apt structure using correct sizes to represent an ethernet header.
- * Various fields, such as source and destination address, underlying payload is modified depending on the type of request.
- */
-
-void handleFrame(Netdev *netdev, EthernetHeader *header) {
-
-  switch(header->payloadType) {
-    case ETH_P_ARP:
-      log(header, L_ETHERNET | L_INCOMING);
-      incomingRequest(netdev, header);
-      break;
-    case ETH_P_IP:
-      ipIncoming(netdev, header);
-      break;
-    default:
-      return;
-  }
-}
+#include "worker.h"
+#include "xsk.h"
 
 /**
  * @brief Entry point of the program.
  *
  *
+ * Parses the configuration from the command line arguments.
  * Opens the log files.
- * Initializes a TAP device, using a hardcoded name.
- * Initializes a vertual network device using hardcoded IP and MAC address.
+ * Initializes a TAP device, using a hardcoded name, or several when the
+ * stack forwards between devices, tapN answering as 10.0.N.4.
+ * Initializes a vertual network device per TAP device using hardcoded IP
+ * and MAC addresses.
+ * Creates the forwarding table shared by the devices, with a default route
+ * on the link of the first device, a route to the /24 of every device when
+ * there are several, and the routes of the route file.
  * Initializes the ARP cache.
- * Continually reads ethernet packets from the TAP device and initializes an ethernet header from it.
- * Handles every incoming frame.
+ * Preallocates the packet pool, large enough for every thread to fill its
+ * cache and hold a whole batch of every device at once, and for the rings
+ * of the workers to be full when the frames are spread by flow hash, as
+ * well as the transmit rings and the batches of the transmit thread when
+ * it writes the replies, and the packets queued on the neighbours being
+ * resolved.
+ * With a single queue, continually reads ethernet packets from the TAP
+ * device in the main thread and handles every incoming frame.
+ * With several queues, opens the TAP device in multi-queue mode and serves
+ * every queue from its own worker thread.
+ * When the frames are spread by flow hash, reads the single queue in the
+ * main thread and dispatches every frame to the worker thread of its flow,
+ * the replies being written by a transmit thread when a transmit batch is
+ * configured.
+ * Every queue is drained in batches when a batch size is configured, or
+ * through io_uring when io_uring reads are configured.
+ * When an existing interface is configured, opens packet sockets with
+ * TPACKET_V3 receive rings on it instead of the TAP device, joined in a
+ * fanout group when there are several queues.
+ * When AF_XDP is configured on an existing interface, attaches the XDP
+ * program redirecting its frames, and every worker opens the AF_XDP socket
+ * of its own queue of the interface.
+ *
+ * @param[in] argc The number of command line arguments.
+ * @param[in] argv The command line arguments.
  */
 
-int main() {
+int main(int argc, char **argv) {
+  Config config;
+
+  parseConfig(&config, argc, argv);
   openLogFiles();
 
-  Netdev netdev;
+  Netdev devices[MAX_DEVICES];
+  int queues[MAX_DEVICES][MAX_QUEUES];
+  Fib *routes = newFib();
+
+  addRoute(routes, 0, 0, 0, 0);
+
+  for (int device = 0; device < config.devices; device++) {
+    char name[20];
+    char address[20];
+    char mac[20];
+
+    snprintf(name, sizeof(name), "tap%d", device);
+    snprintf(address, sizeof(address), "10.0.%d.4", device);
+    snprintf(mac, sizeof(mac), "00:0c:29:6d:50:%02x", 0x25 + device);
 
-  char *name = calloc(20, 1);
-  strcpy(name, "tap0");
+    if (config.packetInterface != NULL) {
+      int fanout = config.queues > 1 ? getpid() : -1;
 
-  int tapDevice = initTap(name);
+      for (int queue = 0; queue < config.queues; queue++) {
+        queues[device][queue] = openPacketSocket(config.packetInterface, fanout);
+      }
+    }
+    else if (config.xdpInterface != NULL) {
+      attachXdpProgram(config.xdpInterface);
 
-  initNetdev(&netdev, tapDevice, "10.0.0.4", "00:0c:29:6d:50:25");
-  initArp();
+      for (int queue = 0; queue < config.queues; queue++) {
+        queues[device][queue] = -1;
+      }
+    }
+    else if (config.queues > 1) {
+      initTapQueues(name, queues[device], config.queues);
+    }
+    else {
+      queues[device][0] = initTap(name);
+    }
 
-  int size = 2500;
-  char *buffer = malloc(size);
+    initNetdev(&devices[device], queues[device][0], address, mac);
+    devices[device].mtu = config.mtu;
+    devices[device].index = device;
+    devices[device].routes = routes;
+
+    if (config.devices > 1) {
+      addRoute(routes, devices[device].address, 24, 0, device);
+    }
+  }
 
-  while (1) {
-    if (read(tapDevice, buffer, size) < 0) {
-      printf("Error reading: %s\n", strerror(errno));
+  for (int prefix = 0; prefix < config.localPrefixCount; prefix++) {
+    if (parseAddress(devices[0].locals, config.localPrefixes[prefix]) != 0) {
+      printf("Invalid address: %s\n", config.localPrefixes[prefix]);
       exit(1);
     }
+  }
 
-    EthernetHeader *header = initializeEthernet(buffer);	
+  if (config.localFile != NULL) {
+    loadAddresses(devices[0].locals, config.localFile);
+  }
 
-    handleFrame(&netdev, header);
+  if (config.routeFile != NULL) {
+    loadRoutes(routes, config.routeFile, config.devices);
   }
-}
 
+  initChecksum();
+  initArp(&devices[0], config.arpSnapshot);
+  setRateLimit(RATE_ARP, config.arpRate);
+  setRateLimit(RATE_ICMP, config.icmpRate);
+  setReassemblyLimit(config.fragments);
+  int threads = config.rssWorkers > 0 ? config.rssWorkers + 1 : config.queues;
+  int transmitted = config.txBatch > 0 ? config.rssWorkers * (PIPELINE_RING_LEN + config.batch) + config.txBatch + PACKET_CACHE_SIZE : 0;
+
+  initPacketPool(threads * (config.devices * config.batch + PACKET_CACHE_SIZE) + config.rssWorkers * RSS_RING_LEN + transmitted + config.fragments + ARP_PENDING_MAX);
+
+  startWorkers(devices, config.devices, queues, &config);
+}
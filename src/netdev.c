@@ -6,6 +6,12 @@
  * Initializes a virtual network device using the file descriptor, IP and
  * MAC address provided.
  * Writes an ethernet frame to the parent TUN/TAP device.
+ * Queues the frames of a batch and writes them together once the batch is
+ * handled.
+ * Hands the frames to io_uring when the device is served through io_uring,
+ * or to the transmit ring when the device is an AF_XDP socket.
+ * Hands the frames of a batch to the transmit thread instead when the
+ * pipeline has one.
  */
 
 #include <arpa/inet.h>
@@ -18,7 +24,10 @@
 #include "netdev.h"
 #include "ethernet.h"
 #include "log.h"
+#include "pipeline.h"
 #include "tap.h"
+#include "uring.h"
+#include "xsk.h"
 
 /**
  * @brief Initializes the virtual network device.
@@ -31,6 +40,10 @@
  * Network Byte Order(Big Endian).
  * Assigns the provided MAC address to the network device converting it to
  * uint8_t.
+ * Adds the IP address to the set of local addresses of the device, which
+ * more addresses and prefixes can be added to.
+ * The device starts as device 0, without a forwarding table.
+ * Sets the MTU of the device to NETDEV_MTU.
  *
  * @param[in, out] netdev A struct respresenting a virtual/emulated network
  * device.
@@ -46,7 +59,7 @@
  */
 
 void initNetdev(Netdev *netdev, int device, char *ipAddress, char *macAddress) {
-  memset(netdev, 0, sizeof(netdev));
+  memset(netdev, 0, sizeof(*netdev));
   netdev->deviceDescriptor = device;
   if (inet_pton(AF_INET, ipAddress, &netdev->address) != 1) {
     printf("Parsing failed\n");
@@ -60,6 +73,10 @@ void initNetdev(Netdev *netdev, int device, char *ipAddress, char *macAddress) {
       &netdev->macOctets[3], 
       &netdev->macOctets[4], 
       &netdev->macOctets[5]);
+
+  netdev->mtu = NETDEV_MTU;
+  netdev->locals = newAddressSet();
+  addAddress(netdev->locals, netdev->address, 32);
 }
 
 /**
@@ -72,7 +89,13 @@ void initNetdev(Netdev *netdev, int device, char *ipAddress, char *macAddress) {
  * Adds the size of the ethernet header to the total length of the
  * packet/frame.
  * Logs the outgoing ethernet header.
- * Writes the ethernet header to the TUN/TAP device of the device provided.
+ * Writes the ethernet header to the TUN/TAP device of the device provided,
+ * or queues it until the end of the batch if the device batches its
+ * transmissions.
+ * Submits the write through io_uring instead, without blocking, if the
+ * device has an io_uring instance.
+ * Posts the frame to the transmit ring instead if the device is an AF_XDP
+ * socket, without copying a frame rewritten in place.
  *
  * @param[in] netdev A struct emulating a network device.
  * The MAC address of netdev is used as source address, as the frame is
@@ -99,7 +122,202 @@ void transmitNetdev(Netdev *netdev, EthernetHeader *ethHeader, uint16_t ethertyp
   length += sizeof(EthernetHeader);
 
   log(ethHeader, L_ETHERNET);
+  sendNetdev(netdev, (char *)ethHeader, length);
+}
+
+/**
+ * @brief Transmits a complete frame through the network device, as it is.
+ *
+ *
+ * Neither rewrites nor logs the ethernet header, for the frames built from
+ * a template.
+ * Writes the frame to the TUN/TAP device of the device provided, or queues
+ * it until the end of the batch if the device batches its transmissions.
+ * Submits the write through io_uring instead, without blocking, if the
+ * device has an io_uring instance.
+ * Posts the frame to the transmit ring instead if the device is an AF_XDP
+ * socket, without copying a frame rewritten in place.
+ *
+ * @param[in] netdev A struct emulating a network device.
+ * @param[in] frame The frame, starting with its ethernet header.
+ * @param[in] length The length of the frame.
+ */
+
+void sendNetdev(Netdev *netdev, char *frame, int length) {
+  if (netdev->uring != NULL) {
+    transmitUring(netdev->uring, frame, length);
+    return;
+  }
+
+  if (netdev->xsk != NULL) {
+    transmitXsk(netdev->xsk, frame, length);
+    return;
+  }
+
+  TxBatch *batch = netdev->txBatch;
+
+  if (batch == NULL) {
+    write(netdev->deviceDescriptor, frame, length);
+    return;
+  }
+
+  if (batch->count == batch->capacity) {
+    flushNetdev(netdev);
+  }
+
+  TxFrame *queued = &batch->frames[batch->count++];
+
+  queued->parts[0].iov_base = frame;
+  queued->parts[0].iov_len = length;
+  queued->count = 1;
+}
+
+/**
+ * @brief Transmits a frame made of headers and of a payload stored apart,
+ * such as a fragment of a larger packet.
+ *
+ *
+ * Only the headers are copied, the payload is gathered from where it is
+ * when the frame is written.
+ * Writes the frame right away with writev() if the device does not batch
+ * its transmissions.
+ * Queues a writev of a copy of the frame on io_uring instead, without
+ * blocking, if the device has an io_uring instance.
+ * Otherwise queues it until the end of the batch, the headers being copied
+ * into the batch.
+ * Gathers the frame into a single buffer first if the device is an AF_XDP
+ * socket, whose transmit ring takes contiguous frames.
+ *
+ * @param[in] netdev A struct emulating a network device.
+ * @param[in] header The headers, starting with the ethernet header.
+ * @param[in] headerLength The length of the headers, TX_HEADER_LEN at most.
+ * @param[in] payload The payload.
+ * @param[in] payloadLength The length of the payload.
+ * @pre The payload stays valid until the device is flushed.
+ */
+
+void sendNetdevParts(Netdev *netdev, char *header, int headerLength, char *payload, int payloadLength) {
+  if (netdev->xsk != NULL) {
+    char frame[XSK_FRAME_SIZE];
+
+    if (headerLength + payloadLength > XSK_FRAME_SIZE) {
+      return;
+    }
+
+    memcpy(frame, header, headerLength);
+    memcpy(frame + headerLength, payload, payloadLength);
+    transmitXsk(netdev->xsk, frame, headerLength + payloadLength);
+    return;
+  }
+
+  TxBatch *batch = netdev->txBatch;
+  struct iovec parts[2] = {
+    {.iov_base = header, .iov_len = headerLength},
+    {.iov_base = payload, .iov_len = payloadLength},
+  };
+
+  if (netdev->uring != NULL) {
+    transmitUringParts(netdev->uring, parts, 2);
+    return;
+  }
+
+  if (batch == NULL) {
+    writev(netdev->deviceDescriptor, parts, 2);
+    return;
+  }
+
+  if (batch->count == batch->capacity) {
+    flushNetdev(netdev);
+  }
+
+  TxFrame *queued = &batch->frames[batch->count++];
+
+  memcpy(queued->header, header, headerLength);
+  queued->parts[0].iov_base = queued->header;
+  queued->parts[0].iov_len = headerLength;
+  queued->parts[1].iov_base = payload;
+  queued->parts[1].iov_len = payloadLength;
+  queued->count = 2;
+}
+
+/**
+ * @brief Allocates a transmit batch for the network device.
+ *
+ *
+ * Once the batch is allocated, the frames transmitted are queued until the
+ * device is flushed.
+ *
+ * @param[in, out] netdev A struct emulating a network device.
+ * @param[in] capacity Maximum number of frames queued before the device is
+ * flushed.
+ */
+
+void initTxBatch(Netdev *netdev, int capacity) {
+  TxBatch *batch = malloc(sizeof(TxBatch));
+
+  batch->frames = calloc(capacity, sizeof(TxFrame));
+  batch->count = 0;
+  batch->capacity = capacity;
+
+  netdev->txBatch = batch;
+}
+
+/**
+ * @brief Writes every frame queued on the network device.
+ *
+ *
+ * Writes the queued frames in the order they were transmitted, and empties
+ * the batch.
+ * A TAP device takes exactly one frame per write, so the frames are written
+ * one after another, each gathered from its parts, but none of them is
+ * written while the batch is still being received and handled.
+ * Hands them to the transmit thread instead if the device has a transmit
+ * ring, so the worker does not wait for the writes.
+ * Does nothing if the device does not batch its transmissions.
+ *
+ * @param[in] netdev A struct emulating a network device.
+ * @pre The buffers the queued frames point into are still valid.
+ */
+
+void flushNetdev(Netdev *netdev) {
+  TxBatch *batch = netdev->txBatch;
+
+  if (batch == NULL) {
+    return;
+  }
 
-  write(netdev->deviceDescriptor, (char *)ethHeader, length);
+  if (netdev->txRing != NULL) {
+    pushPipeline(netdev->txRing, netdev);
+    return;
+  }
+
+  for (int index = 0; index < batch->count; index++) {
+    writev(netdev->deviceDescriptor, batch->frames[index].parts, batch->frames[index].count);
+  }
+
+  batch->count = 0;
 }
 
+
+/**
+ * @brief Returns the calling worker's copy of a network device, by its
+ * index.
+ *
+ *
+ * The copies of a worker share their array of devices, so the frames sent
+ * through the copy returned are queued on the worker's own transmit batch
+ * of that device.
+ *
+ * @param[in] netdev A copy of a network device of the worker.
+ * @param[in] device The index of the network device.
+ * @return The worker's copy of the device, or the copy provided if the
+ * device is not copied for a worker or the index is unknown.
+ */
+
+Netdev *peerNetdev(Netdev *netdev, int device) {
+  if (netdev->devices == NULL || device < 0 || device >= netdev->deviceCount) {
+    return netdev;
+  }
+
+  return &netdev->devices[device];
+}
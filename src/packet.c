@@ -0,0 +1,128 @@
+/**
+ * @file packet.c
+ * @author Aryan Chopra
+ * @brief Parses a received frame into the descriptor carried through the
+ * layers.
+ *
+ * The ethernet, ARP and IP headers are parsed once, and their lengths and
+ * fields are recorded in host order in the descriptor, so no layer swaps
+ * the bytes of the frame or derives the offsets again.
+ */
+
+#include <arpa/inet.h>
+#include <string.h>
+
+#include "arp.h"
+#include "ethernet.h"
+#include "ip.h"
+#include "packet.h"
+
+/**
+ * @brief Parses the ARP header carried by the frame.
+ *
+ * @param[in, out] packet The descriptor of the frame.
+ * @return 0 if the ARP header and its data fit in the frame, -1 otherwise.
+ */
+
+static int parseArp(Packet *packet) {
+  ArpHeader *arpHeader = (ArpHeader *) packet->ethernet->payload;
+
+  if (packet->length < packet->networkOffset + (int) (sizeof(ArpHeader) + sizeof(arp_ipv4))) {
+    return -1;
+  }
+
+  packet->networkLength = sizeof(ArpHeader) + sizeof(arp_ipv4);
+  packet->hardwareType = ntohs(arpHeader->hardwareType);
+  packet->opcode = ntohs(arpHeader->opcode);
+
+  if (ntohs(arpHeader->protocol) != ARP_IPV4) {
+    return -1;
+  }
+
+  packet->flags |= PACKET_ARP;
+  return 0;
+}
+
+/**
+ * @brief Parses the IP header carried by the frame.
+ *
+ * @param[in, out] packet The descriptor of the frame.
+ * @return 0 if the frame carries an IPv4 header whose lengths fit in the
+ * frame, -1 otherwise.
+ */
+
+static int parseIp(Packet *packet) {
+  IpHeader *ipHeader = (IpHeader *) packet->ethernet->payload;
+
+  if (packet->length < packet->networkOffset + (int) sizeof(IpHeader)) {
+    return -1;
+  }
+
+  if (ipHeader->version != IPV4 || ipHeader->headerLength < 5) {
+    return -1;
+  }
+
+  int headerLength = ipHeader->headerLength * 4;
+  int totalLength = ntohs(ipHeader->totalLength);
+
+  if (totalLength < headerLength || packet->networkOffset + totalLength > packet->length) {
+    return -1;
+  }
+
+  packet->networkLength = totalLength;
+  packet->transportOffset = packet->networkOffset + headerLength;
+  packet->transportLength = totalLength - headerLength;
+  packet->protocol = ipHeader->protocol;
+
+  uint16_t fragment = ipFragment(ipHeader);
+
+  packet->fragmentOffset = (fragment & IP_OFFSET_MASK) * 8;
+
+  if (fragment & (IP_MORE_FRAGMENTS | IP_OFFSET_MASK)) {
+    packet->flags |= PACKET_FRAGMENT;
+  }
+
+  if (fragment & IP_MORE_FRAGMENTS) {
+    packet->flags |= PACKET_MORE_FRAGMENTS;
+  }
+
+  packet->flags |= PACKET_IPV4;
+  return 0;
+}
+
+/**
+ * @brief Parses a received frame into its descriptor.
+ *
+ *
+ * Records the ethertype, and the offsets and lengths of the ARP or IP
+ * header, converted to host order, without modifying the frame.
+ * Checks that the headers found fit in the frame received.
+ * Frames of any other ethertype are only described down to their ethertype.
+ *
+ * @param[out] packet The descriptor of the frame.
+ * @param[in] frame The frame received.
+ * @param[in] length The length of the frame received.
+ * @return 0 if the frame can be handled, -1 if it is truncated or malformed.
+ */
+
+int parsePacket(Packet *packet, char *frame, int length) {
+  memset(packet, 0, sizeof(*packet));
+
+  if (length < (int) sizeof(EthernetHeader)) {
+    return -1;
+  }
+
+  packet->ethernet = initializeEthernet(frame);
+  packet->length = length;
+  packet->ethertype = ntohs(packet->ethernet->payloadType);
+  packet->networkOffset = sizeof(EthernetHeader);
+
+  switch (packet->ethertype) {
+    case ETH_P_ARP:
+      return parseArp(packet);
+    case ETH_P_IP:
+      return parseIp(packet);
+    default:
+      return 0;
+  }
+}
@@ -0,0 +1,223 @@
+/**
+ * @file packet_buffer.c
+ * @author Aryan Chopra
+ * @brief A preallocated pool of fixed-size packet buffers, with headroom,
+ * tailroom and reference counts.
+ *
+ * Every buffer is allocated once, when the pool is created, so frames can be
+ * received, queued, deferred and handed between threads without any
+ * allocation on the hot path.
+ * Every core keeps a cache of free buffers which only the core itself
+ * touches, so allocating and freeing a buffer takes no lock.
+ * The shared pool is only locked to move buffers between a cache and the
+ * pool in bulk, once a cache runs empty or full.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "packet_buffer.h"
+
+/**
+ * The free buffers of the shared pool, and the lock guarding them.
+ */
+
+static PacketBuffer **pool;
+static int poolCount;
+static pthread_mutex_t poolLock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * The free buffers cached by the calling core, used without any lock.
+ */
+
+static __thread PacketBuffer *cache[PACKET_CACHE_SIZE];
+static __thread int cacheCount;
+
+/**
+ * @brief Preallocates the pool of packet buffers shared by all the cores.
+ *
+ *
+ * Allocates every buffer in one cache-aligned block, so no buffer is ever
+ * allocated on the receive path.
+ * Prints the error and exits the process if the pool cannot be allocated.
+ *
+ * @param[in] count The number of buffers of the pool.
+ */
+
+void initPacketPool(int count) {
+  PacketBuffer *buffers = aligned_alloc(64, (size_t) count * sizeof(PacketBuffer));
+
+  pool = malloc((size_t) count * sizeof(PacketBuffer *));
+
+  if (buffers == NULL || pool == NULL) {
+    printf("Could not allocate %d packet buffers\n", count);
+    exit(1);
+  }
+
+  for (int index = 0; index < count; index++) {
+    pool[index] = &buffers[index];
+  }
+
+  poolCount = count;
+}
+
+/**
+ * @brief Moves up to a bulk of buffers from the shared pool to the calling
+ * core's cache.
+ */
+
+static void refillCache() {
+  pthread_mutex_lock(&poolLock);
+
+  while (cacheCount < PACKET_CACHE_BULK && poolCount > 0) {
+    cache[cacheCount++] = pool[--poolCount];
+  }
+
+  pthread_mutex_unlock(&poolLock);
+}
+
+/**
+ * @brief Moves a bulk of buffers from the calling core's cache to the shared
+ * pool.
+ */
+
+static void spillCache() {
+  pthread_mutex_lock(&poolLock);
+
+  while (cacheCount > PACKET_CACHE_SIZE - PACKET_CACHE_BULK) {
+    pool[poolCount++] = cache[--cacheCount];
+  }
+
+  pthread_mutex_unlock(&poolLock);
+}
+
+/**
+ * @brief Takes a free buffer from the pool.
+ *
+ *
+ * Takes the buffer from the calling core's cache, without any lock, and
+ * refills the cache from the shared pool in bulk once it is empty.
+ * The buffer is returned with a single reference, an empty frame, and the
+ * whole headroom in front of it.
+ *
+ * @return The buffer, or NULL if the pool is exhausted.
+ */
+
+PacketBuffer *allocPacket(void) {
+  if (cacheCount == 0) {
+    refillCache();
+
+    if (cacheCount == 0) {
+      return NULL;
+    }
+  }
+
+  PacketBuffer *buffer = cache[--cacheCount];
+
+  buffer->data = buffer->room + PACKET_HEADROOM;
+  buffer->length = 0;
+  buffer->references = 1;
+  buffer->next = NULL;
+
+  return buffer;
+}
+
+/**
+ * @brief Takes one more reference on a buffer.
+ *
+ *
+ * The reference count is atomic, as a buffer handed to another thread can
+ * be released by both.
+ *
+ * @param[in, out] buffer The buffer.
+ */
+
+void holdPacket(PacketBuffer *buffer) {
+  __atomic_add_fetch(&buffer->references, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Releases one reference on a buffer.
+ *
+ *
+ * Puts the buffer back in the calling core's cache once the last reference
+ * is released, and spills part of the cache to the shared pool in bulk once
+ * it is full.
+ *
+ * @param[in, out] buffer The buffer.
+ */
+
+void freePacket(PacketBuffer *buffer) {
+  if (__atomic_sub_fetch(&buffer->references, 1, __ATOMIC_ACQ_REL) != 0) {
+    return;
+  }
+
+  if (cacheCount == PACKET_CACHE_SIZE) {
+    spillCache();
+  }
+
+  cache[cacheCount++] = buffer;
+}
+
+/**
+ * @brief Grows the frame at its front, into the headroom.
+ *
+ * @param[in, out] buffer The buffer.
+ * @param[in] length The number of bytes to prepend.
+ * @return The new start of the frame, or NULL if the headroom is too small.
+ */
+
+char *prependPacket(PacketBuffer *buffer, int length) {
+  if (length > packetHeadroom(buffer)) {
+    return NULL;
+  }
+
+  buffer->data -= length;
+  buffer->length += length;
+
+  return buffer->data;
+}
+
+/**
+ * @brief Grows the frame at its end, into the tailroom.
+ *
+ * @param[in, out] buffer The buffer.
+ * @param[in] length The number of bytes to append.
+ * @return The start of the bytes appended, or NULL if the tailroom is too
+ * small.
+ */
+
+char *appendPacket(PacketBuffer *buffer, int length) {
+  if (length > packetTailroom(buffer)) {
+    return NULL;
+  }
+
+  char *tail = buffer->data + buffer->length;
+
+  buffer->length += length;
+
+  return tail;
+}
+
+/**
+ * @brief Returns the room left in front of the frame.
+ *
+ * @param[in] buffer The buffer.
+ * @return The headroom, in bytes.
+ */
+
+int packetHeadroom(PacketBuffer *buffer) {
+  return buffer->data - buffer->room;
+}
+
+/**
+ * @brief Returns the room left after the frame.
+ *
+ * @param[in] buffer The buffer.
+ * @return The tailroom, in bytes.
+ */
+
+int packetTailroom(PacketBuffer *buffer) {
+  return buffer->room + sizeof(buffer->room) - (buffer->data + buffer->length);
+}
@@ -0,0 +1,212 @@
+/**
+ * @file packet_mmap.c
+ * @author Aryan Chopra
+ * @brief Receives the frames of an existing interface through a PACKET_MMAP
+ * TPACKET_V3 ring.
+ *
+ * The kernel writes the frames of the interface into blocks of a ring
+ * shared with the process, so the frames are handled in place instead of
+ * being copied into a receive buffer by read().
+ * The replies are built in place in the ring too, and written to the packet
+ * socket, which transmits them on the interface.
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "packet_mmap.h"
+
+/**
+ * @brief Prints the error of a failed call on the packet socket and exits the
+ * process.
+ *
+ * @param[in] call A description of the call which failed.
+ */
+
+static void packetError(char *call) {
+  printf("Error %s: %s\n", call, strerror(errno));
+  exit(1);
+}
+
+/**
+ * @brief Opens a packet socket with a TPACKET_V3 receive ring on an existing
+ * interface.
+ *
+ *
+ * Sets the socket to TPACKET_V3 and requests the receive ring.
+ * Binds the socket to the interface provided, receiving every ethertype.
+ * Puts the interface in promiscuous mode, as the stack answers with its own
+ * MAC address, not the interface's.
+ * Ignores the frames transmitted by the stack itself.
+ * Joins the fanout group provided if it is not negative, so several sockets
+ * share the frames of the interface, a flow always reaching the same socket.
+ * Prints the error and exits the process on failure.
+ *
+ * @param[in] name The name of the interface, eg. one end of a veth pair.
+ * @param[in] fanout The fanout group to join, or -1 for none.
+ * @return The file descriptor of the packet socket.
+ */
+
+int openPacketSocket(char *name, int fanout) {
+  int version = TPACKET_V3;
+  int ignore = 1;
+  struct tpacket_req3 request;
+  struct sockaddr_ll address;
+  struct packet_mreq membership;
+
+  int device = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+  if (device < 0) {
+    packetError("opening packet socket");
+  }
+
+  if (setsockopt(device, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0) {
+    packetError("setting TPACKET_V3");
+  }
+
+  memset(&request, 0, sizeof(request));
+  request.tp_block_size = PACKET_BLOCK_SIZE;
+  request.tp_block_nr = PACKET_BLOCK_COUNT;
+  request.tp_frame_size = PACKET_FRAME_SIZE;
+  request.tp_frame_nr = (PACKET_BLOCK_SIZE / PACKET_FRAME_SIZE) * PACKET_BLOCK_COUNT;
+  request.tp_retire_blk_tov = PACKET_BLOCK_TIMEOUT;
+
+  if (setsockopt(device, SOL_PACKET, PACKET_RX_RING, &request, sizeof(request)) < 0) {
+    packetError("requesting the receive ring");
+  }
+
+  memset(&address, 0, sizeof(address));
+  address.sll_family = AF_PACKET;
+  address.sll_protocol = htons(ETH_P_ALL);
+  address.sll_ifindex = if_nametoindex(name);
+
+  if (address.sll_ifindex == 0) {
+    packetError("finding the interface");
+  }
+
+  if (bind(device, (struct sockaddr *) &address, sizeof(address)) < 0) {
+    packetError("binding packet socket");
+  }
+
+  memset(&membership, 0, sizeof(membership));
+  membership.mr_ifindex = address.sll_ifindex;
+  membership.mr_type = PACKET_MR_PROMISC;
+
+  if (setsockopt(device, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &membership, sizeof(membership)) < 0) {
+    packetError("setting promiscuous mode");
+  }
+
+  if (setsockopt(device, SOL_PACKET, PACKET_IGNORE_OUTGOING, &ignore, sizeof(ignore)) < 0) {
+    packetError("ignoring outgoing frames");
+  }
+
+  if (fanout >= 0) {
+    int group = (fanout & 0xffff) | (PACKET_FANOUT_HASH << 16);
+
+    if (setsockopt(device, SOL_PACKET, PACKET_FANOUT, &group, sizeof(group)) < 0) {
+      packetError("joining the fanout group");
+    }
+  }
+
+  return device;
+}
+
+/**
+ * @brief Maps the receive ring of a packet socket.
+ *
+ *
+ * Prints the error and exits the process if the ring cannot be mapped.
+ *
+ * @param[in] device The file descriptor of a socket opened by openPacketSocket.
+ * @return The mapped ring.
+ */
+
+PacketRing *mapPacketRing(int device) {
+  PacketRing *ring = calloc(1, sizeof(PacketRing));
+
+  ring->socketDescriptor = device;
+  ring->ring = mmap(NULL, (size_t) PACKET_BLOCK_SIZE * PACKET_BLOCK_COUNT, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED, device, 0);
+
+  if (ring->ring == MAP_FAILED) {
+    ring->ring = mmap(NULL, (size_t) PACKET_BLOCK_SIZE * PACKET_BLOCK_COUNT, PROT_READ | PROT_WRITE, MAP_SHARED, device, 0);
+  }
+
+  if (ring->ring == MAP_FAILED) {
+    packetError("mapping the receive ring");
+  }
+
+  return ring;
+}
+
+/**
+ * @brief Waits for a block of the ring and handles every frame in it.
+ *
+ *
+ * Waits until the kernel hands the next block over to the stack, which it
+ * does once the block is full or its timeout expires, or until the timeout
+ * provided expires.
+ * Calls the handler provided for every frame of the block, in place in the
+ * ring, without copying the frame.
+ * The block stays with the stack until it is released, so the replies built
+ * in it can be written after the whole block is handled.
+ *
+ * @param[in, out] ring The ring to receive from.
+ * @param[in] handler The handler called for every frame.
+ * @param[in] context The context passed to the handler.
+ * @param[in] timeout The milliseconds to wait at most for the block.
+ * @return The number of frames handled, or -1 if the kernel did not hand
+ * the block over before the timeout.
+ */
+
+int receivePacketBlock(PacketRing *ring, void (*handler)(void *, char *, int), void *context, int timeout) {
+  struct tpacket_block_desc *block = (struct tpacket_block_desc *) (ring->ring + (size_t) ring->block * PACKET_BLOCK_SIZE);
+
+  if (!(__atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER)) {
+    struct pollfd socket = {.fd = ring->socketDescriptor, .events = POLLIN | POLLERR};
+
+    if (poll(&socket, 1, timeout) < 0 && errno != EINTR) {
+      packetError("polling the receive ring");
+    }
+
+    if (!(__atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER)) {
+      return -1;
+    }
+  }
+
+  int count = block->hdr.bh1.num_pkts;
+  struct tpacket3_hdr *header = (struct tpacket3_hdr *) ((char *) block + block->hdr.bh1.offset_to_first_pkt);
+
+  for (int index = 0; index < count; index++) {
+    handler(context, (char *) header + header->tp_mac, header->tp_snaplen);
+    header = (struct tpacket3_hdr *) ((char *) header + header->tp_next_offset);
+  }
+
+  return count;
+}
+
+/**
+ * @brief Hands the block received last back to the kernel.
+ *
+ *
+ * The replies written to the socket are copied by the kernel on the write,
+ * so the block can be reused as soon as they are written.
+ *
+ * @param[in, out] ring The ring the block belongs to.
+ * @pre Every reply built in the block has been written.
+ */
+
+void releasePacketBlock(PacketRing *ring) {
+  struct tpacket_block_desc *block = (struct tpacket_block_desc *) (ring->ring + (size_t) ring->block * PACKET_BLOCK_SIZE);
+
+  __atomic_store_n(&block->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+  ring->block = (ring->block + 1) % PACKET_BLOCK_COUNT;
+}
@@ -0,0 +1,274 @@
+/**
+ * @file pipeline.c
+ * @author Aryan Chopra
+ * @brief Writes the frames transmitted by the workers from a thread of its
+ * own, and counts the frames going through the pipeline.
+ *
+ * With the dispatcher receiving the frames and the workers handling them,
+ * the transmit thread makes the third stage of the pipeline, so a slow
+ * write() to the TAP device delays neither the receiving nor the handling
+ * of the next frames.
+ * Every worker pushes its frames to a ring of its own, which only the
+ * transmit thread pops from, so every ring keeps a single producer and a
+ * single consumer.
+ * A worker finding its ring full waits for the transmit thread, and the
+ * dispatcher finding the ring of a worker full drops the frame, so the
+ * backpressure of a slow device ends in frames dropped at the receive side
+ * rather than in the queue stalling, and every stall and drop is counted.
+ */
+
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "packet_buffer.h"
+#include "pipeline.h"
+#include "rate_limit.h"
+#include "timer.h"
+
+/**
+ * The counters of the pipeline, each on its own cache line as they are
+ * written by different threads.
+ */
+
+static struct {
+  uint64_t value __attribute__((aligned(64)));
+} counters[PIPELINE_COUNTERS];
+
+/**
+ * @brief Adds to a counter of the pipeline.
+ *
+ * @param[in] counter The counter, one of the PIPELINE_ counters.
+ * @param[in] amount The amount added.
+ */
+
+void countPipeline(int counter, uint64_t amount) {
+  __atomic_fetch_add(&counters[counter].value, amount, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Returns the value of a counter of the pipeline.
+ *
+ * @param[in] counter The counter, one of the PIPELINE_ counters.
+ * @return The value of the counter.
+ */
+
+uint64_t pipelineCount(int counter) {
+  return __atomic_load_n(&counters[counter].value, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Prints the counters of the pipeline, and the requests dropped by
+ * the rate limits, at most once every PIPELINE_REPORT_MS, and only when
+ * they changed.
+ *
+ *
+ * Called by a single thread.
+ */
+
+void reportPipeline() {
+  static uint64_t lastReport;
+  static uint64_t reported[PIPELINE_COUNTERS];
+  static uint64_t rateReported[RATE_PROTOCOLS];
+  uint64_t now = timerNow();
+  int changed = 0;
+  int rateChanged = 0;
+
+  if (now - lastReport < TIMER_TICKS(PIPELINE_REPORT_MS)) {
+    return;
+  }
+
+  lastReport = now;
+
+  for (int counter = 0; counter < PIPELINE_COUNTERS; counter++) {
+    uint64_t value = pipelineCount(counter);
+
+    changed |= value != reported[counter];
+    reported[counter] = value;
+  }
+
+  for (int protocol = 0; protocol < RATE_PROTOCOLS; protocol++) {
+    uint64_t value = rateDrops(protocol);
+
+    rateChanged |= value != rateReported[protocol];
+    rateReported[protocol] = value;
+  }
+
+  if (rateChanged) {
+    printf("Rate limits: %lu ARP and %lu ICMP requests dropped\n", rateReported[RATE_ARP], rateReported[RATE_ICMP]);
+  }
+
+  if (changed) {
+    printf("Pipeline: %lu dispatched, %lu dropped on a full worker ring, %lu transmitted, %lu stalls on a full transmit ring, %lu replies and %lu frames received dropped on an exhausted pool, %lu packets dropped waiting for ARP resolution\n",
+        reported[PIPELINE_RX_FRAMES], reported[PIPELINE_RX_DROPS], reported[PIPELINE_TX_FRAMES], reported[PIPELINE_TX_STALLS], reported[PIPELINE_TX_DROPS], reported[PIPELINE_POOL_DROPS], reported[PIPELINE_ARP_DROPS]);
+  }
+}
+
+/**
+ * @brief Continually writes the frames the workers push to their rings.
+ *
+ *
+ * Pops up to a batch of frames from every ring per pass, writes them one
+ * after another, as a TAP device takes exactly one frame per write, and
+ * releases their buffers.
+ * Sleeps on every ring at once for a timer tick at most while they are all
+ * empty.
+ *
+ * @param[in] argument The transmit thread.
+ * @return Never returns.
+ */
+
+static void *transmitThread(void *argument) {
+  Transmitter *transmitter = argument;
+  PacketBuffer *buffers[MAX_BATCH];
+
+  while (1) {
+    uint64_t written = 0;
+
+    for (int ring = 0; ring < transmitter->count; ring++) {
+      int count = popSpscRing(transmitter->rings[ring], (void **) buffers, transmitter->batch);
+
+      for (int index = 0; index < count; index++) {
+        write(transmitter->descriptor, buffers[index]->data, buffers[index]->length);
+        freePacket(buffers[index]);
+      }
+
+      written += count;
+    }
+
+    if (written == 0) {
+      waitSpscRings(transmitter->rings, transmitter->count, TIMER_TICK_MS);
+    }
+    else {
+      countPipeline(PIPELINE_TX_FRAMES, written);
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * @brief Starts the thread writing the frames the workers transmit.
+ *
+ *
+ * Allocates one ring per worker, which the worker's copy of the device
+ * pushes its frames to instead of writing them.
+ * Prints the error and exits the process if the thread cannot be started.
+ *
+ * @param[in] descriptor File descriptor of the TAP queue the frames are
+ * written to.
+ * @param[in] count Number of workers, SPSC_WAIT_RINGS at most.
+ * @param[in] batch Maximum number of frames popped from a ring per pass.
+ * @return The transmit thread.
+ */
+
+Transmitter *startTransmitter(int descriptor, int count, int batch) {
+  Transmitter *transmitter = malloc(sizeof(Transmitter));
+
+  if (transmitter == NULL || (transmitter->rings = calloc(count, sizeof(SpscRing *))) == NULL) {
+    printf("Could not allocate the transmit thread\n");
+    exit(1);
+  }
+
+  transmitter->descriptor = descriptor;
+  transmitter->count = count;
+  transmitter->batch = batch;
+
+  for (int ring = 0; ring < count; ring++) {
+    transmitter->rings[ring] = newSpscRing(PIPELINE_RING_LEN);
+  }
+
+  if (pthread_create(&transmitter->thread, NULL, transmitThread, transmitter) != 0) {
+    printf("Could not start the transmit thread\n");
+    exit(1);
+  }
+
+  return transmitter;
+}
+
+/**
+ * @brief Gathers a queued frame into a buffer of the packet pool.
+ *
+ * @param[in] frame The queued frame.
+ * @return The buffer holding the frame, or NULL if the pool is exhausted or
+ * the frame is larger than a buffer.
+ */
+
+static PacketBuffer *gatherFrame(TxFrame *frame) {
+  PacketBuffer *buffer = allocPacket();
+
+  if (buffer == NULL) {
+    return NULL;
+  }
+
+  for (int part = 0; part < frame->count; part++) {
+    char *data = appendPacket(buffer, frame->parts[part].iov_len);
+
+    if (data == NULL) {
+      freePacket(buffer);
+      return NULL;
+    }
+
+    memcpy(data, frame->parts[part].iov_base, frame->parts[part].iov_len);
+  }
+
+  return buffer;
+}
+
+/**
+ * @brief Hands every frame queued on a device to the transmit thread.
+ *
+ *
+ * Copies every frame into a buffer of the packet pool, so the buffers the
+ * frames point into can be reused as soon as the device is flushed.
+ * A frame larger than a buffer, which only a jumbo MTU makes, is written
+ * by the worker itself instead.
+ * A frame no buffer is left for is dropped and counted.
+ * Pushes the frames in one burst, and yields to the transmit thread while
+ * the ring is full, counting every time the worker had to wait, so a slow
+ * TAP device slows the worker down rather than losing its replies.
+ * Empties the batch.
+ *
+ * @param[in, out] ring The ring of the worker.
+ * @param[in, out] netdev The worker's copy of the device.
+ */
+
+void pushPipeline(SpscRing *ring, Netdev *netdev) {
+  TxBatch *batch = netdev->txBatch;
+  PacketBuffer *buffers[MAX_BATCH];
+  int count = 0;
+  int pushed = 0;
+
+  for (int index = 0; index < batch->count; index++) {
+    TxFrame *frame = &batch->frames[index];
+    int length = 0;
+
+    for (int part = 0; part < frame->count; part++) {
+      length += frame->parts[part].iov_len;
+    }
+
+    if (length > PACKET_DATA_SIZE) {
+      writev(netdev->deviceDescriptor, frame->parts, frame->count);
+      continue;
+    }
+
+    buffers[count] = gatherFrame(frame);
+
+    if (buffers[count] == NULL) {
+      countPipeline(PIPELINE_TX_DROPS, 1);
+      continue;
+    }
+
+    count++;
+  }
+
+  batch->count = 0;
+
+  while ((pushed += pushSpscRing(ring, (void **) buffers + pushed, count - pushed)) < count) {
+    countPipeline(PIPELINE_TX_STALLS, 1);
+    sched_yield();
+  }
+}
@@ -0,0 +1,226 @@
+/**
+ * @file rate_limit.c
+ * @author Aryan Chopra
+ * @brief Per-source token buckets limiting the ARP and ICMP requests the
+ * stack answers, so one host flooding it cannot starve the others.
+ *
+ * Every worker keeps its own buckets, so taking a token needs neither a
+ * lock nor an atomic operation, and a source is limited on every queue it
+ * is spread over.
+ * The buckets of a protocol are a set-associative table: a source hashes to
+ * a set of four buckets filling one cache line, and takes over the bucket
+ * of the set idle for the longest time when it has none, so a request
+ * touches a single cache line whatever the number of sources.
+ * Tokens are counted in thousandths, so a bucket refills at the resolution
+ * of the timer ticks without rounding away slow rates.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash.h"
+#include "rate_limit.h"
+#include "timer.h"
+
+#define RATE_COST 1000 ///Thousandths of a token taken by a request.
+
+/**
+ * @struct RateBucket
+ * @brief A struct holding the token bucket of one source.
+ *
+ * @var RateBucket::source
+ * The source owning the bucket.
+ *
+ * @var RateBucket::tokens
+ * Thousandths of a token left in the bucket.
+ *
+ * @var RateBucket::stamp
+ * The millisecond the bucket was last refilled at, always odd, 0 while the
+ * bucket is unused.
+ *
+ * @var RateBucket::drops
+ * Number of requests of the source dropped.
+ */
+
+typedef struct {
+  uint32_t source;
+  uint32_t tokens;
+  uint32_t stamp;
+  uint32_t drops;
+} RateBucket;
+
+/**
+ * @struct RateTable
+ * @brief A struct holding the buckets and counters of one worker.
+ *
+ * @var RateTable::buckets
+ * The sets of buckets of every protocol, each set on its own cache line.
+ *
+ * @var RateTable::dropped
+ * Number of requests of every protocol dropped.
+ */
+
+typedef struct {
+  RateBucket buckets[RATE_PROTOCOLS][RATE_SETS][RATE_WAYS];
+  uint64_t dropped[RATE_PROTOCOLS];
+} RateTable;
+
+/**
+ * The rate and burst of every protocol, in thousandths of a token.
+ */
+
+static uint32_t rates[RATE_PROTOCOLS];
+static uint32_t bursts[RATE_PROTOCOLS];
+
+/**
+ * The tables of all the workers, and the table of the calling thread.
+ */
+
+static RateTable *tables[RATE_TABLES];
+static int tableCount;
+static __thread RateTable *table;
+
+/**
+ * @brief Sets the number of requests per second each source may send.
+ *
+ *
+ * A source may send a burst of one second's worth of requests at once.
+ * Called before the workers are started.
+ *
+ * @param[in] protocol The protocol limited, RATE_ARP or RATE_ICMP.
+ * @param[in] rate The number of requests per second, 0 to answer every
+ * request.
+ */
+
+void setRateLimit(int protocol, uint32_t rate) {
+  rates[protocol] = rate;
+  bursts[protocol] = rate * RATE_COST;
+}
+
+/**
+ * @brief Hashes a source to the set of its bucket.
+ *
+ * @param[in] source The source.
+ * @return The index of the set.
+ */
+
+static uint32_t hashSource(uint32_t source) {
+  return mixHash(source) & (RATE_SETS - 1);
+}
+
+/**
+ * @brief Returns the table of the calling thread, allocating it on first
+ * use.
+ *
+ *
+ * Prints the error and exits the process if the table cannot be allocated,
+ * or if RATE_TABLES threads have one already.
+ *
+ * @return The table.
+ */
+
+static RateTable *rateTable() {
+  if (table != NULL) {
+    return table;
+  }
+
+  int index = __atomic_fetch_add(&tableCount, 1, __ATOMIC_RELAXED);
+
+  table = aligned_alloc(64, sizeof(RateTable));
+
+  if (table == NULL || index >= RATE_TABLES) {
+    printf("Could not allocate the rate limiting buckets\n");
+    exit(1);
+  }
+
+  memset(table, 0, sizeof(RateTable));
+  __atomic_store_n(&tables[index], table, __ATOMIC_RELEASE);
+
+  return table;
+}
+
+/**
+ * @brief Takes a token from the bucket of a source, if it has one left.
+ *
+ *
+ * Finds the bucket of the source in its set, or takes over the unused or
+ * least recently refilled bucket of the set, filled up.
+ * Refills the bucket for the time elapsed since it was last refilled, up to
+ * its burst, then takes a token from it.
+ * Counts the request as dropped, for the source and for the protocol, if
+ * the bucket has no token left.
+ *
+ * @param[in] protocol The protocol of the request, RATE_ARP or RATE_ICMP.
+ * @param[in] source The source of the request.
+ * @return 1 if the request may be answered, 0 if it is dropped.
+ */
+
+int allowRate(int protocol, uint32_t source) {
+  if (rates[protocol] == 0) {
+    return 1;
+  }
+
+  RateTable *own = rateTable();
+  RateBucket *set = own->buckets[protocol][hashSource(source)];
+  RateBucket *bucket = NULL;
+  RateBucket *idle = &set[0];
+  uint32_t now = (uint32_t) (timerNow() * TIMER_TICK_MS) | 1;
+
+  for (int way = 0; way < RATE_WAYS; way++) {
+    if (set[way].stamp != 0 && set[way].source == source) {
+      bucket = &set[way];
+      break;
+    }
+
+    if (idle->stamp != 0 && (set[way].stamp == 0 || now - set[way].stamp > now - idle->stamp)) {
+      idle = &set[way];
+    }
+  }
+
+  if (bucket == NULL) {
+    bucket = idle;
+    bucket->source = source;
+    bucket->tokens = bursts[protocol];
+    bucket->drops = 0;
+  }
+  else {
+    uint64_t tokens = bucket->tokens + (uint64_t) (now - bucket->stamp) * rates[protocol];
+
+    bucket->tokens = tokens < bursts[protocol] ? tokens : bursts[protocol];
+  }
+
+  bucket->stamp = now;
+
+  if (bucket->tokens < RATE_COST) {
+    bucket->drops++;
+    __atomic_store_n(&own->dropped[protocol], own->dropped[protocol] + 1, __ATOMIC_RELAXED);
+    return 0;
+  }
+
+  bucket->tokens -= RATE_COST;
+
+  return 1;
+}
+
+/**
+ * @brief Returns the number of requests dropped by all the workers.
+ *
+ * @param[in] protocol The protocol, RATE_ARP or RATE_ICMP.
+ * @return The number of requests dropped.
+ */
+
+uint64_t rateDrops(int protocol) {
+  int count = __atomic_load_n(&tableCount, __ATOMIC_RELAXED);
+  uint64_t dropped = 0;
+
+  for (int index = 0; index < count && index < RATE_TABLES; index++) {
+    RateTable *other = __atomic_load_n(&tables[index], __ATOMIC_ACQUIRE);
+
+    if (other != NULL) {
+      dropped += __atomic_load_n(&other->dropped[protocol], __ATOMIC_RELAXED);
+    }
+  }
+
+  return dropped;
+}
@@ -0,0 +1,554 @@
+/**
+ * @file reassembly.c
+ * @author Aryan Chopra
+ * @brief Reassembles the fragmented IPv4 datagrams, within a bounded amount
+ * of memory.
+ *
+ * Every worker reassembles the datagrams whose fragments it receives, in
+ * its own table, so adding a fragment takes no lock.
+ * The datagrams in progress are hashed by their source, destination, id and
+ * protocol, into preallocated slots.
+ * The fragments of a datagram are held in the packet buffers they were
+ * received in, sorted by offset, and are only copied once the datagram is
+ * complete.
+ * Fragments overlapping another fragment with different bounds drop their
+ * whole datagram, as the data they carry would be ambiguous, so the holes
+ * left are simply the length of the datagram minus the bytes received.
+ * A datagram is dropped if it is not complete REASSEMBLY_TIMEOUT
+ * milliseconds after its first fragment.
+ * The fragments held by all the workers are bounded by a global limit: once
+ * it is reached, a worker drops its own oldest datagrams to make room, and
+ * drops the fragment if it holds none.
+ */
+
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash.h"
+#include "ip.h"
+#include "reassembly.h"
+#include "timer.h"
+
+/**
+ * @struct Datagram
+ * @brief A struct holding a datagram being reassembled.
+ *
+ * @var Datagram::source
+ * The source of the datagram, in Network notation(Big Endian).
+ *
+ * @var Datagram::destination
+ * The destination of the datagram, in Network notation(Big Endian).
+ *
+ * @var Datagram::id
+ * The id of the datagram, as received.
+ *
+ * @var Datagram::protocol
+ * The protocol of the payload of the datagram.
+ *
+ * @var Datagram::used
+ * Whether the slot holds a datagram.
+ *
+ * @var Datagram::length
+ * The length of the payload of the datagram, known once its last fragment
+ * is received, 0 until then.
+ *
+ * @var Datagram::end
+ * The end of the furthest fragment received.
+ *
+ * @var Datagram::received
+ * The number of bytes of the payload received.
+ *
+ * @var Datagram::count
+ * The number of fragments held.
+ *
+ * @var Datagram::fragments
+ * The fragments held, sorted by offset, linked through their next field.
+ *
+ * @var Datagram::chain
+ * The next datagram of the bucket, or of the free slots.
+ *
+ * @var Datagram::timer
+ * The timer dropping the datagram if it is not complete in time.
+ */
+
+typedef struct Datagram {
+  uint32_t source;
+  uint32_t destination;
+  uint16_t id;
+  uint8_t protocol;
+  uint8_t used;
+  uint32_t length;
+  uint32_t end;
+  uint32_t received;
+  uint32_t count;
+  PacketBuffer *fragments;
+  struct Datagram *chain;
+  Timer timer;
+} Datagram;
+
+/**
+ * @struct ReassemblyTable
+ * @brief A struct holding the datagrams one worker reassembles.
+ *
+ * @var ReassemblyTable::datagrams
+ * The slots of the datagrams.
+ *
+ * @var ReassemblyTable::buckets
+ * The chains of datagrams of every bucket of the hash.
+ *
+ * @var ReassemblyTable::free
+ * The free slots, linked through their chain field.
+ *
+ * @var ReassemblyTable::timers
+ * The wheel the timers of the datagrams are armed on.
+ *
+ * @var ReassemblyTable::frame
+ * The frame the last datagram completed is reassembled in.
+ */
+
+typedef struct {
+  Datagram datagrams[REASSEMBLY_DATAGRAMS];
+  Datagram *buckets[REASSEMBLY_BUCKETS];
+  Datagram *free;
+  TimerWheel timers;
+  char frame[sizeof(EthernetHeader) + REASSEMBLY_MAX_LEN];
+} ReassemblyTable;
+
+/**
+ * The maximum number of fragments held by all the workers, and the number
+ * held.
+ */
+
+static int fragmentLimit;
+static int heldFragments;
+
+/**
+ * The table of the calling thread.
+ */
+
+static __thread ReassemblyTable *table;
+
+/**
+ * @brief Sets the maximum number of fragments held by all the workers,
+ * waiting for the rest of their datagram.
+ *
+ *
+ * Called before the workers are started.
+ *
+ * @param[in] limit The maximum number of fragments held, 0 to drop every
+ * fragment.
+ */
+
+void setReassemblyLimit(int limit) {
+  fragmentLimit = limit;
+}
+
+/**
+ * @brief Returns the table of the calling thread, allocating it on first
+ * use.
+ *
+ *
+ * Prints the error and exits the process if the table cannot be allocated.
+ *
+ * @return The table.
+ */
+
+static ReassemblyTable *reassemblyTable() {
+  if (table != NULL) {
+    return table;
+  }
+
+  table = calloc(1, sizeof(ReassemblyTable));
+
+  if (table == NULL) {
+    printf("Could not allocate the reassembly table\n");
+    exit(1);
+  }
+
+  for (int index = REASSEMBLY_DATAGRAMS - 1; index >= 0; index--) {
+    table->datagrams[index].chain = table->free;
+    table->free = &table->datagrams[index];
+  }
+
+  initTimerWheel(&table->timers);
+
+  return table;
+}
+
+/**
+ * @brief Hashes the key of a datagram to its bucket.
+ *
+ * @param[in] source The source of the datagram.
+ * @param[in] destination The destination of the datagram.
+ * @param[in] id The id of the datagram.
+ * @param[in] protocol The protocol of the payload of the datagram.
+ * @return The index of the bucket.
+ */
+
+static uint32_t hashDatagram(uint32_t source, uint32_t destination, uint16_t id, uint8_t protocol) {
+  return mixHash(source ^ (destination * 0x9e3779b1) ^ ((uint32_t) id << 8 | protocol)) & (REASSEMBLY_BUCKETS - 1);
+}
+
+/**
+ * @brief Returns the IP header of a fragment held.
+ *
+ * @param[in] fragment The buffer holding the fragment.
+ * @return The IP header.
+ */
+
+static IpHeader *fragmentHeader(PacketBuffer *fragment) {
+  return (IpHeader *) (fragment->data + sizeof(EthernetHeader));
+}
+
+/**
+ * @brief Returns the offset of a fragment held in its datagram.
+ *
+ * @param[in] fragment The buffer holding the fragment.
+ * @return The offset of the payload of the fragment, in bytes.
+ */
+
+static uint32_t fragmentStart(PacketBuffer *fragment) {
+  return (ipFragment(fragmentHeader(fragment)) & IP_OFFSET_MASK) * 8;
+}
+
+/**
+ * @brief Returns the length of the payload of a fragment held.
+ *
+ * @param[in] fragment The buffer holding the fragment.
+ * @return The length of the payload, in bytes.
+ */
+
+static uint32_t fragmentLength(PacketBuffer *fragment) {
+  IpHeader *ipHeader = fragmentHeader(fragment);
+
+  return ntohs(ipHeader->totalLength) - ipHeader->headerLength * 4;
+}
+
+/**
+ * @brief Drops a datagram, releasing its fragments and its slot.
+ *
+ * @param[in, out] own The table of the worker.
+ * @param[in, out] datagram The datagram.
+ */
+
+static void releaseDatagram(ReassemblyTable *own, Datagram *datagram) {
+  Datagram **link = &own->buckets[hashDatagram(datagram->source, datagram->destination, datagram->id, datagram->protocol)];
+
+  while (*link != datagram) {
+    link = &(*link)->chain;
+  }
+
+  *link = datagram->chain;
+
+  while (datagram->fragments != NULL) {
+    PacketBuffer *fragment = datagram->fragments;
+
+    datagram->fragments = fragment->next;
+    freePacket(fragment);
+  }
+
+  __atomic_sub_fetch(&heldFragments, datagram->count, __ATOMIC_RELAXED);
+  cancelTimer(&own->timers, &datagram->timer);
+
+  datagram->used = 0;
+  datagram->chain = own->free;
+  own->free = datagram;
+}
+
+/**
+ * @brief Drops a datagram which did not receive all its fragments in time.
+ *
+ * @param[in, out] timer The timer of the datagram.
+ * @param[in] context The table of the worker.
+ */
+
+static void reassemblyExpired(Timer *timer, void *context) {
+  releaseDatagram(context, timerOwner(timer, Datagram, timer));
+}
+
+/**
+ * @brief Returns the datagram of the table started the longest time ago.
+ *
+ * @param[in] own The table of the worker.
+ * @param[in] spared A datagram which is not returned, NULL if none.
+ * @return The datagram, or NULL if the table holds no other datagram.
+ */
+
+static Datagram *oldestDatagram(ReassemblyTable *own, Datagram *spared) {
+  Datagram *oldest = NULL;
+
+  for (int index = 0; index < REASSEMBLY_DATAGRAMS; index++) {
+    Datagram *datagram = &own->datagrams[index];
+
+    if (datagram->used && datagram != spared && (oldest == NULL || datagram->timer.expires < oldest->timer.expires)) {
+      oldest = datagram;
+    }
+  }
+
+  return oldest;
+}
+
+/**
+ * @brief Finds the datagram a fragment belongs to, or starts it.
+ *
+ *
+ * Drops the oldest datagram of the table to free a slot if they are all
+ * used.
+ *
+ * @param[in, out] own The table of the worker.
+ * @param[in] ipHeader The IP header of the fragment.
+ * @return The datagram.
+ */
+
+static Datagram *findDatagram(ReassemblyTable *own, IpHeader *ipHeader) {
+  Datagram **bucket = &own->buckets[hashDatagram(ipHeader->sourceAddress, ipHeader->destinationAddress, ipHeader->id, ipHeader->protocol)];
+
+  for (Datagram *datagram = *bucket; datagram != NULL; datagram = datagram->chain) {
+    if (datagram->source == ipHeader->sourceAddress && datagram->destination == ipHeader->destinationAddress &&
+        datagram->id == ipHeader->id && datagram->protocol == ipHeader->protocol) {
+      return datagram;
+    }
+  }
+
+  if (own->free == NULL) {
+    releaseDatagram(own, oldestDatagram(own, NULL));
+  }
+
+  Datagram *datagram = own->free;
+
+  own->free = datagram->chain;
+
+  datagram->source = ipHeader->sourceAddress;
+  datagram->destination = ipHeader->destinationAddress;
+  datagram->id = ipHeader->id;
+  datagram->protocol = ipHeader->protocol;
+  datagram->used = 1;
+  datagram->length = 0;
+  datagram->end = 0;
+  datagram->received = 0;
+  datagram->count = 0;
+  datagram->fragments = NULL;
+  datagram->chain = *bucket;
+  *bucket = datagram;
+
+  datagram->timer.callback = reassemblyExpired;
+  addTimer(&own->timers, &datagram->timer, TIMER_TICKS(REASSEMBLY_TIMEOUT));
+
+  return datagram;
+}
+
+/**
+ * @brief Takes a packet buffer holding a fragment, within the global limit.
+ *
+ *
+ * Drops the oldest datagrams of the table, but the one the fragment belongs
+ * to, while the limit is reached.
+ * Holds the buffer the fragment was received in, or copies the fragment
+ * into a buffer of the pool if it was received in a ring.
+ *
+ * @param[in, out] own The table of the worker.
+ * @param[in] datagram The datagram the fragment belongs to.
+ * @param[in] packet The descriptor of the fragment.
+ * @return The buffer, or NULL if the fragment is dropped.
+ */
+
+static PacketBuffer *holdFragment(ReassemblyTable *own, Datagram *datagram, Packet *packet) {
+  while (__atomic_add_fetch(&heldFragments, 1, __ATOMIC_RELAXED) > fragmentLimit) {
+    __atomic_sub_fetch(&heldFragments, 1, __ATOMIC_RELAXED);
+
+    Datagram *oldest = oldestDatagram(own, datagram);
+
+    if (oldest == NULL) {
+      return NULL;
+    }
+
+    releaseDatagram(own, oldest);
+  }
+
+  if (packet->buffer != NULL) {
+    holdPacket(packet->buffer);
+    return packet->buffer;
+  }
+
+  PacketBuffer *buffer = allocPacket();
+
+  if (buffer == NULL || appendPacket(buffer, packet->length) == NULL) {
+    if (buffer != NULL) {
+      freePacket(buffer);
+    }
+
+    __atomic_sub_fetch(&heldFragments, 1, __ATOMIC_RELAXED);
+    return NULL;
+  }
+
+  memcpy(buffer->data, packet->ethernet, packet->length);
+
+  return buffer;
+}
+
+/**
+ * @brief Copies the fragments of a complete datagram into the frame of the
+ * table, and describes the frame.
+ *
+ *
+ * The ethernet and IP headers are those of the first fragment, the total
+ * length, the fragment field and the checksum of the IP header being
+ * rewritten.
+ *
+ * @param[in, out] own The table of the worker.
+ * @param[in] datagram The datagram, whose fragments cover its length.
+ * @param[out] packet The descriptor filled with the datagram.
+ * @return 0 if the datagram was reassembled, -1 if it exceeds
+ * REASSEMBLY_MAX_LEN.
+ */
+
+static int buildDatagram(ReassemblyTable *own, Datagram *datagram, Packet *packet) {
+  PacketBuffer *first = datagram->fragments;
+  int headerLength = fragmentHeader(first)->headerLength * 4;
+  int totalLength = headerLength + datagram->length;
+
+  if (totalLength > REASSEMBLY_MAX_LEN) {
+    return -1;
+  }
+
+  char *payload = own->frame + sizeof(EthernetHeader) + headerLength;
+
+  memcpy(own->frame, first->data, sizeof(EthernetHeader) + headerLength);
+
+  for (PacketBuffer *fragment = first; fragment != NULL; fragment = fragment->next) {
+    int offset = sizeof(EthernetHeader) + fragmentHeader(fragment)->headerLength * 4;
+
+    memcpy(payload + fragmentStart(fragment), fragment->data + offset, fragmentLength(fragment));
+  }
+
+  IpHeader *ipHeader = (IpHeader *) (own->frame + sizeof(EthernetHeader));
+
+  ipHeader->totalLength = htons(totalLength);
+  setIpFragment(ipHeader, 0);
+  ipHeader->checksum = 0;
+  ipHeader->checksum = checksum(ipHeader, headerLength);
+
+  return parsePacket(packet, own->frame, sizeof(EthernetHeader) + totalLength);
+}
+
+/**
+ * @brief Adds a fragment to the datagram it belongs to, and describes the
+ * datagram once it is complete.
+ *
+ *
+ * Every fragment but the last one carries a multiple of 8 bytes.
+ * Ignores a fragment received twice.
+ * Drops the datagram if its fragments overlap, exceed its last fragment or
+ * REASSEMBLY_MAX_LEN, or if two fragments claim to be the last one at
+ * different offsets.
+ * The datagram reassembled is only valid until the next fragment is added.
+ *
+ * @param[in, out] packet The descriptor of the fragment received, filled
+ * with the datagram reassembled.
+ * @return 0 if the datagram is complete, -1 if the fragment is held or
+ * dropped.
+ */
+
+int reassembleIp(Packet *packet) {
+  ReassemblyTable *own = reassemblyTable();
+  IpHeader *ipHeader = (IpHeader *) ((char *) packet->ethernet + packet->networkOffset);
+  uint32_t start = packet->fragmentOffset;
+  uint32_t length = packet->transportLength;
+  uint32_t end = start + length;
+  int last = !(packet->flags & PACKET_MORE_FRAGMENTS);
+
+  if ((!last && (length == 0 || length % 8 != 0)) || packet->transportOffset - packet->networkOffset + end > REASSEMBLY_MAX_LEN) {
+    return -1;
+  }
+
+  Datagram *datagram = findDatagram(own, ipHeader);
+
+  if ((last && datagram->length != 0 && datagram->length != end) || (last && datagram->end > end) ||
+      (datagram->length != 0 && end > datagram->length)) {
+    releaseDatagram(own, datagram);
+    return -1;
+  }
+
+  PacketBuffer **link = &datagram->fragments;
+  uint32_t previousEnd = 0;
+
+  while (*link != NULL && fragmentStart(*link) < start) {
+    previousEnd = fragmentStart(*link) + fragmentLength(*link);
+    link = &(*link)->next;
+  }
+
+  if (*link != NULL && fragmentStart(*link) == start && fragmentLength(*link) == length) {
+    return -1;
+  }
+
+  if (previousEnd > start || (*link != NULL && fragmentStart(*link) < end)) {
+    releaseDatagram(own, datagram);
+    return -1;
+  }
+
+  PacketBuffer *fragment = holdFragment(own, datagram, packet);
+
+  if (fragment == NULL) {
+    if (datagram->count == 0) {
+      releaseDatagram(own, datagram);
+    }
+
+    return -1;
+  }
+
+  fragment->next = *link;
+  *link = fragment;
+  datagram->count++;
+  datagram->received += length;
+
+  if (end > datagram->end) {
+    datagram->end = end;
+  }
+
+  if (last) {
+    datagram->length = end;
+  }
+
+  if (datagram->length == 0 || datagram->received != datagram->length) {
+    return -1;
+  }
+
+  int built = buildDatagram(own, datagram, packet);
+
+  releaseDatagram(own, datagram);
+
+  return built;
+}
+
+/**
+ * @brief Drops the datagrams of the calling worker which did not receive
+ * all their fragments in time.
+ *
+ *
+ * Does nothing if the worker never received a fragment.
+ */
+
+void runReassemblyTimers() {
+  if (table == NULL) {
+    return;
+  }
+
+  advanceTimerWheel(&table->timers, timerNow(), table);
+}
+
+/**
+ * @brief Returns the tick the next datagram of the calling worker times out
+ * at, at the latest.
+ *
+ * @return The tick, UINT64_MAX if the worker holds no fragment.
+ */
+
+uint64_t reassemblyTimerDeadline() {
+  if (table == NULL) {
+    return UINT64_MAX;
+  }
+
+  return nextTimerExpiry(&table->timers);
+}
@@ -0,0 +1,142 @@
+/**
+ * @file rss.c
+ * @author Aryan Chopra
+ * @brief Computes the flow hash spreading the frames of a single queue over
+ * several workers.
+ *
+ * The hash is the Toeplitz hash of receive side scaling, with the key the
+ * network cards use by default, so a flow is spread like a card would.
+ * The hash of an input is the XOR of a 32-bit window of the key for every
+ * bit set in the input, the window starting at the position of the bit.
+ * The windows of every possible byte at every position of the input are
+ * XORed once when the tables are built, so hashing costs one table lookup
+ * per byte of the input.
+ */
+
+#include <arpa/inet.h>
+#include <string.h>
+
+#include "arp.h"
+#include "ip.h"
+#include "rss.h"
+
+/**
+ * The key used by the network cards by default.
+ */
+
+static const uint8_t rssKey[RSS_KEY_LEN] = {
+  0x6d, 0x5a, 0x56, 0xda, 0x25, 0x5b, 0x0e, 0xc2,
+  0x41, 0x67, 0x25, 0x3d, 0x43, 0xa3, 0x8f, 0xb0,
+  0xd0, 0xca, 0x2b, 0xcb, 0xae, 0x7b, 0x30, 0xb4,
+  0x77, 0xcb, 0x2d, 0xa3, 0x80, 0x30, 0xf2, 0x0c,
+  0x6a, 0x42, 0xb7, 0x3b, 0xbe, 0xac, 0x01, 0xfa,
+};
+
+/**
+ * The hash of every byte at every position of the input.
+ */
+
+static uint32_t rssTable[RSS_INPUT_LEN][256];
+
+/**
+ * @brief Reads the 32-bit window of the key starting at a bit.
+ *
+ * @param[in] bit The position of the first bit of the window.
+ * @return The window.
+ */
+
+static uint32_t keyWindow(int bit) {
+  int byte = bit / 8;
+  uint64_t bits = 0;
+
+  for (int index = 0; index < 5; index++) {
+    bits = bits << 8 | rssKey[byte + index];
+  }
+
+  return (uint32_t) (bits >> (8 - bit % 8));
+}
+
+/**
+ * @brief Precomputes the tables of the Toeplitz hash from the key used by
+ * the network cards by default.
+ *
+ *
+ * Called once, before the frames are dispatched.
+ */
+
+void initRss() {
+  for (int position = 0; position < RSS_INPUT_LEN; position++) {
+    for (int value = 0; value < 256; value++) {
+      uint32_t hash = 0;
+
+      for (int bit = 0; bit < 8; bit++) {
+        if (value & (0x80 >> bit)) {
+          hash ^= keyWindow(position * 8 + bit);
+        }
+      }
+
+      rssTable[position][value] = hash;
+    }
+  }
+}
+
+/**
+ * @brief Computes the Toeplitz hash of bytes.
+ *
+ * @param[in] input The bytes, in Network notation(Big Endian).
+ * @param[in] length The number of bytes, RSS_INPUT_LEN at most.
+ * @return The hash.
+ */
+
+static uint32_t toeplitz(const uint8_t *input, int length) {
+  uint32_t hash = 0;
+
+  for (int position = 0; position < length; position++) {
+    hash ^= rssTable[position][input[position]];
+  }
+
+  return hash;
+}
+
+/**
+ * @brief Computes the Toeplitz hash of the flow a frame belongs to.
+ *
+ *
+ * The input is the source and destination addresses of an IP packet,
+ * followed by its source and destination ports for a TCP or UDP packet
+ * which is not a fragment, in the order of the network cards.
+ * The flow of any other IP packet, and of every fragment, is its addresses
+ * only, so all the fragments of a datagram belong to the same flow.
+ * The input of an ARP packet is its sender address.
+ *
+ * @param[in] packet The descriptor of the frame.
+ * @return The hash, 0 for the frames of any other ethertype.
+ */
+
+uint32_t hashFlow(Packet *packet) {
+  char *network = (char *) packet->ethernet + packet->networkOffset;
+  uint8_t input[RSS_INPUT_LEN];
+
+  if (packet->flags & PACKET_ARP) {
+    arp_ipv4 *arpData = (arp_ipv4 *) ((ArpHeader *) network)->data;
+
+    memcpy(input, &arpData->sourceIp, 4);
+    return toeplitz(input, 4);
+  }
+
+  if (!(packet->flags & PACKET_IPV4)) {
+    return 0;
+  }
+
+  IpHeader *ipHeader = (IpHeader *) network;
+
+  memcpy(input, &ipHeader->sourceAddress, 4);
+  memcpy(input + 4, &ipHeader->destinationAddress, 4);
+
+  if ((packet->protocol == IPPROTO_TCP || packet->protocol == IPPROTO_UDP) && !(packet->flags & PACKET_FRAGMENT) && packet->transportLength >= 4) {
+    memcpy(input + 8, (char *) packet->ethernet + packet->transportOffset, 4);
+    return toeplitz(input, 12);
+  }
+
+  return toeplitz(input, 8);
+}
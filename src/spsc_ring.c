@@ -0,0 +1,210 @@
+/**
+ * @file spsc_ring.c
+ * @author Aryan Chopra
+ * @brief Hands pointers from one thread to another through bounded
+ * lock-free rings.
+ *
+ * The producer publishes the pointers it pushed by storing the head with
+ * release ordering, and the consumer releases the slots it popped by
+ * storing the tail the same way, so neither side ever waits for the other.
+ * The consumer only sleeps once it found the ring empty, after announcing
+ * it, and the producer only pays for a write to the eventfd when the
+ * consumer announced it is sleeping.
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "spsc_ring.h"
+
+/**
+ * @brief Allocates an empty ring.
+ *
+ *
+ * Prints the error and exits the process if the ring cannot be allocated.
+ *
+ * @param[in] size The number of slots, rounded up to a power of two.
+ * @return The ring.
+ */
+
+SpscRing *newSpscRing(int size) {
+  SpscRing *ring = aligned_alloc(64, sizeof(SpscRing));
+  uint32_t slots = 1;
+
+  while (slots < (uint32_t) size) {
+    slots <<= 1;
+  }
+
+  if (ring == NULL || (ring->items = malloc(slots * sizeof(void *))) == NULL) {
+    printf("Could not allocate a ring of %u slots\n", slots);
+    exit(1);
+  }
+
+  ring->head = 0;
+  ring->cachedTail = 0;
+  ring->tail = 0;
+  ring->cachedHead = 0;
+  ring->sleeping = 0;
+  ring->mask = slots - 1;
+  ring->eventDescriptor = eventfd(0, EFD_NONBLOCK);
+
+  if (ring->eventDescriptor < 0) {
+    perror("Could not create the eventfd of a ring");
+    exit(1);
+  }
+
+  return ring;
+}
+
+/**
+ * @brief Pushes pointers to the ring, as many as it has free slots for.
+ *
+ *
+ * Called by the producer only.
+ * Reads the tail again only if the ring looks full from the tail cached.
+ * Wakes the consumer up if it is sleeping.
+ *
+ * @param[in, out] ring The ring.
+ * @param[in] items The pointers.
+ * @param[in] count The number of pointers.
+ * @return The number of pointers pushed, the first ones.
+ */
+
+int pushSpscRing(SpscRing *ring, void **items, int count) {
+  uint32_t head = ring->head;
+  uint32_t size = ring->mask + 1;
+
+  if (head - ring->cachedTail + count > size) {
+    ring->cachedTail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+  }
+
+  uint32_t room = size - (head - ring->cachedTail);
+
+  if ((uint32_t) count > room) {
+    count = room;
+  }
+
+  for (int index = 0; index < count; index++) {
+    ring->items[(head + index) & ring->mask] = items[index];
+  }
+
+  __atomic_store_n(&ring->head, head + count, __ATOMIC_RELEASE);
+
+  if (count == 0) {
+    return 0;
+  }
+
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+  if (__atomic_load_n(&ring->sleeping, __ATOMIC_RELAXED)) {
+    uint64_t one = 1;
+
+    write(ring->eventDescriptor, &one, sizeof(one));
+  }
+
+  return count;
+}
+
+/**
+ * @brief Pops pointers from the ring, oldest first.
+ *
+ *
+ * Called by the consumer only.
+ * Reads the head again only if the ring looks empty from the head cached.
+ *
+ * @param[in, out] ring The ring.
+ * @param[out] items The pointers popped.
+ * @param[in] count The maximum number of pointers popped.
+ * @return The number of pointers popped.
+ */
+
+int popSpscRing(SpscRing *ring, void **items, int count) {
+  uint32_t tail = ring->tail;
+
+  if (ring->cachedHead - tail < (uint32_t) count) {
+    ring->cachedHead = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+  }
+
+  uint32_t used = ring->cachedHead - tail;
+
+  if ((uint32_t) count > used) {
+    count = used;
+  }
+
+  for (int index = 0; index < count; index++) {
+    items[index] = ring->items[(tail + index) & ring->mask];
+  }
+
+  __atomic_store_n(&ring->tail, tail + count, __ATOMIC_RELEASE);
+
+  return count;
+}
+
+/**
+ * @brief Waits until pointers are pushed to an empty ring, or the timeout
+ * expires.
+ *
+ *
+ * Called by the consumer only, returns right away if the ring is not
+ * empty.
+ *
+ * @param[in, out] ring The ring.
+ * @param[in] timeout The timeout, in milliseconds.
+ */
+
+void waitSpscRing(SpscRing *ring, int timeout) {
+  waitSpscRings(&ring, 1, timeout);
+}
+
+/**
+ * @brief Waits until pointers are pushed to any of several empty rings, or
+ * the timeout expires.
+ *
+ *
+ * Announces the consumer is sleeping on every ring before checking the
+ * rings a last time, so a pointer pushed in between either is seen by the
+ * check, or sees the announcement and wakes the consumer up.
+ * Called by the consumer of all the rings only, returns right away if any
+ * ring is not empty.
+ * An eventfd left signalled when the wait is skipped is read by the next
+ * wait, which it wakes up right away.
+ * Prints the error and exits the process if waiting fails.
+ *
+ * @param[in, out] rings The rings.
+ * @param[in] count The number of rings, SPSC_WAIT_RINGS at most.
+ * @param[in] timeout The timeout, in milliseconds.
+ */
+
+void waitSpscRings(SpscRing **rings, int count, int timeout) {
+  struct pollfd events[SPSC_WAIT_RINGS];
+  int empty = 1;
+  uint64_t value;
+
+  for (int index = 0; index < count; index++) {
+    __atomic_store_n(&rings[index]->sleeping, 1, __ATOMIC_SEQ_CST);
+    events[index].fd = rings[index]->eventDescriptor;
+    events[index].events = POLLIN;
+    events[index].revents = 0;
+  }
+
+  for (int index = 0; index < count && empty; index++) {
+    empty = __atomic_load_n(&rings[index]->head, __ATOMIC_SEQ_CST) == rings[index]->tail;
+  }
+
+  if (empty && poll(events, count, timeout) < 0 && errno != EINTR) {
+    perror("Could not wait on a ring");
+    exit(1);
+  }
+
+  for (int index = 0; index < count; index++) {
+    __atomic_store_n(&rings[index]->sleeping, 0, __ATOMIC_RELAXED);
+
+    if (events[index].revents & POLLIN) {
+      read(rings[index]->eventDescriptor, &value, sizeof(value));
+    }
+  }
+}
@@ -0,0 +1,262 @@
+/**
+ * @file timer.c
+ * @author Aryan Chopra
+ * @brief A hierarchical timer wheel, the protocol timers are armed on.
+ *
+ * Arming and cancelling a timer link it into or out of the list of one slot,
+ * in constant time, whatever the number of timers armed.
+ * Advancing the wheel by one tick runs the whole slot of that tick as a
+ * batch, and only cascades a slot of a higher level down once every 64
+ * ticks of the level below, so no timer is looked at before it is due.
+ */
+
+#include <time.h>
+
+#include "timer.h"
+
+/**
+ * @brief Returns the current tick, from the monotonic clock.
+ *
+ *
+ * Reads the coarse clock, which does not enter the kernel and is precise
+ * enough for ticks of TIMER_TICK_MS.
+ *
+ * @return The current tick.
+ */
+
+uint64_t timerNow() {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+
+  return ((uint64_t) now.tv_sec * 1000 + now.tv_nsec / 1000000) / TIMER_TICK_MS;
+}
+
+/**
+ * @brief Initializes an empty timer wheel, starting at the current tick.
+ *
+ * @param[out] wheel The wheel.
+ */
+
+void initTimerWheel(TimerWheel *wheel) {
+  for (int level = 0; level < TIMER_LEVELS; level++) {
+    for (int slot = 0; slot < TIMER_SLOTS; slot++) {
+      Timer *head = &wheel->slots[level][slot];
+
+      head->next = head;
+      head->previous = head;
+    }
+  }
+
+  wheel->now = timerNow();
+  wheel->count = 0;
+}
+
+/**
+ * @brief Links an armed timer into the slot of its expiry.
+ *
+ *
+ * The level is chosen from the number of ticks left, and the slot from the
+ * bits of the expiry tick the level is indexed with.
+ * A timer further away than the wheel spans is put in the furthest slot,
+ * and cascaded down again until it is due.
+ *
+ * @param[in, out] wheel The wheel.
+ * @param[in, out] timer The timer.
+ */
+
+static void placeTimer(TimerWheel *wheel, Timer *timer) {
+  uint64_t expires = timer->expires;
+  uint64_t left = expires - wheel->now;
+  int level = 0;
+
+  if (expires < wheel->now) {
+    expires = wheel->now;
+    left = 0;
+  }
+
+  while (level < TIMER_LEVELS - 1 && left >= (1ULL << (TIMER_SLOT_BITS * (level + 1)))) {
+    level++;
+  }
+
+  if (left >= (1ULL << (TIMER_SLOT_BITS * TIMER_LEVELS))) {
+    expires = wheel->now + (1ULL << (TIMER_SLOT_BITS * TIMER_LEVELS)) - 1;
+  }
+
+  Timer *head = &wheel->slots[level][(expires >> (TIMER_SLOT_BITS * level)) & (TIMER_SLOTS - 1)];
+
+  timer->next = head;
+  timer->previous = head->previous;
+  head->previous->next = timer;
+  head->previous = timer;
+}
+
+/**
+ * @brief Unlinks a timer from its slot.
+ *
+ * @param[in, out] timer The timer.
+ */
+
+static void unlinkTimer(Timer *timer) {
+  timer->previous->next = timer->next;
+  timer->next->previous = timer->previous;
+  timer->next = NULL;
+  timer->previous = NULL;
+}
+
+/**
+ * @brief Arms a timer on the wheel, in constant time.
+ *
+ *
+ * Rearms the timer if it is already armed.
+ *
+ * @param[in, out] wheel The wheel.
+ * @param[in, out] timer The timer, whose callback is set.
+ * @param[in] ticks The number of ticks after which the timer expires, at
+ * least one.
+ */
+
+void addTimer(TimerWheel *wheel, Timer *timer, uint64_t ticks) {
+  cancelTimer(wheel, timer);
+
+  timer->expires = wheel->now + (ticks > 0 ? ticks : 1);
+  placeTimer(wheel, timer);
+  wheel->count++;
+}
+
+/**
+ * @brief Disarms a timer, in constant time.
+ *
+ *
+ * Does nothing if the timer is not armed.
+ *
+ * @param[in, out] wheel The wheel the timer is armed on.
+ * @param[in, out] timer The timer.
+ */
+
+void cancelTimer(TimerWheel *wheel, Timer *timer) {
+  if (timer->next == NULL) {
+    return;
+  }
+
+  unlinkTimer(timer);
+  wheel->count--;
+}
+
+/**
+ * @brief Moves every timer of a slot of a higher level down the wheel.
+ *
+ * @param[in, out] wheel The wheel.
+ * @param[in] level The level of the slot.
+ * @param[in] slot The index of the slot.
+ */
+
+static void cascade(TimerWheel *wheel, int level, int slot) {
+  Timer *head = &wheel->slots[level][slot];
+  Timer *timer = head->next;
+
+  head->next = head;
+  head->previous = head;
+
+  while (timer != head) {
+    Timer *next = timer->next;
+
+    placeTimer(wheel, timer);
+    timer = next;
+  }
+}
+
+/**
+ * @brief Advances the wheel to the tick provided, and runs every timer
+ * expired on the way.
+ *
+ *
+ * Cascades the slots of the higher levels down whenever the level below
+ * wraps around.
+ * The timers of a tick are detached from the wheel as a batch before their
+ * callbacks are called, so a callback can rearm its own timer.
+ * Jumps straight to the tick provided when no timer is armed.
+ *
+ * @param[in, out] wheel The wheel.
+ * @param[in] now The current tick.
+ * @param[in] context The context passed to the callbacks.
+ * @return The number of timers run.
+ */
+
+int advanceTimerWheel(TimerWheel *wheel, uint64_t now, void *context) {
+  int ran = 0;
+
+  while (wheel->now < now) {
+    if (wheel->count == 0) {
+      wheel->now = now;
+      break;
+    }
+
+    wheel->now++;
+
+    for (int level = 1; level < TIMER_LEVELS; level++) {
+      int below = (wheel->now >> (TIMER_SLOT_BITS * (level - 1))) & (TIMER_SLOTS - 1);
+
+      if (below != 0) {
+        break;
+      }
+
+      cascade(wheel, level, (wheel->now >> (TIMER_SLOT_BITS * level)) & (TIMER_SLOTS - 1));
+    }
+
+    Timer *head = &wheel->slots[0][wheel->now & (TIMER_SLOTS - 1)];
+    Timer expired = {.next = head->next, .previous = head->previous};
+
+    if (head->next == head) {
+      continue;
+    }
+
+    expired.next->previous = &expired;
+    expired.previous->next = &expired;
+    head->next = head;
+    head->previous = head;
+
+    while (expired.next != &expired) {
+      Timer *timer = expired.next;
+
+      unlinkTimer(timer);
+      wheel->count--;
+      timer->callback(timer, context);
+      ran++;
+    }
+  }
+
+  return ran;
+}
+
+/**
+ * @brief Returns the tick the next timer of the wheel is due at, at the
+ * latest.
+ *
+ *
+ * Only scans the slots of the lowest level up to its next wrap around,
+ * as every timer of a higher level expires at that wrap or later, and
+ * returns the wrap around when none of those slots is armed, the wheel
+ * cascading the higher levels down at that tick.
+ *
+ * @param[in] wheel The wheel.
+ * @return The tick, UINT64_MAX when no timer is armed.
+ */
+
+uint64_t nextTimerExpiry(TimerWheel *wheel) {
+  if (wheel->count == 0) {
+    return UINT64_MAX;
+  }
+
+  uint64_t wrap = (wheel->now | (TIMER_SLOTS - 1)) + 1;
+
+  for (uint64_t tick = wheel->now + 1; tick < wrap; tick++) {
+    Timer *head = &wheel->slots[0][tick & (TIMER_SLOTS - 1)];
+
+    if (head->next != head) {
+      return tick;
+    }
+  }
+
+  return wrap;
+}
@@ -6,6 +6,7 @@
  * Initializes the TUN/TAP device by opening the tun file
  * Initializes the TUN/TAP device as a TAP device.
  * Assigns IP address to the device and activates it's state.
+ * Opens several queues of the same TAP device when multi-queue is requested.
  */
 
 #include <errno.h>
@@ -32,6 +33,8 @@
  * Configures the interface as a TAP device.
  * IFF_NO_PI signifies that the version of IP protocol will be deduced from
  * IP version number in the packet.
+ * Any extra flags provided, such as IFF_MULTI_QUEUE, are added to the
+ * configuration.
  * Writes the error to the console, and exits the process if device's
  * configuration fails.
  *
@@ -39,13 +42,14 @@
  * to the interface
  * In case the buffer is empty, the default name assigned is copied to the
  * buffer.
+ * @param[in] flags Extra interface flags to configure the device with.
  * @return device An integer containing the file descriptor of the TUN/TAP
  * device.
  * @pre The "name" array has sufficient capacity to hold the default name,
  * if empty.
  */
 
-int allocTap(char *name) {
+static int allocTap(char *name, short flags) {
 	struct ifreq ifr;
 	int device, err;
 
@@ -58,7 +62,7 @@ int allocTap(char *name) {
 	//Set ifr's memory to be zero
 	memset(&ifr, 0, sizeof(ifr));
 
-	ifr.ifr_flags = IFF_TAP | IFF_NO_PI;
+	ifr.ifr_flags = IFF_TAP | IFF_NO_PI | flags;
 	if (*name) {
 		strncpy(ifr.ifr_name, name, IFNAMSIZ);
 	} 
@@ -70,7 +74,7 @@ int allocTap(char *name) {
     exit(1);
 	}
 
-	strncpy(name, ifr.ifr_name, sizeof(ifr.ifr_name));
+	strncpy(name, ifr.ifr_name, IFNAMSIZ);
 	return device;
 }
 
@@ -78,17 +82,13 @@ int allocTap(char *name) {
  * @brief Activates the TAP device and assigns an IP route to it.
  *
  *
- * Calls the appropriate function to create a TAP device.
- * Sets the device created as UP.
+ * Sets the device as UP.
  * Assigns a hardcorded route to TAP device.
  *
- * @param[in, out] A character array containing the name of the device, used for configuring it.
- * Could be modified by the allocTap function if empty.
- * @return fd An integer containing the file descriptor of the TAP device.
+ * @param[in] name A character array containing the name of the device.
  */
 
-int initTap(char *name) {
-  int	fd = allocTap(name);
+static void configureTap(char *name) {
 	char *command = malloc(250);
 
 	//Set interface up
@@ -100,7 +100,49 @@ int initTap(char *name) {
 	system(command);	 
 
   free(command);
+}
+
+/**
+ * @brief Activates the TAP device and assigns an IP route to it.
+ *
+ *
+ * Calls the appropriate function to create a TAP device.
+ * Sets the device created as UP.
+ * Assigns a hardcorded route to TAP device.
+ *
+ * @param[in, out] A character array containing the name of the device, used for configuring it.
+ * Could be modified by the allocTap function if empty.
+ * @return fd An integer containing the file descriptor of the TAP device.
+ */
+
+int initTap(char *name) {
+  int	fd = allocTap(name, 0);
+
+  configureTap(name);
 
 	return fd;
 }
 
+/**
+ * @brief Opens a multi-queue TAP device and activates it.
+ *
+ *
+ * Opens the first queue with IFF_MULTI_QUEUE, creating the device.
+ * Every further queue is attached to the same device by name, since the
+ * name is filled in by the first allocation if it was empty.
+ * Sets the device as UP and assigns the route once all the queues exist.
+ *
+ * @param[in, out] name A character array containing the name of the device.
+ * Could be modified by the allocTap function if empty.
+ * @param[out] fds An array which receives the file descriptor of every queue.
+ * @param[in] count The number of queues to open.
+ * @pre The "fds" array has space for "count" descriptors.
+ */
+
+void initTapQueues(char *name, int *fds, int count) {
+  for (int queue = 0; queue < count; queue++) {
+    fds[queue] = allocTap(name, IFF_MULTI_QUEUE);
+  }
+
+  configureTap(name);
+}
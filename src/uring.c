@@ -0,0 +1,389 @@
+/**
+ * @file uring.c
+ * @author Aryan Chopra
+ * @brief Receives and transmits the frames of a TAP queue through io_uring.
+ *
+ * Keeps a fixed-buffer read posted on every receive buffer of the queue.
+ * Replies are built in place in the buffer their request was read into, and
+ * written from it with a fixed-buffer write, which is submitted together
+ * with the next wait for completions, so the reply path never blocks the
+ * receive path.
+ * The frames built elsewhere, such as fragments and ARP requests, are copied
+ * into buffers of their own and written with a writev submitted the same
+ * way.
+ * The rings are set up and mapped through the raw system calls, as the
+ * stack does not depend on liburing.
+ */
+
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "uring.h"
+
+#define URING_WRITE (1ULL << 32) ///Marks the user data of a write, the lower bits hold the buffer index.
+#define URING_COPY (1ULL << 33) ///Marks the user data of the write of a copy, the lower bits hold the index of the copy.
+#define URING_INDEX 0xffffffffULL ///Mask of the index held in the user data.
+
+/**
+ * @brief Prints the error of a failed io_uring call and exits the process.
+ *
+ * @param[in] call The name of the call which failed.
+ */
+
+static void uringError(char *call) {
+  printf("Error in %s: %s\n", call, strerror(errno));
+  exit(1);
+}
+
+/**
+ * @brief Submits the queued entries, and optionally waits for completions.
+ *
+ *
+ * Retries the system call if it is interrupted by a signal.
+ * Stops waiting once the timeout provided expires, without any completion.
+ *
+ * @param[in, out] uring The io_uring instance.
+ * @param[in] wait The number of completions to wait for.
+ * @param[in] timeout The milliseconds to wait at most, or -1 to wait until
+ * the completions arrive.
+ */
+
+static void enterUring(Uring *uring, unsigned wait, int timeout) {
+  unsigned flags = wait ? IORING_ENTER_GETEVENTS : 0;
+  struct __kernel_timespec limit = {.tv_sec = timeout / 1000, .tv_nsec = (timeout % 1000) * 1000000L};
+  struct io_uring_getevents_arg argument = {.ts = (uint64_t) (uintptr_t) &limit};
+  void *extra = NULL;
+  size_t extraSize = 0;
+  int submitted;
+
+  if (wait && timeout >= 0) {
+    flags |= IORING_ENTER_EXT_ARG;
+    extra = &argument;
+    extraSize = sizeof(argument);
+  }
+
+  do {
+    submitted = syscall(__NR_io_uring_enter, uring->ringDescriptor, uring->pending, wait, flags, extra, extraSize);
+  } while (submitted < 0 && errno == EINTR);
+
+  if (submitted < 0 && errno == ETIME) {
+    return;
+  }
+
+  if (submitted < 0) {
+    uringError("io_uring_enter");
+  }
+
+  uring->pending -= submitted;
+}
+
+/**
+ * @brief Returns a cleared submission queue entry, ready to be filled.
+ *
+ *
+ * Submits the queued entries first if the submission queue is full.
+ *
+ * @param[in, out] uring The io_uring instance.
+ * @return The submission queue entry.
+ */
+
+static struct io_uring_sqe *nextSqe(Uring *uring) {
+  unsigned tail = *uring->sqTail;
+
+  while (tail - __atomic_load_n(uring->sqHead, __ATOMIC_ACQUIRE) > uring->sqMask) {
+    enterUring(uring, 0, -1);
+  }
+
+  unsigned index = tail & uring->sqMask;
+  struct io_uring_sqe *sqe = &uring->sqes[index];
+
+  memset(sqe, 0, sizeof(*sqe));
+  uring->sqArray[index] = index;
+
+  return sqe;
+}
+
+/**
+ * @brief Publishes the entry returned last by nextSqe to the kernel.
+ *
+ * @param[in, out] uring The io_uring instance.
+ */
+
+static void queueSqe(Uring *uring) {
+  __atomic_store_n(uring->sqTail, *uring->sqTail + 1, __ATOMIC_RELEASE);
+  uring->pending++;
+}
+
+/**
+ * @brief Queues a fixed-buffer read of one frame into a receive buffer.
+ *
+ * @param[in, out] uring The io_uring instance.
+ * @param[in] index The index of the receive buffer.
+ */
+
+static void postRead(Uring *uring, int index) {
+  struct io_uring_sqe *sqe = nextSqe(uring);
+
+  sqe->opcode = IORING_OP_READ_FIXED;
+  sqe->fd = uring->deviceDescriptor;
+  sqe->addr = (uint64_t) (uintptr_t) (uring->buffers + index * uring->bufferSize);
+  sqe->len = uring->bufferSize;
+  sqe->buf_index = 0;
+  sqe->user_data = index;
+
+  queueSqe(uring);
+}
+
+/**
+ * @brief Creates an io_uring instance for a TAP queue and posts its reads.
+ *
+ *
+ * Sets up the submission and completion queues and maps them.
+ * The submission queue holds two entries per buffer, so a read or a write
+ * can always be queued for every buffer, and one per buffer of copies.
+ * Allocates the receive buffers and registers them with the kernel as fixed
+ * buffers, so the kernel does not map them again on every operation.
+ * Allocates the buffers the frames built elsewhere are copied into.
+ * Posts one fixed-buffer read per receive buffer.
+ * Prints the error and exits the process if io_uring, or its timed waits,
+ * are not available.
+ *
+ * @param[in] device The file descriptor of the TAP queue.
+ * @param[in] count The number of reads kept posted on the queue.
+ * @param[in] bufferSize The size of a single receive buffer.
+ * @return The io_uring instance created.
+ */
+
+Uring *initUring(int device, int count, int bufferSize) {
+  Uring *uring = calloc(1, sizeof(Uring));
+  struct io_uring_params params;
+
+  memset(&params, 0, sizeof(params));
+
+  uring->ringDescriptor = syscall(__NR_io_uring_setup, 2 * count + URING_COPIES, &params);
+  if (uring->ringDescriptor < 0) {
+    uringError("io_uring_setup");
+  }
+
+  if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_EXT_ARG)) {
+    printf("io_uring without single mmap or timed waits is not supported\n");
+    exit(1);
+  }
+
+  size_t sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  size_t cqSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  size_t ringSize = sqSize > cqSize ? sqSize : cqSize;
+
+  char *ring = mmap(NULL, ringSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring->ringDescriptor, IORING_OFF_SQ_RING);
+  if (ring == MAP_FAILED) {
+    uringError("mmap of the rings");
+  }
+
+  uring->sqes = mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring->ringDescriptor, IORING_OFF_SQES);
+  if (uring->sqes == MAP_FAILED) {
+    uringError("mmap of the submission entries");
+  }
+
+  uring->sqHead = (unsigned *) (ring + params.sq_off.head);
+  uring->sqTail = (unsigned *) (ring + params.sq_off.tail);
+  uring->sqMask = *(unsigned *) (ring + params.sq_off.ring_mask);
+  uring->sqArray = (unsigned *) (ring + params.sq_off.array);
+
+  uring->cqHead = (unsigned *) (ring + params.cq_off.head);
+  uring->cqTail = (unsigned *) (ring + params.cq_off.tail);
+  uring->cqMask = *(unsigned *) (ring + params.cq_off.ring_mask);
+  uring->cqes = (struct io_uring_cqe *) (ring + params.cq_off.cqes);
+
+  uring->deviceDescriptor = device;
+  uring->bufferSize = bufferSize;
+  uring->bufferCount = count;
+  uring->buffers = aligned_alloc(4096, ((size_t) count * bufferSize + 4095) & ~4095UL);
+
+  uring->copies = malloc((size_t) URING_COPIES * URING_COPY_SIZE);
+  uring->freeCopyCount = URING_COPIES;
+
+  if (uring->buffers == NULL || uring->copies == NULL) {
+    printf("Could not allocate the buffers of io_uring\n");
+    exit(1);
+  }
+
+  for (int index = 0; index < URING_COPIES; index++) {
+    uring->freeCopies[index] = index;
+  }
+
+  struct iovec region = {.iov_base = uring->buffers, .iov_len = (size_t) count * bufferSize};
+
+  if (syscall(__NR_io_uring_register, uring->ringDescriptor, IORING_REGISTER_BUFFERS, &region, 1) < 0) {
+    uringError("io_uring_register");
+  }
+
+  for (int index = 0; index < count; index++) {
+    postRead(uring, index);
+  }
+
+  return uring;
+}
+
+/**
+ * @brief Queues the write of a frame on the io_uring instance.
+ *
+ *
+ * If the frame lies in one of the fixed receive buffers, which is the case
+ * for every reply built in place, a fixed-buffer write is queued and the
+ * buffer is held until the write completes.
+ * Any other frame is copied and written like transmitUringParts().
+ * The write is submitted with the next wait, so transmitting never blocks.
+ *
+ * @param[in, out] uring The io_uring instance.
+ * @param[in] frame The frame to write.
+ * @param[in] length The length of the frame.
+ */
+
+void transmitUring(Uring *uring, char *frame, int length) {
+  long offset = frame - uring->buffers;
+
+  if (offset < 0 || offset >= (long) uring->bufferCount * uring->bufferSize) {
+    struct iovec part = {.iov_base = frame, .iov_len = length};
+
+    transmitUringParts(uring, &part, 1);
+    return;
+  }
+
+  struct io_uring_sqe *sqe = nextSqe(uring);
+
+  sqe->opcode = IORING_OP_WRITE_FIXED;
+  sqe->fd = uring->deviceDescriptor;
+  sqe->addr = (uint64_t) (uintptr_t) frame;
+  sqe->len = length;
+  sqe->buf_index = 0;
+  sqe->user_data = URING_WRITE | (offset / uring->bufferSize);
+
+  queueSqe(uring);
+  uring->replied = 1;
+}
+
+/**
+ * @brief Queues the write of a frame built outside the receive buffers,
+ * gathered from its parts, on the io_uring instance.
+ *
+ *
+ * Copies the parts into a buffer held until the write completes, as the
+ * memory they point into is released once the frame is transmitted, and
+ * queues a writev of them, each part keeping its own iovec.
+ * The write is submitted with the next wait, so transmitting never blocks.
+ * Drops the frame if URING_COPIES writes of copies are in flight already,
+ * like a full transmit queue, or if it is larger than URING_COPY_SIZE.
+ *
+ * @param[in, out] uring The io_uring instance.
+ * @param[in] parts The parts of the frame.
+ * @param[in] count The number of parts, two at most.
+ */
+
+void transmitUringParts(Uring *uring, struct iovec *parts, int count) {
+  size_t length = 0;
+
+  for (int part = 0; part < count; part++) {
+    length += parts[part].iov_len;
+  }
+
+  if (uring->freeCopyCount == 0 || length > URING_COPY_SIZE) {
+    return;
+  }
+
+  int copy = uring->freeCopies[--uring->freeCopyCount];
+  char *data = uring->copies + (size_t) copy * URING_COPY_SIZE;
+
+  for (int part = 0; part < count; part++) {
+    memcpy(data, parts[part].iov_base, parts[part].iov_len);
+    uring->copyParts[copy][part].iov_base = data;
+    uring->copyParts[copy][part].iov_len = parts[part].iov_len;
+    data += parts[part].iov_len;
+  }
+
+  struct io_uring_sqe *sqe = nextSqe(uring);
+
+  sqe->opcode = IORING_OP_WRITEV;
+  sqe->fd = uring->deviceDescriptor;
+  sqe->addr = (uint64_t) (uintptr_t) uring->copyParts[copy];
+  sqe->len = count;
+  sqe->user_data = URING_COPY | copy;
+
+  queueSqe(uring);
+}
+
+/**
+ * @brief Submits the queued entries and handles the completed reads.
+ *
+ *
+ * Submits every queued read and write, and waits for at least one
+ * completion in the same system call, or until the timeout expires.
+ * Calls the handler provided for every frame read, then posts a new read on
+ * the buffer, unless the handler transmitted a reply from it.
+ * Posts a new read on every buffer whose write completed, whether the write
+ * succeeded or not, as a failed reply is simply dropped, and releases the
+ * buffer of every copy written.
+ * Prints the error and exits the process if a read fails.
+ *
+ * @param[in, out] uring The io_uring instance.
+ * @param[in] handler The handler called for every frame read.
+ * @param[in] context The context passed to the handler.
+ * @param[in] timeout The milliseconds to wait at most for a completion.
+ * @return The number of frames read.
+ */
+
+int runUring(Uring *uring, void (*handler)(void *, char *, int), void *context, int timeout) {
+  int frames = 0;
+
+  enterUring(uring, 1, timeout);
+
+  unsigned head = *uring->cqHead;
+  unsigned tail = __atomic_load_n(uring->cqTail, __ATOMIC_ACQUIRE);
+
+  while (head != tail) {
+    struct io_uring_cqe *cqe = &uring->cqes[head & uring->cqMask];
+    int index = cqe->user_data & URING_INDEX;
+    int result = cqe->res;
+
+    head++;
+
+    if (cqe->user_data & URING_COPY) {
+      uring->freeCopies[uring->freeCopyCount++] = index;
+      continue;
+    }
+
+    if (cqe->user_data & URING_WRITE) {
+      postRead(uring, index);
+      continue;
+    }
+
+    if (result < 0) {
+      if (result != -EINTR && result != -EAGAIN) {
+        printf("Error reading through io_uring: %s\n", strerror(-result));
+        exit(1);
+      }
+
+      postRead(uring, index);
+      continue;
+    }
+
+    uring->replied = 0;
+    handler(context, uring->buffers + index * uring->bufferSize, result);
+    frames++;
+
+    if (!uring->replied) {
+      postRead(uring, index);
+    }
+  }
+
+  __atomic_store_n(uring->cqHead, head, __ATOMIC_RELEASE);
+
+  return frames;
+}
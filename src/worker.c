@@ -0,0 +1,727 @@
+/**
+ * @file worker.c
+ * @author Aryan Chopra
+ * @brief Receives and handles the frames of the queues of the TAP device.
+ *
+ * A worker serves one queue of the TAP device, or of every TAP device when
+ * the stack forwards between several devices.
+ * When the device has a single queue, the worker runs in the main thread.
+ * When the device has several queues, every worker runs in its own thread,
+ * pinned to its own core, with its own cache of packet buffers and its own
+ * copies of the network devices, so the whole path from receiving a frame to
+ * transmitting the reply stays on one core.
+ * A worker can drain a batch of frames per wakeup, and transmit the replies
+ * of the whole batch together.
+ * A worker can also serve its queue through io_uring instead of read() and
+ * write(), or serve a packet socket attached to an existing interface,
+ * handling the frames in place in its receive ring, or an AF_XDP socket,
+ * handling the frames in place in its UMEM.
+ * Whatever it serves, a worker runs the protocol timers which expired on
+ * every iteration of its loop.
+ * A worker reading TAP queues waits for them in an event loop, which busy
+ * polls for a while after traffic when configured to, and otherwise sleeps
+ * until a queue is readable or its next timer is due.
+ * The other workers never wait for frames longer than a timer tick.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "arp.h"
+#include "epoch.h"
+#include "ethernet.h"
+#include "event_loop.h"
+#include "graph.h"
+#include "ip.h"
+#include "log.h"
+#include "netdev.h"
+#include "packet.h"
+#include "packet_buffer.h"
+#include "packet_mmap.h"
+#include "pipeline.h"
+#include "reassembly.h"
+#include "rss.h"
+#include "spsc_ring.h"
+#include "timer.h"
+#include "uring.h"
+#include "worker.h"
+#include "xsk.h"
+
+#define FRAME_SIZE 2500 ///Size of a receive buffer owned by io_uring.
+
+/**
+ * @brief Handles a parsed frame based on the type of its payload.
+ *
+ *
+ * Logs the incoming ethernet header for an ARP type payload.
+ * Only ARP and IP type payloads are supported yet.
+ *
+ * @param[in] netdev A struct emulating a network device having an IP and a MAC address.
+ * @param[in, out] packet The descriptor of the frame.
+ */
+
+static void handlePacket(Netdev *netdev, Packet *packet) {
+  switch(packet->ethertype) {
+    case ETH_P_ARP:
+      log(packet->ethernet, L_ETHERNET | L_INCOMING);
+      incomingRequest(netdev, packet);
+      break;
+    case ETH_P_IP:
+      ipIncoming(netdev, packet);
+      break;
+    default:
+      return;
+  }
+}
+
+/*
+ * @brief Handles the incoming frame.
+ *
+ *
+ * Parses the incoming ethernet frame into its descriptor once, and drops
+ * it if it is truncated or malformed.
+ * Handles the frame based on the type of payload.
+ * Calls various functions designed to handle the ethernet packet.
+ *
+ * @param[in] netdev A struct emulating a network device having an IP and a MAC address.
+ * @param[in, out] frame The frame received.
+ * Various fields, such as source and destination address, underlying payload is modified depending on the type of request.
+ * @param[in] length The length of the frame received.
+ */
+
+void handleFrame(Netdev *netdev, char *frame, int length) {
+  Packet packet;
+
+  if (parsePacket(&packet, frame, length) != 0) {
+    return;
+  }
+
+  handlePacket(netdev, &packet);
+}
+
+/**
+ * @brief Handles the frame received in a buffer of the packet pool.
+ *
+ *
+ * Handles the frame like handleFrame(), recording the buffer in the
+ * descriptor so the layers can hold on to it, such as the reassembly
+ * holding a fragment without copying it.
+ *
+ * @param[in] netdev A struct emulating a network device having an IP and a MAC address.
+ * @param[in, out] buffer The buffer holding the frame received.
+ */
+
+void handleBuffer(Netdev *netdev, PacketBuffer *buffer) {
+  Packet packet;
+
+  if (parsePacket(&packet, buffer->data, buffer->length) != 0) {
+    return;
+  }
+
+  packet.buffer = buffer;
+  handlePacket(netdev, &packet);
+}
+
+/**
+ * @brief Runs the protocol timers which expired.
+ *
+ *
+ * Called after the replies of an iteration are flushed, so the frames the
+ * timers transmit do not interleave with a batch.
+ * The worker holds no pointer into the shared tables at that point, so it
+ * announces a quiescent state, and releases the memory retired which no
+ * worker can still be reading.
+ *
+ * @param[in] netdev The network device of the worker, the frames the
+ * timers transmit are sent from.
+ */
+
+static void runTimers(Netdev *netdev) {
+  quiescentEpoch();
+  runArpTimers(netdev);
+  runReassemblyTimers();
+  reclaimEpoch();
+}
+
+/**
+ * @brief Returns the tick the next protocol timer of the calling worker is
+ * due at, at the latest.
+ *
+ * @return The tick, UINT64_MAX when no timer is armed.
+ */
+
+static uint64_t timerDeadline() {
+  uint64_t arp = arpTimerDeadline();
+  uint64_t reassembly = reassemblyTimerDeadline();
+
+  return arp < reassembly ? arp : reassembly;
+}
+
+/**
+ * @brief Reads the next frame of a queue and drops it, as the packet pool
+ * is exhausted.
+ *
+ *
+ * Reading the frame keeps the queue from filling up while the buffers are
+ * held elsewhere, and the drop is counted with the counters of the
+ * pipeline, rather than the process exiting.
+ *
+ * @param[in] netdev The worker's copy of the device whose queue is read.
+ */
+
+static void dropFrame(Netdev *netdev) {
+  char frame[PACKET_DATA_SIZE];
+
+  read(netdev->deviceDescriptor, frame, sizeof(frame));
+  countPipeline(PIPELINE_POOL_DROPS, 1);
+}
+
+/**
+ * @brief Drains up to a batch of frames from a queue without blocking.
+ *
+ *
+ * Reads frames until the queue is empty, the batch is full, or the packet
+ * pool is exhausted.
+ * Every frame is read into its own buffer taken from the packet pool.
+ * Prints the error and exits the process if reading fails.
+ *
+ * @param[in] worker The worker whose queue is drained.
+ * @param[in] netdev The worker's copy of the device whose queue is drained.
+ * @param[out] buffers The buffers the frames are read into, one per frame of
+ * the batch.
+ * @return The number of frames read.
+ * @pre The queue's file descriptor is non blocking.
+ */
+
+static int receiveBatch(Worker *worker, Netdev *netdev, PacketBuffer **buffers) {
+  int count = 0;
+
+  while (count < worker->batch) {
+    PacketBuffer *buffer = allocPacket();
+
+    if (buffer == NULL) {
+      break;
+    }
+
+    buffer->length = read(netdev->deviceDescriptor, buffer->data, packetTailroom(buffer));
+
+    if (buffer->length < 0) {
+      freePacket(buffer);
+
+      if (errno == EAGAIN || errno == EINTR) {
+        break;
+      }
+
+      printf("Error reading queue %d of device %d: %s\n", worker->index, netdev->index, strerror(errno));
+      exit(1);
+    }
+
+    buffers[count++] = buffer;
+  }
+
+  return count;
+}
+
+/**
+ * @brief Continually receives and handles batches of frames of the worker's
+ * queues.
+ *
+ *
+ * Switches the queues to non blocking mode, and watches them in the
+ * worker's event loop.
+ * Waits until any queue is readable, or the next timer is due, then drains
+ * up to a batch of frames from every readable queue and handles them as a
+ * vector through the worker's graph of nodes.
+ * Replies and forwarded packets are queued on the worker's copy of their
+ * device while the vector is handled, and every device is flushed at the
+ * end of the vector, before the buffers of the batch go back to the packet
+ * pool.
+ *
+ * @param[in] worker The worker whose queues are served.
+ */
+
+static void runBatches(Worker *worker) {
+  PacketBuffer *buffers[MAX_DEVICES * MAX_BATCH];
+  EventLoop loop;
+  Graph graph;
+
+  initEventLoop(&loop, worker->busyPoll);
+
+  for (int device = 0; device < worker->deviceCount; device++) {
+    Netdev *netdev = &worker->devices[device];
+    int flags = fcntl(netdev->deviceDescriptor, F_GETFL);
+
+    fcntl(netdev->deviceDescriptor, F_SETFL, flags | O_NONBLOCK);
+    initTxBatch(netdev, worker->batch);
+    watchEventLoop(&loop, netdev->deviceDescriptor, device);
+  }
+
+  while (1) {
+    uint64_t ready = waitEventLoop(&loop, timerDeadline());
+    int count = 0;
+
+    for (int device = 0; device < worker->deviceCount; device++) {
+      Netdev *netdev = &worker->devices[device];
+
+      if (!(ready & (1ULL << device))) {
+        continue;
+      }
+
+      int received = receiveBatch(worker, netdev, buffers + count);
+
+      runGraph(&graph, netdev, buffers + count, received);
+      count += received;
+    }
+
+    for (int index = 0; index < count; index++) {
+      freePacket(buffers[index]);
+    }
+
+    runTimers(worker->devices);
+
+    if (worker->index == 0) {
+      reportPipeline();
+    }
+  }
+}
+
+/**
+ * @brief Handles a frame received in a buffer owned by io_uring or a receive
+ * ring.
+ *
+ * @param[in] context The network device of the worker.
+ * @param[in, out] frame The frame received.
+ * @param[in] length The length of the frame received.
+ */
+
+static void handleRingFrame(void *context, char *frame, int length) {
+  handleFrame(context, frame, length);
+}
+
+/**
+ * @brief Continually receives and handles the frames of the worker's queue
+ * through io_uring.
+ *
+ *
+ * Creates the worker's io_uring instance, which keeps the reads posted, and
+ * attaches it to the worker's network device so the replies are submitted
+ * through it.
+ * Every wakeup submits the replies of the previous frames and handles all
+ * the reads completed since.
+ * The first worker prints the counters of the pipeline periodically.
+ *
+ * @param[in] worker The worker whose queue is served.
+ */
+
+static void runUringWorker(Worker *worker) {
+  Netdev *netdev = worker->devices;
+
+  netdev->uring = initUring(netdev->deviceDescriptor, worker->uringReads, FRAME_SIZE);
+
+  while (1) {
+    runUring(netdev->uring, handleRingFrame, netdev, TIMER_TICK_MS);
+    runTimers(netdev);
+
+    if (worker->index == 0) {
+      reportPipeline();
+    }
+  }
+}
+
+/**
+ * @brief Continually receives and handles the frames of the worker's packet
+ * socket, in place in its receive ring.
+ *
+ *
+ * Maps the receive ring of the socket.
+ * Handles every frame of a block where the kernel wrote it.
+ * The replies built in the block are written to the socket, directly or at
+ * the end of the block when a batch size is configured, before the block is
+ * handed back to the kernel.
+ * The first worker prints the counters of the pipeline periodically.
+ *
+ * @param[in] worker The worker whose packet socket is served.
+ */
+
+static void runPacketWorker(Worker *worker) {
+  Netdev *netdev = worker->devices;
+  PacketRing *ring = mapPacketRing(netdev->deviceDescriptor);
+
+  if (worker->batch > 1) {
+    initTxBatch(netdev, worker->batch);
+  }
+
+  while (1) {
+    if (receivePacketBlock(ring, handleRingFrame, netdev, TIMER_TICK_MS) >= 0) {
+      flushNetdev(netdev);
+      releasePacketBlock(ring);
+    }
+
+    runTimers(netdev);
+
+    if (worker->index == 0) {
+      reportPipeline();
+    }
+  }
+}
+
+/**
+ * @brief Continually receives and handles the frames of the worker's AF_XDP
+ * socket, in place in its UMEM.
+ *
+ *
+ * Opens the AF_XDP socket on the interface's queue the worker serves, and
+ * attaches it to the worker's network device so the replies are posted to
+ * its transmit ring.
+ * Every wakeup handles all the descriptors received, and hands the replies
+ * rewritten in place to the kernel.
+ * The first worker prints the counters of the pipeline periodically.
+ *
+ * @param[in] worker The worker whose queue is served.
+ */
+
+static void runXskWorker(Worker *worker) {
+  Netdev *netdev = worker->devices;
+
+  netdev->xsk = openXsk(worker->xdpInterface, worker->index);
+  netdev->deviceDescriptor = netdev->xsk->socketDescriptor;
+
+  while (1) {
+    runXsk(netdev->xsk, handleRingFrame, netdev, TIMER_TICK_MS);
+    runTimers(netdev);
+
+    if (worker->index == 0) {
+      reportPipeline();
+    }
+  }
+}
+
+/**
+ * @brief Continually handles the frames the dispatcher pushes to the
+ * worker's ring.
+ *
+ *
+ * Pops up to a batch of frames per iteration and handles them as a vector
+ * through the worker's graph of nodes, the replies being written to the TAP
+ * queue at the end of the vector, or handed to the transmit thread when the
+ * pipeline has one.
+ * Sleeps on the ring for a timer tick at most while it is empty.
+ *
+ * @param[in] worker The worker whose ring is served.
+ */
+
+static void runRingWorker(Worker *worker) {
+  Netdev *netdev = worker->devices;
+  PacketBuffer *buffers[MAX_BATCH];
+  Graph graph;
+
+  initTxBatch(netdev, worker->batch);
+
+  while (1) {
+    int count = popSpscRing(worker->ring, (void **) buffers, worker->batch);
+
+    if (count == 0) {
+      waitSpscRing(worker->ring, TIMER_TICK_MS);
+    }
+    else {
+      runGraph(&graph, netdev, buffers, count);
+    }
+
+    for (int index = 0; index < count; index++) {
+      freePacket(buffers[index]);
+    }
+
+    runTimers(netdev);
+  }
+}
+
+/**
+ * @brief Continually reads the frames of the single TAP queue, and hands
+ * every frame to the worker of its flow.
+ *
+ *
+ * Switches the queue to non blocking mode, and waits for it in an event
+ * loop, busy polling after traffic when configured to.
+ * Drains up to a batch of frames per wakeup, parses every frame to hash its
+ * flow, and pushes the frames of every worker to its ring in one burst, so
+ * every flow is handled by one worker, in order.
+ * The frames a ring has no room for are dropped, like a network card drops
+ * the frames of a full queue, so a worker slowed down by the transmit side
+ * never stalls the queue.
+ * Counts the frames dispatched and dropped, and prints the counters of the
+ * pipeline periodically.
+ * Prints the error and exits the process if reading fails.
+ *
+ * @param[in] workers The workers, the first one providing the queue and the
+ * batch size.
+ * @param[in] count The number of workers.
+ */
+
+static void runDispatcher(Worker *workers, int count) {
+  Netdev *netdev = workers[0].devices;
+  PacketBuffer *buffers[MAX_BATCH];
+  PacketBuffer *bursts[MAX_QUEUES][MAX_BATCH];
+  int burstCounts[MAX_QUEUES];
+  int flags = fcntl(netdev->deviceDescriptor, F_GETFL);
+  EventLoop loop;
+
+  fcntl(netdev->deviceDescriptor, F_SETFL, flags | O_NONBLOCK);
+  initEventLoop(&loop, workers[0].busyPoll);
+  watchEventLoop(&loop, netdev->deviceDescriptor, 0);
+  initRss();
+
+  while (1) {
+    int received = waitEventLoop(&loop, UINT64_MAX) ? receiveBatch(&workers[0], netdev, buffers) : 0;
+
+    for (int worker = 0; worker < count; worker++) {
+      burstCounts[worker] = 0;
+    }
+
+    for (int index = 0; index < received; index++) {
+      Packet packet;
+
+      if (parsePacket(&packet, buffers[index]->data, buffers[index]->length) != 0) {
+        freePacket(buffers[index]);
+        continue;
+      }
+
+      int worker = ((uint64_t) hashFlow(&packet) * count) >> 32;
+
+      bursts[worker][burstCounts[worker]++] = buffers[index];
+    }
+
+    for (int worker = 0; worker < count; worker++) {
+      int pushed = pushSpscRing(workers[worker].ring, (void **) bursts[worker], burstCounts[worker]);
+
+      for (int index = pushed; index < burstCounts[worker]; index++) {
+        freePacket(bursts[worker][index]);
+      }
+
+      countPipeline(PIPELINE_RX_FRAMES, pushed);
+      countPipeline(PIPELINE_RX_DROPS, burstCounts[worker] - pushed);
+    }
+
+    reportPipeline();
+  }
+}
+
+/**
+ * @brief Continually receives and handles the frames of the worker's queue.
+ *
+ *
+ * Reads ethernet frames from the queue's file descriptor into buffers taken
+ * from the packet pool, and handles every frame.
+ * With several devices, waits for any of the worker's queues to become
+ * readable, and drains them in batches.
+ * Waits for a frame in the worker's event loop, until the next protocol
+ * timer is due at most, and runs the expired protocol timers after every
+ * frame or timeout.
+ * Reads and drops the frame when the packet pool is exhausted, counting it,
+ * rather than exiting.
+ * The first worker prints the counters of the pipeline periodically.
+ * With a batch larger than one, waits for the queue to become readable,
+ * drains up to a batch of frames without blocking, handles them one after
+ * another, and then flushes every reply of the batch together.
+ * With io_uring, keeps fixed-buffer reads posted on the queue and handles
+ * every completed read, submitting the replies without blocking.
+ * With a packet socket, handles the frames in place in the blocks of its
+ * receive ring.
+ * With an AF_XDP socket, handles the frames in place in its UMEM.
+ * With a ring, handles the frames the dispatcher pushes to it.
+ * Registers the worker as a reader of the shared tables first.
+ * Prints the error and exits the process if reading fails.
+ *
+ * @param[in] worker The worker whose queue is served.
+ */
+
+void runWorker(Worker *worker) {
+  Netdev *netdev = worker->devices;
+
+  registerEpochReader();
+
+  if (worker->ring != NULL) {
+    runRingWorker(worker);
+    return;
+  }
+
+  if (worker->xdpInterface != NULL) {
+    runXskWorker(worker);
+    return;
+  }
+
+  if (worker->packetRing) {
+    runPacketWorker(worker);
+    return;
+  }
+
+  if (worker->uringReads > 0) {
+    runUringWorker(worker);
+    return;
+  }
+
+  if (worker->batch > 1 || worker->deviceCount > 1) {
+    runBatches(worker);
+    return;
+  }
+
+  EventLoop loop;
+
+  initEventLoop(&loop, worker->busyPoll);
+  watchEventLoop(&loop, netdev->deviceDescriptor, 0);
+
+  while (1) {
+    if (waitEventLoop(&loop, timerDeadline())) {
+      PacketBuffer *buffer = allocPacket();
+
+      if (buffer == NULL) {
+        dropFrame(netdev);
+      }
+      else {
+        buffer->length = read(netdev->deviceDescriptor, buffer->data, packetTailroom(buffer));
+
+        if (buffer->length < 0) {
+          printf("Error reading queue %d: %s\n", worker->index, strerror(errno));
+          exit(1);
+        }
+
+        handleBuffer(netdev, buffer);
+        freePacket(buffer);
+      }
+    }
+
+    runTimers(netdev);
+
+    if (worker->index == 0) {
+      reportPipeline();
+    }
+  }
+}
+
+/**
+ * @brief Entry point of a worker thread.
+ *
+ *
+ * Pins the thread to the core assigned to the worker, so the queue's frames
+ * are always handled on the same core.
+ * Serves the worker's queue.
+ *
+ * @param[in] argument The worker to run.
+ * @return Never returns.
+ */
+
+static void *workerThread(void *argument) {
+  Worker *worker = argument;
+  cpu_set_t cores;
+
+  CPU_ZERO(&cores);
+  CPU_SET(worker->core, &cores);
+
+  if (pthread_setaffinity_np(pthread_self(), sizeof(cores), &cores) != 0) {
+    printf("Could not pin queue %d to core %d\n", worker->index, worker->core);
+  }
+
+  runWorker(worker);
+  return NULL;
+}
+
+/**
+ * @brief Starts a worker thread for every queue, and waits for them.
+ *
+ *
+ * Copies every network device provided for every worker, assigning the file
+ * descriptor of the worker's queue of the device to the copy, and linking
+ * the copies of the worker together.
+ * Starts one thread per queue, each pinned to its own core.
+ * Cores are assigned round robin when there are more queues than cores.
+ * Runs the worker in the calling thread instead, without pinning it, when
+ * there is a single queue.
+ * When the frames are spread by flow hash, starts the configured number of
+ * workers, each with its own ring and sharing the single queue to write
+ * their replies, and dispatches the frames of the queue to them from the
+ * calling thread.
+ * With a transmit batch configured, the workers hand their replies to a
+ * transmit thread instead, through a ring per worker.
+ * Waits for the threads, which run until the process exits.
+ *
+ * @param[in] devices The network devices the queues belong to.
+ * @param[in] deviceCount The number of network devices.
+ * @param[in] queues The file descriptors of the queues of every device.
+ * @param[in] config The configuration, providing the number of queues,
+ * the batch size, the io_uring reads, whether the queues are packet or
+ * AF_XDP sockets, and the number of workers and transmit batch of the
+ * flow hash dispatch.
+ */
+
+void startWorkers(Netdev *devices, int deviceCount, int (*queues)[MAX_QUEUES], Config *config) {
+  int dispatch = config->rssWorkers > 0;
+  int count = dispatch ? config->rssWorkers : config->queues;
+  Worker *workers = calloc(count, sizeof(Worker));
+  Transmitter *transmitter = NULL;
+  long cores = sysconf(_SC_NPROCESSORS_ONLN);
+
+  if (cores < 1) {
+    cores = 1;
+  }
+
+  if (dispatch && config->txBatch > 0) {
+    transmitter = startTransmitter(queues[0][0], count, config->txBatch);
+  }
+
+  for (int index = 0; index < count; index++) {
+    Worker *worker = &workers[index];
+
+    worker->index = index;
+    worker->core = index % cores;
+    worker->devices = calloc(deviceCount, sizeof(Netdev));
+    worker->deviceCount = deviceCount;
+    worker->batch = config->batch;
+    worker->uringReads = config->uringReads;
+    worker->packetRing = config->packetInterface != NULL;
+    worker->xdpInterface = config->xdpInterface;
+    worker->ring = dispatch ? newSpscRing(RSS_RING_LEN) : NULL;
+    worker->busyPoll = config->busyPoll;
+
+    if (worker->devices == NULL) {
+      printf("Could not allocate the devices of queue %d\n", index);
+      exit(1);
+    }
+
+    for (int device = 0; device < deviceCount; device++) {
+      worker->devices[device] = devices[device];
+      worker->devices[device].deviceDescriptor = queues[device][dispatch ? 0 : index];
+      worker->devices[device].devices = worker->devices;
+      worker->devices[device].deviceCount = deviceCount;
+      worker->devices[device].txRing = transmitter != NULL ? transmitter->rings[index] : NULL;
+    }
+  }
+
+  if (count == 1 && !dispatch) {
+    runWorker(&workers[0]);
+    return;
+  }
+
+  for (int index = 0; index < count; index++) {
+    if (pthread_create(&workers[index].thread, NULL, workerThread, &workers[index]) != 0) {
+      printf("Could not start worker for queue %d\n", index);
+      exit(1);
+    }
+  }
+
+  if (dispatch) {
+    runDispatcher(workers, count);
+  }
+
+  for (int index = 0; index < count; index++) {
+    pthread_join(workers[index].thread, NULL);
+  }
+
+  free(workers);
+}
@@ -0,0 +1,432 @@
+/**
+ * @file xsk.c
+ * @author Aryan Chopra
+ * @brief Receives and transmits the frames of an existing interface through
+ * AF_XDP sockets.
+ *
+ * An XDP program attached to the interface redirects the frames of every
+ * queue to the AF_XDP socket registered for the queue in an XSKMAP.
+ * The kernel writes the frames into the socket's UMEM, a frame pool shared
+ * with the process, and hands their descriptors over through the receive
+ * ring.
+ * The frames are handled in place in the UMEM, and a reply rewritten in
+ * place is posted to the transmit ring without any copy.
+ * The sockets are bound in copy mode, which every driver supports, so the
+ * stack runs on a local veth pair.
+ * The program is loaded through the raw bpf system call, as the stack does
+ * not depend on libbpf.
+ */
+
+#include <errno.h>
+#include <linux/bpf.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+#include <net/if.h>
+#include <poll.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "xsk.h"
+
+#ifndef AF_XDP
+#define AF_XDP 44
+#endif
+
+#define XSK_SPARE_FRAMES 64 ///Number of frames kept out of the fill ring to copy foreign frames into.
+
+/**
+ * File descriptor of the XSKMAP the sockets register in.
+ */
+
+static int xskMap = -1;
+
+/**
+ * @brief Prints the error of a failed AF_XDP or bpf call and exits the
+ * process.
+ *
+ * @param[in] call A description of the call which failed.
+ */
+
+static void xskError(char *call) {
+  printf("Error %s: %s\n", call, strerror(errno));
+  exit(1);
+}
+
+/**
+ * @brief Issues a bpf system call.
+ *
+ * @param[in] command The bpf command.
+ * @param[in, out] attributes The attributes of the command.
+ * @return The result of the system call.
+ */
+
+static int bpf(int command, union bpf_attr *attributes) {
+  return syscall(__NR_bpf, command, attributes, sizeof(*attributes));
+}
+
+/**
+ * @brief Attaches the XDP program redirecting the frames of an interface to
+ * the AF_XDP sockets.
+ *
+ *
+ * Creates the XSKMAP the sockets register in, one entry per queue.
+ * Loads a program redirecting every frame to the socket of its receive
+ * queue, or passing it to the kernel if the queue has no socket.
+ * Attaches the program to the interface in generic mode, which works on
+ * every driver, including veth.
+ * The program stays attached until the process exits, as it is attached
+ * through a link owned by the process.
+ * Prints the error and exits the process on failure.
+ *
+ * @param[in] name The name of the interface.
+ */
+
+void attachXdpProgram(char *name) {
+  union bpf_attr attributes;
+  char verifierLog[1024] = "";
+
+  memset(&attributes, 0, sizeof(attributes));
+  attributes.map_type = BPF_MAP_TYPE_XSKMAP;
+  attributes.key_size = sizeof(uint32_t);
+  attributes.value_size = sizeof(uint32_t);
+  attributes.max_entries = MAX_QUEUES;
+
+  xskMap = bpf(BPF_MAP_CREATE, &attributes);
+  if (xskMap < 0) {
+    xskError("creating the XSKMAP");
+  }
+
+  //r2 = ctx->rx_queue_index; r1 = xskMap; r3 = XDP_PASS; return bpf_redirect_map(r1, r2, r3)
+  struct bpf_insn program[] = {
+    {.code = BPF_LDX | BPF_MEM | BPF_W, .dst_reg = BPF_REG_2, .src_reg = BPF_REG_1, .off = offsetof(struct xdp_md, rx_queue_index)},
+    {.code = BPF_LD | BPF_DW | BPF_IMM, .dst_reg = BPF_REG_1, .src_reg = BPF_PSEUDO_MAP_FD, .imm = xskMap},
+    {.code = 0},
+    {.code = BPF_ALU64 | BPF_MOV | BPF_K, .dst_reg = BPF_REG_3, .imm = XDP_PASS},
+    {.code = BPF_JMP | BPF_CALL, .imm = BPF_FUNC_redirect_map},
+    {.code = BPF_JMP | BPF_EXIT},
+  };
+
+  memset(&attributes, 0, sizeof(attributes));
+  attributes.prog_type = BPF_PROG_TYPE_XDP;
+  attributes.insns = (uint64_t) (uintptr_t) program;
+  attributes.insn_cnt = sizeof(program) / sizeof(program[0]);
+  attributes.license = (uint64_t) (uintptr_t) "GPL";
+  attributes.log_buf = (uint64_t) (uintptr_t) verifierLog;
+  attributes.log_size = sizeof(verifierLog);
+  attributes.log_level = 1;
+
+  int programDescriptor = bpf(BPF_PROG_LOAD, &attributes);
+  if (programDescriptor < 0) {
+    printf("%s", verifierLog);
+    xskError("loading the XDP program");
+  }
+
+  memset(&attributes, 0, sizeof(attributes));
+  attributes.link_create.prog_fd = programDescriptor;
+  attributes.link_create.target_ifindex = if_nametoindex(name);
+  attributes.link_create.attach_type = BPF_XDP;
+  attributes.link_create.flags = XDP_FLAGS_SKB_MODE;
+
+  if (attributes.link_create.target_ifindex == 0) {
+    xskError("finding the interface");
+  }
+
+  if (bpf(BPF_LINK_CREATE, &attributes) < 0) {
+    xskError("attaching the XDP program");
+  }
+}
+
+/**
+ * @brief Maps one of the rings of the socket.
+ *
+ * @param[in] device The file descriptor of the socket.
+ * @param[in] offsets The offsets of the ring's fields, reported by the kernel.
+ * @param[in] pageOffset The offset the ring is mapped at.
+ * @param[in] size The number of descriptors in the ring.
+ * @param[in] descriptorSize The size of a descriptor of the ring.
+ * @param[out] ring The ring mapped.
+ */
+
+static void mapRing(int device, struct xdp_ring_offset *offsets, off_t pageOffset, uint32_t size, size_t descriptorSize, XskRing *ring) {
+  char *map = mmap(NULL, offsets->desc + size * descriptorSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, device, pageOffset);
+
+  if (map == MAP_FAILED) {
+    xskError("mapping a ring");
+  }
+
+  ring->producer = (uint32_t *) (map + offsets->producer);
+  ring->consumer = (uint32_t *) (map + offsets->consumer);
+  ring->descriptors = map + offsets->desc;
+  ring->mask = size - 1;
+}
+
+/**
+ * @brief Returns the number of descriptors a ring can still take.
+ *
+ * @param[in] ring A ring the stack produces to.
+ * @return The number of free descriptors.
+ */
+
+static uint32_t ringFree(XskRing *ring) {
+  return ring->mask + 1 - (*ring->producer - __atomic_load_n(ring->consumer, __ATOMIC_ACQUIRE));
+}
+
+/**
+ * @brief Returns the number of descriptors waiting in a ring.
+ *
+ * @param[in] ring A ring the stack consumes from.
+ * @return The number of descriptors waiting.
+ */
+
+static uint32_t ringWaiting(XskRing *ring) {
+  return __atomic_load_n(ring->producer, __ATOMIC_ACQUIRE) - *ring->consumer;
+}
+
+/**
+ * @brief Hands a frame of the UMEM back to the kernel to receive into.
+ *
+ *
+ * Frames which are spares are kept aside instead.
+ * The fill ring holds as many descriptors as the UMEM has frames, so it can
+ * always take the frame.
+ *
+ * @param[in, out] xsk The socket.
+ * @param[in] address The address of the frame in the UMEM.
+ */
+
+static void refill(Xsk *xsk, uint64_t address) {
+  address &= ~((uint64_t) XSK_FRAME_SIZE - 1);
+
+  if (address < (uint64_t) XSK_SPARE_FRAMES * XSK_FRAME_SIZE) {
+    xsk->spare[xsk->spareCount++] = address;
+    return;
+  }
+
+  uint32_t producer = *xsk->fill.producer;
+
+  ((uint64_t *) xsk->fill.descriptors)[producer & xsk->fill.mask] = address;
+  __atomic_store_n(xsk->fill.producer, producer + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Hands the frames whose transmission completed back to the fill
+ * ring.
+ *
+ * @param[in, out] xsk The socket.
+ */
+
+static void reclaimCompletions(Xsk *xsk) {
+  uint32_t waiting = ringWaiting(&xsk->completion);
+  uint32_t consumer = *xsk->completion.consumer;
+
+  for (uint32_t index = 0; index < waiting; index++) {
+    refill(xsk, ((uint64_t *) xsk->completion.descriptors)[(consumer + index) & xsk->completion.mask]);
+  }
+
+  __atomic_store_n(xsk->completion.consumer, consumer + waiting, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Opens an AF_XDP socket on one queue of an interface.
+ *
+ *
+ * Allocates and registers the UMEM, and sets up and maps the fill,
+ * completion, receive and transmit rings.
+ * Binds the socket to the queue in copy mode.
+ * Hands all the frames but a few spares to the fill ring.
+ * Registers the socket in the XSKMAP, so the program redirects the queue's
+ * frames to it.
+ * Prints the error and exits the process on failure.
+ *
+ * @param[in] name The name of the interface.
+ * @param[in] queue The queue of the interface.
+ * @return The socket opened.
+ * @pre attachXdpProgram was called on the interface.
+ */
+
+Xsk *openXsk(char *name, int queue) {
+  Xsk *xsk = calloc(1, sizeof(Xsk));
+  struct xdp_umem_reg umem;
+  struct xdp_mmap_offsets offsets;
+  struct sockaddr_xdp address;
+  socklen_t length = sizeof(offsets);
+  int fillSize = XSK_FRAME_COUNT;
+  int ringSize = XSK_RING_SIZE;
+
+  xsk->socketDescriptor = socket(AF_XDP, SOCK_RAW, 0);
+  if (xsk->socketDescriptor < 0) {
+    xskError("opening AF_XDP socket");
+  }
+
+  xsk->umem = aligned_alloc(getpagesize(), (size_t) XSK_FRAME_COUNT * XSK_FRAME_SIZE);
+
+  memset(&umem, 0, sizeof(umem));
+  umem.addr = (uint64_t) (uintptr_t) xsk->umem;
+  umem.len = (uint64_t) XSK_FRAME_COUNT * XSK_FRAME_SIZE;
+  umem.chunk_size = XSK_FRAME_SIZE;
+
+  if (setsockopt(xsk->socketDescriptor, SOL_XDP, XDP_UMEM_REG, &umem, sizeof(umem)) < 0) {
+    xskError("registering the UMEM");
+  }
+
+  if (setsockopt(xsk->socketDescriptor, SOL_XDP, XDP_UMEM_FILL_RING, &fillSize, sizeof(fillSize)) < 0 ||
+      setsockopt(xsk->socketDescriptor, SOL_XDP, XDP_UMEM_COMPLETION_RING, &ringSize, sizeof(ringSize)) < 0 ||
+      setsockopt(xsk->socketDescriptor, SOL_XDP, XDP_RX_RING, &ringSize, sizeof(ringSize)) < 0 ||
+      setsockopt(xsk->socketDescriptor, SOL_XDP, XDP_TX_RING, &ringSize, sizeof(ringSize)) < 0) {
+    xskError("sizing the rings");
+  }
+
+  if (getsockopt(xsk->socketDescriptor, SOL_XDP, XDP_MMAP_OFFSETS, &offsets, &length) < 0) {
+    xskError("reading the ring offsets");
+  }
+
+  mapRing(xsk->socketDescriptor, &offsets.fr, XDP_UMEM_PGOFF_FILL_RING, fillSize, sizeof(uint64_t), &xsk->fill);
+  mapRing(xsk->socketDescriptor, &offsets.cr, XDP_UMEM_PGOFF_COMPLETION_RING, ringSize, sizeof(uint64_t), &xsk->completion);
+  mapRing(xsk->socketDescriptor, &offsets.rx, XDP_PGOFF_RX_RING, ringSize, sizeof(struct xdp_desc), &xsk->rx);
+  mapRing(xsk->socketDescriptor, &offsets.tx, XDP_PGOFF_TX_RING, ringSize, sizeof(struct xdp_desc), &xsk->tx);
+
+  xsk->spare = calloc(XSK_SPARE_FRAMES, sizeof(uint64_t));
+
+  for (int frame = 0; frame < XSK_FRAME_COUNT; frame++) {
+    refill(xsk, (uint64_t) frame * XSK_FRAME_SIZE);
+  }
+
+  memset(&address, 0, sizeof(address));
+  address.sxdp_family = AF_XDP;
+  address.sxdp_ifindex = if_nametoindex(name);
+  address.sxdp_queue_id = queue;
+  address.sxdp_flags = XDP_COPY;
+
+  if (bind(xsk->socketDescriptor, (struct sockaddr *) &address, sizeof(address)) < 0) {
+    xskError("binding AF_XDP socket");
+  }
+
+  union bpf_attr attributes;
+  uint32_t key = queue;
+
+  memset(&attributes, 0, sizeof(attributes));
+  attributes.map_fd = xskMap;
+  attributes.key = (uint64_t) (uintptr_t) &key;
+  attributes.value = (uint64_t) (uintptr_t) &xsk->socketDescriptor;
+
+  if (bpf(BPF_MAP_UPDATE_ELEM, &attributes) < 0) {
+    xskError("registering the socket in the XSKMAP");
+  }
+
+  return xsk;
+}
+
+/**
+ * @brief Posts a frame to the transmit ring of the socket.
+ *
+ *
+ * A frame lying in the UMEM, which is the case for every reply rewritten in
+ * place, is posted without any copy, and held until its transmission
+ * completes.
+ * Any other frame is copied into a spare frame first.
+ * The frame is dropped if the transmit ring is full, or no spare frame is
+ * left to copy it into.
+ *
+ * @param[in, out] xsk The socket.
+ * @param[in] frame The frame to transmit.
+ * @param[in] length The length of the frame.
+ */
+
+void transmitXsk(Xsk *xsk, char *frame, int length) {
+  long offset = frame - xsk->umem;
+  int inPlace = offset >= 0 && offset < (long) XSK_FRAME_COUNT * XSK_FRAME_SIZE;
+
+  if (ringFree(&xsk->tx) == 0) {
+    reclaimCompletions(xsk);
+    return;
+  }
+
+  if (!inPlace) {
+    if (xsk->spareCount == 0 || length > XSK_FRAME_SIZE) {
+      return;
+    }
+
+    offset = xsk->spare[--xsk->spareCount];
+    memcpy(xsk->umem + offset, frame, length);
+  }
+
+  uint32_t producer = *xsk->tx.producer;
+  struct xdp_desc *descriptor = &((struct xdp_desc *) xsk->tx.descriptors)[producer & xsk->tx.mask];
+
+  descriptor->addr = offset;
+  descriptor->len = length;
+  descriptor->options = 0;
+
+  __atomic_store_n(xsk->tx.producer, producer + 1, __ATOMIC_RELEASE);
+  xsk->queued++;
+
+  if (inPlace) {
+    xsk->replied = 1;
+  }
+}
+
+/**
+ * @brief Handles the frames received on the socket.
+ *
+ *
+ * Waits until frames are received, or the timeout expires, if the receive
+ * ring is empty.
+ * Calls the handler provided for every descriptor of the receive ring, with
+ * the frame in place in the UMEM.
+ * Hands every frame not transmitted back to the fill ring.
+ * Wakes the kernel up to transmit the frames posted, as a socket in copy
+ * mode only transmits when asked to, and hands the frames whose
+ * transmission completed back to the fill ring.
+ *
+ * @param[in, out] xsk The socket.
+ * @param[in] handler The handler called for every frame.
+ * @param[in] context The context passed to the handler.
+ * @param[in] timeout The milliseconds to wait at most for a frame.
+ * @return The number of frames handled.
+ */
+
+int runXsk(Xsk *xsk, void (*handler)(void *, char *, int), void *context, int timeout) {
+  uint32_t waiting = ringWaiting(&xsk->rx);
+
+  if (waiting == 0) {
+    struct pollfd socket = {.fd = xsk->socketDescriptor, .events = POLLIN};
+
+    if (poll(&socket, 1, timeout) < 0 && errno != EINTR) {
+      xskError("polling AF_XDP socket");
+    }
+
+    waiting = ringWaiting(&xsk->rx);
+  }
+
+  uint32_t consumer = *xsk->rx.consumer;
+
+  for (uint32_t index = 0; index < waiting; index++) {
+    struct xdp_desc *descriptor = &((struct xdp_desc *) xsk->rx.descriptors)[(consumer + index) & xsk->rx.mask];
+
+    xsk->replied = 0;
+    handler(context, xsk->umem + descriptor->addr, descriptor->len);
+
+    if (!xsk->replied) {
+      refill(xsk, descriptor->addr);
+    }
+  }
+
+  __atomic_store_n(xsk->rx.consumer, consumer + waiting, __ATOMIC_RELEASE);
+
+  if (xsk->queued > 0) {
+    sendto(xsk->socketDescriptor, NULL, 0, MSG_DONTWAIT, NULL, 0);
+    xsk->queued = 0;
+  }
+
+  reclaimCompletions(xsk);
+
+  return waiting;
+}